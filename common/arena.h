@@ -0,0 +1,95 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include "macros.h"
+
+namespace Common{
+
+constexpr size_t ARENA_BLOCK_BYTES = 1024ul * 1024 * 1024;
+
+/*
+Bump allocator for objects that live as long as the arena, such as order books created while the exchange
+runs. Memory comes from anonymous mappings reserved ARENA_BLOCK_BYTES at a time (larger requests get a
+mapping of their own) with MAP_NORESERVE, so only pages that are written count against the machine's
+memory, and every allocation starts out zeroed because nothing is ever handed out twice. Nothing is freed
+before the arena is destroyed, objects with destructors have to be destroyed by their owner first.
+Single threaded, the thread that owns the objects allocates them.
+*/
+class Arena final{
+private:
+    struct Block{
+        char* begin_;
+        size_t size_;
+    };
+
+    std::vector<Block> blocks_;
+    char* next_ = nullptr;
+    char* end_ = nullptr;
+    size_t reserved_bytes_ = 0;
+    size_t allocated_bytes_ = 0;
+
+    auto Map(size_t size) -> char*{
+        const auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(UNLIKELY(memory == MAP_FAILED)){
+            FATAL("Arena failed to map " + std::to_string(size) + " bytes error: " + std::string(std::strerror(errno)));
+        }
+        blocks_.push_back(Block{static_cast<char*>(memory), size});
+        reserved_bytes_ += size;
+        return static_cast<char*>(memory);
+    }
+
+public:
+    Arena() = default;
+
+    ~Arena(){
+        for(const auto& block : blocks_){
+            munmap(block.begin_, block.size_);
+        }
+        blocks_.clear();
+    }
+
+    Arena(const Arena&) = delete;
+    Arena(const Arena&&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena& operator=(const Arena&&) = delete;
+
+    // zeroed memory for bytes, aligned to align (a power of two no larger than a page)
+    auto Allocate(size_t bytes, size_t align) -> void*{
+        auto aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(next_) + align - 1) & ~(align - 1));
+        if(!next_ || aligned + bytes > end_){
+            if(bytes > ARENA_BLOCK_BYTES / 2){
+                // big enough to get its own mapping, the current block keeps its free space
+                allocated_bytes_ += bytes;
+                return Map(bytes);
+            }
+            next_ = Map(ARENA_BLOCK_BYTES);
+            end_ = next_ + ARENA_BLOCK_BYTES;
+            aligned = next_;
+        }
+        next_ = aligned + bytes;
+        allocated_bytes_ += bytes;
+        return aligned;
+    }
+
+    // constructs a T in arena memory, the caller calls its destructor
+    template<typename T, typename... Args>
+    auto New(Args&&... args) -> T*{
+        return new(Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    auto GetReservedBytes() const noexcept{
+        return reserved_bytes_;
+    }
+
+    auto GetAllocatedBytes() const noexcept{
+        return allocated_bytes_;
+    }
+};
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "time_utils.h"
+#include "perf_counters.h"
+
+namespace Common{
+
+/* Every result is printed as one human readable line. When the BENCHMARK_JSON environment variable names
+   a file, the result is also appended to it as one JSON object per line:
+   {"benchmark":"<binary>","name":"<result>","kind":"latency|throughput|metrics",<metric>:<number>,...}
+   so runs on different machines or commits can be compared with a script. */
+
+typedef std::initializer_list<std::pair<std::string_view, double>> BenchmarkMetrics;
+
+// integers are printed exactly, everything else with enough digits to compare runs
+inline auto FormatMetric(double value){
+    char buffer[64];
+    if(std::isfinite(value) && value == std::trunc(value) && std::fabs(value) < 1e15){
+        std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+    }else if(std::isfinite(value)){
+        std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+    }else{
+        // JSON has no inf or nan
+        std::snprintf(buffer, sizeof(buffer), "null");
+    }
+    return std::string(buffer);
+}
+
+inline auto JsonEscape(std::string_view text){
+    std::string escaped;
+    for(const auto c : text){
+        if(c == '"' || c == '\\'){
+            escaped += '\\';
+        }
+        if(static_cast<unsigned char>(c) >= 0x20){
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// appends one result to the BENCHMARK_JSON file, does nothing when the variable is not set
+inline auto WriteBenchmarkJson(const std::string& name, std::string_view kind, BenchmarkMetrics metrics) noexcept{
+    static FILE* file = [](){
+        const auto path = std::getenv("BENCHMARK_JSON");
+        FILE* json = (path && *path ? std::fopen(path, "a") : nullptr);
+        if(path && *path && !json){
+            std::cerr << "Could not open BENCHMARK_JSON file " << path << " error: " << std::strerror(errno) << std::endl;
+        }
+        return json;
+    }();
+    if(!file){
+        return;
+    }
+    std::string line = "{\"benchmark\":\"" + JsonEscape(program_invocation_short_name) + "\",\"name\":\"" + JsonEscape(name)
+                       + "\",\"kind\":\"" + std::string(kind) + "\"";
+    for(const auto& [key, value] : metrics){
+        line += ",\"" + JsonEscape(key) + "\":" + FormatMetric(value);
+    }
+    line += "}\n";
+    std::fwrite(line.data(), 1, line.size(), file);
+    std::fflush(file);
+}
+
+// prints name followed by key:value pairs, for results that are neither latency samples nor a timed run
+inline auto PrintMetrics(const std::string& name, BenchmarkMetrics metrics) noexcept{
+    std::cout << name;
+    for(const auto& [key, value] : metrics){
+        std::cout << " " << key << ":" << FormatMetric(value);
+    }
+    std::cout << std::endl;
+    WriteBenchmarkJson(name, "metrics", metrics);
+}
+
+// prints min/percentiles/max/mean for a set of latency samples in nanoseconds
+inline auto PrintLatencyStats(const std::string& name, std::vector<Nanos>& samples) noexcept{
+    if(samples.empty()){
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto percentile = [&samples](double p){
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+    };
+    const auto mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    std::cout << name << " samples:" << samples.size()
+              << " min:" << samples.front()
+              << " p50:" << percentile(0.5)
+              << " p90:" << percentile(0.9)
+              << " p99:" << percentile(0.99)
+              << " p99.9:" << percentile(0.999)
+              << " max:" << samples.back()
+              << " mean:" << mean << std::endl;
+    WriteBenchmarkJson(name, "latency", {{"samples", samples.size()}, {"min", samples.front()}, {"p50", percentile(0.5)},
+                                         {"p90", percentile(0.9)}, {"p99", percentile(0.99)}, {"p99.9", percentile(0.999)},
+                                         {"max", samples.back()}, {"mean", mean}});
+}
+
+// prints the hardware events per operation counted for ops operations, nothing when the counters are unavailable
+inline auto PrintPerfCounters(const std::string& name, const PerfCounters& counters, size_t ops) noexcept{
+    if(!counters.Available() || !ops){
+        return;
+    }
+    const auto per_op = [&](PerfEvent event){
+        return static_cast<double>(counters.Get(event)) / ops;
+    };
+    const auto cycles = counters.Get(PerfEvent::CYCLES);
+    PrintMetrics(name + " perf", {{"ops", ops}, {"cycles_per_op", per_op(PerfEvent::CYCLES)},
+                                  {"instructions_per_op", per_op(PerfEvent::INSTRUCTIONS)}, {"branches_per_op", per_op(PerfEvent::BRANCHES)},
+                                  {"branch_misses_per_op", per_op(PerfEvent::BRANCH_MISSES)},
+                                  {"ipc", (cycles ? static_cast<double>(counters.Get(PerfEvent::INSTRUCTIONS)) / cycles : 0.0)}});
+}
+
+// prints operations per second and nanoseconds per operation for a timed run
+inline auto PrintThroughput(const std::string& name, size_t ops, Nanos elapsed) noexcept{
+    const auto ops_per_sec = (elapsed ? static_cast<double>(ops) * NANOS_TO_SECS / elapsed : 0.0);
+    const auto ns_per_op = (ops ? static_cast<double>(elapsed) / ops : 0.0);
+    std::cout << name << " ops:" << ops
+              << " elapsed_ns:" << elapsed
+              << " ops_per_sec:" << ops_per_sec
+              << " ns_per_op:" << ns_per_op << std::endl;
+    WriteBenchmarkJson(name, "throughput", {{"ops", ops}, {"elapsed_ns", elapsed}, {"ops_per_sec", ops_per_sec}, {"ns_per_op", ns_per_op}});
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#endif
+
+namespace Common{
+
+/*
+CRC-32C (Castagnoli), the checksum of iSCSI, ext4 and most write-ahead logs. x86-64 cores with SSE4.2
+compute it with the crc32 instruction, 8 bytes per instruction, the build doesn't need -msse4.2 because
+only that function is compiled for it and it is picked at run time. Everything else uses a byte-wise
+table. Crc32c(data, size, Crc32c(prefix, n)) continues a checksum over data that follows prefix.
+*/
+
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82f63b78; // reflected 0x1edc6f41
+
+inline constexpr auto MakeCrc32cTable() noexcept{
+    std::array<uint32_t, 256> table = {};
+    for(uint32_t i = 0; i < 256; ++i){
+        auto crc = i;
+        for(int bit = 0; bit < 8; ++bit){
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr auto CRC32C_TABLE = MakeCrc32cTable();
+
+inline auto Crc32cSoftware(const void* data, size_t size, uint32_t crc = 0) noexcept -> uint32_t{
+    auto bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i){
+        crc = CRC32C_TABLE[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline auto Crc32cHardware(const void* data, size_t size, uint32_t crc = 0) noexcept -> uint32_t{
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint64_t crc64 = ~crc;
+    for(; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)){
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    auto crc32 = static_cast<uint32_t>(crc64);
+    // the tail in at most three instructions, a record's size is rarely a multiple of 8
+    if(size & sizeof(uint32_t)){
+        uint32_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        crc32 = _mm_crc32_u32(crc32, word);
+        bytes += sizeof(word);
+    }
+    if(size & sizeof(uint16_t)){
+        uint16_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        crc32 = _mm_crc32_u16(crc32, word);
+        bytes += sizeof(word);
+    }
+    if(size & 1){
+        crc32 = _mm_crc32_u8(crc32, *bytes);
+    }
+    return ~crc32;
+}
+
+inline auto HasCrc32cInstruction() noexcept{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    return (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2));
+}
+#endif
+
+inline auto Crc32c(const void* data, size_t size, uint32_t crc = 0) noexcept -> uint32_t{
+#if defined(__x86_64__)
+    static const bool hardware = HasCrc32cInstruction();
+    if(hardware){
+        return Crc32cHardware(data, size, crc);
+    }
+#endif
+    return Crc32cSoftware(data, size, crc);
+}
+
+}
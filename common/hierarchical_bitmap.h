@@ -0,0 +1,195 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include "macros.h"
+
+namespace Common{
+
+/*
+Occupancy bitmap with a summary level per 64 words: bit i of a word at level k+1 is set when word i
+of level k is non-zero. Set(), Clear(), FindNext() and FindPrev() touch one word per level, so with
+64^3 = 262144 bits they are three loads and a count-trailing/leading-zeros each, independent of how
+many bits are set or how far apart they are.
+*/
+class HierarchicalBitmap final{
+public:
+    static constexpr size_t NPOS = std::numeric_limits<size_t>::max();
+    // 64^11 covers any size_t number of bits
+    static constexpr size_t MAX_LEVELS = 11;
+
+private:
+    // levels_[0] holds one bit per index, levels_[num_levels_ - 1] is a single word. All levels share one
+    // zeroed allocation, level by level
+    std::array<uint64_t*, MAX_LEVELS> levels_ = {};
+    std::array<size_t, MAX_LEVELS> level_words_ = {};
+    size_t num_levels_ = 0;
+    size_t num_bits_ = 0;
+    uint64_t* words_ = nullptr;
+    const bool owns_words_ = true;
+
+    static constexpr auto Bit(size_t index) noexcept -> uint64_t{
+        return 1ull << (index & 63);
+    }
+
+public:
+    // words in every level for num_bits
+    static constexpr auto StorageWords(size_t num_bits) noexcept{
+        size_t total = 0;
+        auto num_words = (num_bits + 63) / 64;
+        while(true){
+            total += num_words;
+            if(num_words == 1){
+                return total;
+            }
+            num_words = (num_words + 63) / 64;
+        }
+    }
+
+    // what a caller providing the bitmap's storage has to allocate for num_bits
+    static constexpr auto StorageBytes(size_t num_bits) noexcept{
+        return StorageWords(num_bits) * sizeof(uint64_t);
+    }
+
+    static constexpr auto StorageAlignment() noexcept{
+        return alignof(uint64_t);
+    }
+
+    // storage, when given, holds StorageBytes(num_bits) zeroed bytes and outlives the bitmap
+    explicit HierarchicalBitmap(size_t num_bits, void* storage = nullptr):
+             num_bits_(num_bits), words_(storage ? static_cast<uint64_t*>(storage) : new uint64_t[StorageWords(num_bits)]()),
+             owns_words_(!storage){
+        auto level = words_;
+        auto num_words = (num_bits + 63) / 64;
+        while(true){
+            levels_[num_levels_] = level;
+            level_words_[num_levels_] = num_words;
+            ++num_levels_;
+            level += num_words;
+            if(num_words == 1){
+                break;
+            }
+            num_words = (num_words + 63) / 64;
+        }
+    }
+
+    ~HierarchicalBitmap(){
+        if(owns_words_){
+            delete[] words_;
+        }
+        words_ = nullptr;
+    }
+
+    HierarchicalBitmap() = delete;
+    HierarchicalBitmap(const HierarchicalBitmap&) = delete;
+    HierarchicalBitmap(const HierarchicalBitmap&&) = delete;
+    HierarchicalBitmap& operator=(const HierarchicalBitmap&) = delete;
+    HierarchicalBitmap& operator=(const HierarchicalBitmap&&) = delete;
+
+    auto Size() const noexcept{
+        return num_bits_;
+    }
+
+    auto Test(size_t index) const noexcept{
+        return (levels_[0][index >> 6] & Bit(index)) != 0;
+    }
+
+    auto Empty() const noexcept{
+        return levels_[num_levels_ - 1][0] == 0;
+    }
+
+    auto Set(size_t index) noexcept{
+        for(size_t level = 0; level < num_levels_; ++level){
+            auto& word = levels_[level][index >> 6];
+            const auto was_empty = (word == 0);
+            word |= Bit(index);
+            // summary bits above are already set
+            if(!was_empty){
+                break;
+            }
+            index >>= 6;
+        }
+    }
+
+    auto Clear(size_t index) noexcept{
+        for(size_t level = 0; level < num_levels_; ++level){
+            auto& word = levels_[level][index >> 6];
+            word &= ~Bit(index);
+            // other bits in this word still need the summary bits above
+            if(word != 0){
+                break;
+            }
+            index >>= 6;
+        }
+    }
+
+    // lowest set index >= index, NPOS if there is none
+    auto FindNext(size_t index) const noexcept -> size_t{
+        if(UNLIKELY(index >= num_bits_)){
+            return NPOS;
+        }
+        // climb until a word has a set bit at or after the position we are looking from
+        size_t level = 0;
+        uint64_t word = 0;
+        while(true){
+            if((index >> 6) < level_words_[level]){
+                word = levels_[level][index >> 6] & (~0ull << (index & 63));
+                if(word){
+                    break;
+                }
+            }
+            if(level + 1 == num_levels_){
+                return NPOS;
+            }
+            index = (index >> 6) + 1;
+            ++level;
+        }
+        // descend taking the lowest set bit at every level
+        index = (index & ~63ull) + __builtin_ctzll(word);
+        while(level > 0){
+            --level;
+            index = (index << 6) + __builtin_ctzll(levels_[level][index]);
+        }
+        return index;
+    }
+
+    // highest set index <= index, NPOS if there is none
+    auto FindPrev(size_t index) const noexcept -> size_t{
+        if(index >= num_bits_){
+            index = num_bits_ - 1;
+        }
+        size_t level = 0;
+        uint64_t word = 0;
+        while(true){
+            word = levels_[level][index >> 6] & (~0ull >> (63 - (index & 63)));
+            if(word){
+                break;
+            }
+            if(level + 1 == num_levels_ || (index >> 6) == 0){
+                return NPOS;
+            }
+            index = (index >> 6) - 1;
+            ++level;
+        }
+        index = (index & ~63ull) + 63 - __builtin_clzll(word);
+        while(level > 0){
+            --level;
+            index = (index << 6) + 63 - __builtin_clzll(levels_[level][index]);
+        }
+        return index;
+    }
+
+    // FindNext()/FindPrev() treating the bitmap as a ring, used when indices are positions in a
+    // circular buffer
+    auto FindNextWrapping(size_t index) const noexcept -> size_t{
+        const auto found = FindNext(index);
+        return (found != NPOS ? found : FindNext(0));
+    }
+
+    auto FindPrevWrapping(size_t index) const noexcept -> size_t{
+        const auto found = (index < num_bits_ ? FindPrev(index) : NPOS);
+        return (found != NPOS ? found : FindPrev(num_bits_ - 1));
+    }
+};
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <climits>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "macros.h"
+#include "time_utils.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Common{
+
+/*
+What a polling thread does when a pass over its queues found nothing. The strategies trade wake-up
+latency for CPU time:
+- BUSY_SPIN: a pause instruction and straight back to polling, lowest latency, burns the whole core,
+  for threads pinned to isolated cores
+- SPIN_YIELD: spins for IDLE_SPIN_ITERATIONS passes, then gives the core away with sched_yield() on every
+  pass, still 100% CPU when nothing else wants the core
+- BACKOFF: spins, then yields, then sleeps for a time that doubles from IDLE_MIN_SLEEP_NANOS up to the
+  strategy's max sleep, for shared dev boxes
+- PARK: spins, then sleeps on a futex until the producer calls Unpark() or the max sleep runs out. Once
+  it is marked parked it asks the caller's has_work() again before sleeping, a publish that landed
+  before the mark is seen there and one after it finds the thread parked and wakes it
+Any pass that did work resets the strategy back to spinning.
+*/
+
+constexpr size_t IDLE_SPIN_ITERATIONS = 1000;
+constexpr size_t IDLE_YIELD_ITERATIONS = 100;
+constexpr Nanos IDLE_MIN_SLEEP_NANOS = 1 * NANOS_TO_MICROS;
+constexpr Nanos IDLE_MAX_SLEEP_NANOS = 1 * NANOS_TO_MILLIS;
+
+enum class IdleStrategyType: uint8_t{
+    BUSY_SPIN = 0,
+    SPIN_YIELD = 1,
+    BACKOFF = 2,
+    PARK = 3
+};
+
+inline auto IdleStrategyTypeToString(IdleStrategyType type) -> std::string{
+    switch(type){
+        case IdleStrategyType::BUSY_SPIN:
+            return "BUSY_SPIN";
+        case IdleStrategyType::SPIN_YIELD:
+            return "SPIN_YIELD";
+        case IdleStrategyType::BACKOFF:
+            return "BACKOFF";
+        case IdleStrategyType::PARK:
+            return "PARK";
+    }
+    return "UNKNOWN";
+}
+
+// false when name is not a strategy, type is left alone then
+inline auto IdleStrategyTypeFromString(const std::string& name, IdleStrategyType* type) noexcept{
+    for(auto candidate : {IdleStrategyType::BUSY_SPIN, IdleStrategyType::SPIN_YIELD, IdleStrategyType::BACKOFF, IdleStrategyType::PARK}){
+        if(name == IdleStrategyTypeToString(candidate)){
+            *type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// tells the core we are spinning: frees execution resources for the sibling hyperthread and avoids the
+// memory order mis-speculation when the polled cache line finally changes
+inline auto CpuRelax() noexcept{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// owned by the thread that idles, Unpark() may be called from any thread
+class IdleStrategy final{
+private:
+    const IdleStrategyType type_;
+    const Nanos max_sleep_;
+    // passes in a row that found nothing
+    size_t idle_passes_ = 0;
+    Nanos sleep_nanos_ = IDLE_MIN_SLEEP_NANOS;
+
+    // PARK only, bumped by Unpark() so a futex wait that has not started yet returns at once
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> wake_seq_ = {0};
+    std::atomic<bool> parked_ = {false};
+
+    template<typename HasWork>
+    auto Park(HasWork& has_work) noexcept{
+        const auto seq = wake_seq_.load(std::memory_order_acquire);
+        parked_.store(true, std::memory_order_relaxed);
+        // orders the parked_ store before the re-check, pairs with the fence in Unpark()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!has_work()){
+            const timespec timeout{static_cast<time_t>(max_sleep_ / NANOS_TO_SECS), static_cast<long>(max_sleep_ % NANOS_TO_SECS)};
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_seq_), FUTEX_WAIT_PRIVATE, seq, &timeout, nullptr, 0);
+        }
+        parked_.store(false, std::memory_order_relaxed);
+    }
+
+public:
+    explicit IdleStrategy(IdleStrategyType type, Nanos max_sleep = IDLE_MAX_SLEEP_NANOS): type_(type), max_sleep_(max_sleep){
+
+    }
+
+    IdleStrategy() = delete;
+    IdleStrategy(const IdleStrategy&) = delete;
+    IdleStrategy(const IdleStrategy&&) = delete;
+    IdleStrategy& operator=(const IdleStrategy&) = delete;
+    IdleStrategy& operator=(const IdleStrategy&&) = delete;
+
+    auto GetType() const noexcept{
+        return type_;
+    }
+
+    // called once per pass of the polling loop, has_work() tells whether the queues the loop polls hold
+    // anything now, only PARK calls it, right before it sleeps
+    template<typename HasWork>
+    auto Idle(bool did_work, HasWork&& has_work) noexcept{
+        if(did_work){
+            idle_passes_ = 0;
+            sleep_nanos_ = IDLE_MIN_SLEEP_NANOS;
+            return;
+        }
+        ++idle_passes_;
+        if(type_ == IdleStrategyType::BUSY_SPIN || idle_passes_ <= IDLE_SPIN_ITERATIONS){
+            CpuRelax();
+            return;
+        }
+        switch(type_){
+            case IdleStrategyType::SPIN_YIELD:
+                sched_yield();
+                break;
+            case IdleStrategyType::BACKOFF:
+                if(idle_passes_ <= IDLE_SPIN_ITERATIONS + IDLE_YIELD_ITERATIONS){
+                    sched_yield();
+                }else{
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_nanos_));
+                    sleep_nanos_ = std::min(sleep_nanos_ * 2, max_sleep_);
+                }
+                break;
+            case IdleStrategyType::PARK:
+                Park(has_work);
+                break;
+            case IdleStrategyType::BUSY_SPIN:
+                break;
+        }
+    }
+
+    // wakes the thread if it is parked, only PARK pays for the fence
+    auto Unpark() noexcept{
+        if(type_ != IdleStrategyType::PARK){
+            return;
+        }
+        // orders the caller's publish before the parked_ load, pairs with the fence in Park()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(parked_.load(std::memory_order_relaxed)){
+            wake_seq_.fetch_add(1, std::memory_order_release);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_seq_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+};
+
+}
@@ -0,0 +1,78 @@
+#include <cstdlib>
+#include <ctime>
+#include "thread_utils.h"
+#include "lf_queue.h"
+#include "idle_strategy.h"
+#include "benchmark_utils.h"
+
+/* Wake-up latency and CPU use of every IdleStrategyType. A consumer thread polls an SPSCLFQueue and
+   idles with the strategy between messages, the producer sends one timestamped message every gap_us
+   microseconds, long enough for every strategy to reach its deepest idle state:
+   - wakeup: nanoseconds from the producer's publish to the consumer seeing the message
+   - cpu: consumer thread CPU time as a percentage of the run's wall time
+   Usage: idle_strategy_benchmark [messages] [gap_us] [producer_core] [consumer_core] */
+
+using namespace Common;
+
+constexpr size_t BENCH_QUEUE_SIZE = 1024;
+
+auto ThreadCpuNanos() noexcept{
+    return ClockNanos(CLOCK_THREAD_CPUTIME_ID);
+}
+
+auto RunStrategy(IdleStrategyType type, size_t messages, Nanos gap, int producer_core, int consumer_core){
+    const auto name = IdleStrategyTypeToString(type);
+    SPSCLFQueue<Nanos> queue(BENCH_QUEUE_SIZE);
+    IdleStrategy idle_strategy(type);
+    queue.SetReaderIdleStrategy(&idle_strategy);
+    std::vector<Nanos> samples;
+    samples.reserve(messages);
+    Nanos consumer_cpu = 0;
+
+    auto consume = [&](){
+        const auto cpu_start = ThreadCpuNanos();
+        for(size_t received = 0; received < messages;){
+            const auto ready = queue.GetReadSpan();
+            if(!ready.empty()){
+                const auto now = GetTscNanos();
+                for(const auto sent : ready){
+                    samples.push_back(now - sent);
+                }
+                received += ready.size();
+                queue.UpdateReadIndex(ready.size());
+            }
+            idle_strategy.Idle(!ready.empty(), [&](){ return queue.Size() != 0; });
+        }
+        consumer_cpu = ThreadCpuNanos() - cpu_start;
+    };
+    auto consumer_thread = CreateAndStartThread(consumer_core, "Bench/Idle" + name, consume);
+
+    if(producer_core >= 0){
+        ASSERT(SetThreadCore(producer_core), "Failed to pin producer to core " + std::to_string(producer_core));
+    }
+    const auto start = GetCurrentNanos();
+    for(size_t i = 0; i < messages; ++i){
+        std::this_thread::sleep_for(std::chrono::nanoseconds(gap));
+        *queue.GetNextToWriteTo() = GetTscNanos();
+        queue.UpdateWriteIndex();
+    }
+    consumer_thread->join();
+    delete consumer_thread;
+    const auto elapsed = GetCurrentNanos() - start;
+
+    PrintLatencyStats("wakeup " + name + " ns", samples);
+    PrintMetrics("cpu " + name, {{"consumer_cpu_ms", consumer_cpu / NANOS_TO_MILLIS}, {"wall_ms", elapsed / NANOS_TO_MILLIS},
+                                 {"cpu_percent", (elapsed ? 100.0 * consumer_cpu / elapsed : 0.0)}});
+}
+
+int main(int argc, char** argv){
+    const size_t messages = argc > 1 ? std::atol(argv[1]) : 2000;
+    const Nanos gap = (argc > 2 ? std::atol(argv[2]) : 500) * NANOS_TO_MICROS;
+    const int producer_core = argc > 3 ? std::atoi(argv[3]) : -1;
+    const int consumer_core = argc > 4 ? std::atoi(argv[4]) : -1;
+
+    for(auto type : {IdleStrategyType::BUSY_SPIN, IdleStrategyType::SPIN_YIELD, IdleStrategyType::BACKOFF, IdleStrategyType::PARK}){
+        RunStrategy(type, messages, gap, producer_core, consumer_core);
+    }
+    return 0;
+}
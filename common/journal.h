@@ -0,0 +1,533 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "macros.h"
+#include "time_utils.h"
+#include "thread_utils.h"
+#include "stats_segment.h"
+#include "crc32c.h"
+
+namespace Common{
+
+/*
+Write-ahead journal of fixed or variable size records on memory-mapped files. The writer copies a record
+and its CRC-32C into a mapped, preallocated segment file and moves on, it never makes a system call. A sync
+thread flushes what the writer committed with msync according to the JournalSyncPolicy, and it creates and
+maps the next segment ahead of the writer and unmaps the ones the writer has filled, so the cost of
+durability and of switching segments stays off the writing thread. The records sit in the page
+cache as soon as they are appended, so they survive the process dying whatever the policy, surviving the
+machine going down needs them synced.
+
+The journal is a series of segments <prefix>.0, <prefix>.1, ... each starting with a JournalSegmentHeader
+followed by records, every record a JournalRecordHeader and its payload padded to 8 bytes. A record with
+size 0 ends the written part of a segment, a record whose checksum doesn't match is a torn write and ends
+it too. Sequence numbers run on across segments and across restarts: a new Journal scans the last existing
+segment and starts a new one after it, it never writes into an old one. The segment the sync thread
+prepared next has a zero header until the writer starts it, readers stop there.
+*/
+
+constexpr uint64_t JOURNAL_MAGIC = 0x314c414e52554f4a; // "JOURNAL1"
+constexpr size_t JOURNAL_SEGMENT_BYTES = 64ul * 1024 * 1024;
+constexpr size_t JOURNAL_RECORD_ALIGNMENT = 8;
+// how often the sync thread looks for a newly committed batch under JournalSyncPolicy::BATCH
+constexpr Nanos JOURNAL_BATCH_POLL = 50 * NANOS_TO_MICROS;
+
+enum class JournalSyncPolicy : uint8_t{
+    // the journal never syncs, the kernel writes the pages back in its own time
+    NONE = 0,
+    // the sync thread flushes every batch the writer commits, within JOURNAL_BATCH_POLL of the commit
+    BATCH = 1,
+    // the sync thread flushes whatever was committed every sync_interval_
+    PERIODIC = 2
+};
+
+inline auto JournalSyncPolicyToString(JournalSyncPolicy policy) -> std::string{
+    switch(policy){
+        case JournalSyncPolicy::NONE:
+            return "NONE";
+        case JournalSyncPolicy::BATCH:
+            return "BATCH";
+        case JournalSyncPolicy::PERIODIC:
+            return "PERIODIC";
+    }
+    return "UNKNOWN";
+}
+
+inline auto JournalSyncPolicyFromString(const std::string& name, JournalSyncPolicy* policy) noexcept{
+    for(auto candidate : {JournalSyncPolicy::NONE, JournalSyncPolicy::BATCH, JournalSyncPolicy::PERIODIC}){
+        if(name == JournalSyncPolicyToString(candidate)){
+            *policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct JournalConfig{
+    JournalSyncPolicy sync_policy_ = JournalSyncPolicy::BATCH;
+    // used by JournalSyncPolicy::PERIODIC
+    Nanos sync_interval_ = NANOS_TO_MILLIS;
+    size_t segment_bytes_ = JOURNAL_SEGMENT_BYTES;
+};
+
+struct alignas(CACHE_LINE_SIZE) JournalSegmentHeader{
+    uint64_t magic_ = JOURNAL_MAGIC;
+    uint64_t segment_bytes_ = 0;
+    // sequence number of the segment's first record
+    uint64_t first_sequence_ = 0;
+    Nanos create_time_ = 0;
+};
+
+struct JournalRecordHeader{
+    // payload bytes, 0 where nothing was written yet
+    uint32_t size_;
+    // CRC-32C of sequence_ followed by the payload
+    uint32_t crc32c_;
+    uint64_t sequence_;
+};
+static_assert(sizeof(JournalRecordHeader) == 16);
+
+inline auto JournalSegmentName(const std::string& prefix, size_t index){
+    return prefix + "." + std::to_string(index);
+}
+
+// bytes a record of size payload bytes takes in the segment
+inline constexpr auto JournalRecordBytes(size_t size) noexcept{
+    return (sizeof(JournalRecordHeader) + size + JOURNAL_RECORD_ALIGNMENT - 1) & ~(JOURNAL_RECORD_ALIGNMENT - 1);
+}
+
+inline auto JournalRecordCrc(uint64_t sequence, const void* payload, size_t size) noexcept{
+    return Crc32c(payload, size, Crc32c(&sequence, sizeof(sequence)));
+}
+
+inline auto JournalSegmentExists(const std::string& prefix, size_t index){
+    struct stat file_stat;
+    return stat(JournalSegmentName(prefix, index).c_str(), &file_stat) == 0;
+}
+
+struct JournalRecord{
+    uint64_t sequence_ = 0;
+    const void* payload_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Reads the records of a journal in order, starting at segment first_segment, for recovery and inspection.
+// Stops at the end of the last started segment or at a sequence gap between segments
+class JournalReader final{
+private:
+    const std::string prefix_;
+    size_t segment_index_ = 0;
+    const char* segment_ = nullptr;
+    size_t segment_bytes_ = 0;
+    size_t offset_ = 0;
+    uint64_t next_sequence_ = 0;
+    size_t torn_records_ = 0;
+    std::string error_;
+
+    auto Unmap() noexcept{
+        if(segment_){
+            munmap(const_cast<char*>(segment_), segment_bytes_);
+        }
+        segment_ = nullptr;
+        segment_bytes_ = 0;
+    }
+
+    // maps segment segment_index_, false at the end of the journal or on an error
+    auto MapSegment() -> bool{
+        Unmap();
+        const auto name = JournalSegmentName(prefix_, segment_index_);
+        const auto fd = open(name.c_str(), O_RDONLY);
+        if(fd < 0){
+            if(errno != ENOENT){
+                error_ = "could not open " + name + " error: " + std::string(std::strerror(errno));
+            }
+            return false;
+        }
+        struct stat file_stat;
+        if(fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(JournalSegmentHeader)){
+            error_ = name + " is too short for a journal segment";
+            close(fd);
+            return false;
+        }
+        auto memory = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(memory == MAP_FAILED){
+            error_ = "could not map " + name + " error: " + std::string(std::strerror(errno));
+            return false;
+        }
+        segment_ = static_cast<const char*>(memory);
+        segment_bytes_ = file_stat.st_size;
+        const auto header = reinterpret_cast<const JournalSegmentHeader*>(segment_);
+        // prepared by the sync thread but not started by the writer, nothing follows it
+        if(!header->magic_){
+            return false;
+        }
+        if(header->magic_ != JOURNAL_MAGIC || header->segment_bytes_ != segment_bytes_){
+            error_ = name + " is not a journal segment";
+            return false;
+        }
+        if(next_sequence_ && header->first_sequence_ != next_sequence_){
+            error_ = name + " starts at sequence " + std::to_string(header->first_sequence_) + ", expected " + std::to_string(next_sequence_);
+            return false;
+        }
+        next_sequence_ = header->first_sequence_;
+        offset_ = sizeof(JournalSegmentHeader);
+        return true;
+    }
+
+public:
+    explicit JournalReader(const std::string& prefix, size_t first_segment = 0): prefix_(prefix), segment_index_(first_segment){
+        MapSegment();
+    }
+
+    ~JournalReader(){
+        Unmap();
+    }
+
+    JournalReader() = delete;
+    JournalReader(const JournalReader&) = delete;
+    JournalReader(const JournalReader&&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&&) = delete;
+
+    // the next valid record, its payload stays readable until the following call. False at the end
+    auto Next(JournalRecord* record) -> bool{
+        while(segment_ && error_.empty()){
+            if(offset_ + sizeof(JournalRecordHeader) <= segment_bytes_){
+                const auto header = reinterpret_cast<const JournalRecordHeader*>(segment_ + offset_);
+                const auto payload = segment_ + offset_ + sizeof(JournalRecordHeader);
+                if(header->size_ && offset_ + JournalRecordBytes(header->size_) <= segment_bytes_){
+                    if(header->sequence_ == next_sequence_ && header->crc32c_ == JournalRecordCrc(header->sequence_, payload, header->size_)){
+                        *record = JournalRecord{header->sequence_, payload, header->size_};
+                        offset_ += JournalRecordBytes(header->size_);
+                        ++next_sequence_;
+                        return true;
+                    }
+                    // the writer died mid-record, the next segment continues after the last whole record
+                    ++torn_records_;
+                }
+            }
+            ++segment_index_;
+            if(!MapSegment()){
+                Unmap();
+            }
+        }
+        return false;
+    }
+
+    // sequence number the record after the last one read would have
+    auto GetNextSequence() const noexcept{
+        return next_sequence_;
+    }
+
+    auto GetSegmentIndex() const noexcept{
+        return segment_index_;
+    }
+
+    auto GetTornRecords() const noexcept{
+        return torn_records_;
+    }
+
+    // empty unless the journal is damaged or unreadable
+    auto GetError() const noexcept -> const std::string&{
+        return error_;
+    }
+};
+
+// a segment's place in its Journal, the writer and the sync thread hand a slot back and forth through its state
+enum class JournalSegmentState : uint8_t{
+    // unmapped, the sync thread may prepare the next segment in it
+    FREE = 0,
+    // created, mapped and faulted in by the sync thread, waiting for the writer
+    READY = 1,
+    // the writer appends to it
+    CURRENT = 2,
+    // the writer moved on, the sync thread flushes, unmaps and closes it
+    RETIRED = 3
+};
+
+struct JournalSegment{
+    std::atomic<JournalSegmentState> state_ = {JournalSegmentState::FREE};
+    int fd_ = -1;
+    char* memory_ = nullptr;
+    // end of the records the writer committed, read by the sync thread
+    std::atomic<size_t> committed_offset_ = {0};
+    // start of what the sync thread has not flushed yet, only the sync thread uses it
+    size_t synced_offset_ = 0;
+};
+
+// the current segment, the one prepared after it and the one retired before it
+constexpr size_t JOURNAL_SEGMENT_SLOTS = 3;
+// longest the sync thread sleeps before it looks for a segment to retire or prepare, whatever the policy
+constexpr Nanos JOURNAL_SEGMENT_POLL = NANOS_TO_MILLIS;
+
+class Journal final{
+private:
+    const std::string prefix_;
+    const JournalConfig config_;
+    JournalSegment slots_[JOURNAL_SEGMENT_SLOTS];
+    // the writer's segment, segment segment_index_ lives in slot segment_index_ % JOURNAL_SEGMENT_SLOTS
+    JournalSegment* segment_ = nullptr;
+    size_t segment_index_ = 0;
+    size_t write_offset_ = 0;
+    uint64_t next_sequence_ = 1;
+    // the sync thread's oldest segment not retired yet and the next segment it prepares
+    size_t sync_index_ = 0;
+    size_t prepare_index_ = 0;
+    std::atomic<bool> run_ = {false};
+    std::thread* sync_thread_ = nullptr;
+    StatsCounter records_;
+    StatsCounter segments_;
+    StatsCounter syncs_;
+    StatsCounter sync_errors_;
+
+    auto Slot(size_t index) noexcept -> JournalSegment&{
+        return slots_[index % JOURNAL_SEGMENT_SLOTS];
+    }
+
+    // creates segment index as a fully allocated file and maps it, its pages are faulted in and dirtied here
+    // so the writer takes neither the read fault nor the write-protect fault a clean shared page takes on
+    // its first store. The header stays zero until the writer starts the segment, a reader takes a segment
+    // without a magic for the end of the journal
+    auto PrepareSegment(size_t index) -> void{
+        auto& segment = Slot(index);
+        const auto name = JournalSegmentName(prefix_, index);
+        segment.fd_ = open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if(segment.fd_ < 0){
+            FATAL("Could not create journal segment " + name + " error: " + std::string(std::strerror(errno)));
+        }
+        if(const auto error = posix_fallocate(segment.fd_, 0, config_.segment_bytes_); error != 0){
+            FATAL("Could not allocate journal segment " + name + " error: " + std::string(std::strerror(error)));
+        }
+        auto memory = mmap(nullptr, config_.segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, segment.fd_, 0);
+        if(memory == MAP_FAILED){
+            FATAL("Could not map journal segment " + name + " error: " + std::string(std::strerror(errno)));
+        }
+        segment.memory_ = static_cast<char*>(memory);
+        const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        for(size_t offset = 0; offset < config_.segment_bytes_; offset += page_size){
+            reinterpret_cast<volatile char*>(segment.memory_)[offset] = 0;
+        }
+        segment.committed_offset_.store(0, std::memory_order_relaxed);
+        segment.synced_offset_ = 0;
+        segment.state_.store(JournalSegmentState::READY, std::memory_order_release);
+    }
+
+    // makes the prepared segment segment_index_ the writer's, only stores to memory that is already mapped
+    auto StartSegment() noexcept -> void{
+        segment_ = &Slot(segment_index_);
+        new(segment_->memory_) JournalSegmentHeader{JOURNAL_MAGIC, config_.segment_bytes_, next_sequence_, GetCurrentNanos()};
+        write_offset_ = sizeof(JournalSegmentHeader);
+        segment_->committed_offset_.store(write_offset_, std::memory_order_release);
+        segment_->state_.store(JournalSegmentState::CURRENT, std::memory_order_release);
+        segments_.Increment();
+    }
+
+    // flushes the whole segment when the policy syncs at all, then unmaps and closes it
+    auto ReleaseSegment(JournalSegment& segment) noexcept -> void{
+        if(config_.sync_policy_ != JournalSyncPolicy::NONE){
+            SyncCommitted(segment);
+        }
+        munmap(segment.memory_, config_.segment_bytes_);
+        close(segment.fd_);
+        segment.memory_ = nullptr;
+        segment.fd_ = -1;
+        segment.state_.store(JournalSegmentState::FREE, std::memory_order_release);
+    }
+
+    // the writer found no room for the next record, cold. It retires its segment to the sync thread and
+    // takes the one the sync thread prepared, and waits only when the sync thread is a whole segment behind
+    auto NextSegment() noexcept -> void{
+        auto& next = Slot(segment_index_ + 1);
+        while(next.state_.load(std::memory_order_acquire) != JournalSegmentState::READY){
+            std::this_thread::yield();
+        }
+        segment_->committed_offset_.store(write_offset_, std::memory_order_release);
+        segment_->state_.store(JournalSegmentState::RETIRED, std::memory_order_release);
+        ++segment_index_;
+        StartSegment();
+    }
+
+    // flushes the segment's committed records not synced yet, sync thread only
+    auto SyncCommitted(JournalSegment& segment) noexcept -> void{
+        const auto committed = segment.committed_offset_.load(std::memory_order_acquire);
+        if(committed <= segment.synced_offset_){
+            return;
+        }
+        // msync wants a page aligned start
+        const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const auto start = segment.synced_offset_ & ~(page_size - 1);
+        if(msync(segment.memory_ + start, committed - start, MS_SYNC) != 0){
+            sync_errors_.Increment();
+            return;
+        }
+        segment.synced_offset_ = committed;
+        syncs_.Increment();
+    }
+
+    // retires the segments the writer left, oldest first, flushes the current one when sync is true and
+    // prepares the segment after the current one
+    auto ServiceSegments(bool sync) -> void{
+        for(;;){
+            auto& segment = Slot(sync_index_);
+            const auto state = segment.state_.load(std::memory_order_acquire);
+            if(state == JournalSegmentState::RETIRED){
+                ReleaseSegment(segment);
+                ++sync_index_;
+                continue;
+            }
+            if(state == JournalSegmentState::CURRENT && sync){
+                SyncCommitted(segment);
+            }
+            break;
+        }
+        if(prepare_index_ == sync_index_ + 1 && Slot(prepare_index_).state_.load(std::memory_order_acquire) == JournalSegmentState::FREE){
+            PrepareSegment(prepare_index_);
+            ++prepare_index_;
+        }
+    }
+
+    auto RunSync() noexcept{
+        const auto sync_interval = (config_.sync_policy_ == JournalSyncPolicy::BATCH ? JOURNAL_BATCH_POLL : config_.sync_interval_);
+        const auto poll = std::min(sync_interval, JOURNAL_SEGMENT_POLL);
+        auto next_sync = GetCurrentNanos() + sync_interval;
+        while(run_.load(std::memory_order_acquire)){
+            std::this_thread::sleep_for(std::chrono::nanoseconds(poll));
+            const auto now = GetCurrentNanos();
+            const auto sync = (config_.sync_policy_ != JournalSyncPolicy::NONE && now >= next_sync);
+            if(sync){
+                next_sync = now + sync_interval;
+            }
+            ServiceSegments(sync);
+        }
+    }
+
+    // true for a segment a journal prepared but never started, left behind when its process died
+    static auto IsUnstartedSegment(const std::string& prefix, size_t index){
+        const auto fd = open(JournalSegmentName(prefix, index).c_str(), O_RDONLY);
+        if(fd < 0){
+            return false;
+        }
+        uint64_t magic = 0;
+        const auto read_bytes = pread(fd, &magic, sizeof(magic), 0);
+        close(fd);
+        return read_bytes == static_cast<ssize_t>(sizeof(magic)) && magic == 0;
+    }
+
+public:
+    // continues the journal at prefix, or starts one. stat_prefix names its stats, thread_name its sync
+    // thread, which runs under every policy since it also prepares and releases the segments
+    Journal(const std::string& prefix, const JournalConfig& config, const std::string& stat_prefix, const std::string& thread_name):
+            prefix_(prefix), config_(config),
+            records_(stat_prefix + "records"), segments_(stat_prefix + "segments"),
+            syncs_(stat_prefix + "syncs"), sync_errors_(stat_prefix + "sync_errors"){
+        ASSERT(config_.segment_bytes_ > sizeof(JournalSegmentHeader) + sizeof(JournalRecordHeader)
+               && config_.segment_bytes_ % JOURNAL_RECORD_ALIGNMENT == 0, "Invalid journal segment size " + std::to_string(config_.segment_bytes_));
+        while(JournalSegmentExists(prefix_, segment_index_)){
+            ++segment_index_;
+        }
+        // nothing was ever written to a segment that was only prepared, it is created again
+        if(segment_index_ && IsUnstartedSegment(prefix_, segment_index_ - 1)){
+            --segment_index_;
+            unlink(JournalSegmentName(prefix_, segment_index_).c_str());
+        }
+        if(segment_index_){
+            // the last segment tells where the sequence stopped, a torn last record is left behind
+            JournalReader reader(prefix_, segment_index_ - 1);
+            JournalRecord record;
+            while(reader.Next(&record)){
+            }
+            if(!reader.GetError().empty() || !reader.GetNextSequence()){
+                FATAL("Could not continue journal " + prefix_ + ": " + reader.GetError());
+            }
+            next_sequence_ = reader.GetNextSequence();
+        }
+        // the first segment and the spare after it are ready before the writer appends
+        PrepareSegment(segment_index_);
+        StartSegment();
+        PrepareSegment(segment_index_ + 1);
+        sync_index_ = segment_index_;
+        prepare_index_ = segment_index_ + 2;
+        run_ = true;
+        sync_thread_ = CreateAndStartThread(-1, thread_name, [this](){ RunSync(); });
+        ASSERT(sync_thread_ != nullptr, "Failed to start " + thread_name + " thread.");
+    }
+
+    ~Journal(){
+        Commit();
+        run_ = false;
+        if(sync_thread_){
+            sync_thread_->join();
+            delete sync_thread_;
+            sync_thread_ = nullptr;
+        }
+        // the sync thread is gone, retire what it left and the writer's segment, drop the unstarted spare
+        segment_->state_.store(JournalSegmentState::RETIRED, std::memory_order_release);
+        for(size_t index = sync_index_; index < prepare_index_; ++index){
+            auto& segment = Slot(index);
+            if(segment.state_.load(std::memory_order_acquire) == JournalSegmentState::RETIRED){
+                ReleaseSegment(segment);
+            }else if(segment.state_.load(std::memory_order_acquire) == JournalSegmentState::READY){
+                ReleaseSegment(segment);
+                unlink(JournalSegmentName(prefix_, index).c_str());
+            }
+        }
+    }
+
+    Journal() = delete;
+    Journal(const Journal&) = delete;
+    Journal(const Journal&&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    Journal& operator=(const Journal&&) = delete;
+
+    // copies the record into the segment, it is flushed once committed
+    auto Append(const void* payload, uint32_t size) noexcept{
+        const auto record_bytes = JournalRecordBytes(size);
+        if(UNLIKELY(write_offset_ + record_bytes > config_.segment_bytes_)){
+            if(UNLIKELY(sizeof(JournalSegmentHeader) + record_bytes > config_.segment_bytes_)){
+                FATAL("Journal record of " + std::to_string(size) + " bytes does not fit a segment");
+            }
+            NextSegment();
+        }
+        auto header = reinterpret_cast<JournalRecordHeader*>(segment_->memory_ + write_offset_);
+        std::memcpy(header + 1, payload, size);
+        header->sequence_ = next_sequence_;
+        header->crc32c_ = JournalRecordCrc(next_sequence_, payload, size);
+        header->size_ = size;
+        write_offset_ += record_bytes;
+        ++next_sequence_;
+        records_.Increment();
+    }
+
+    template<typename T>
+    auto Append(const T& record) noexcept{
+        static_assert(std::is_trivially_copyable_v<T>, "journal records are copied byte for byte");
+        Append(&record, sizeof(T));
+    }
+
+    // hands everything appended so far to the sync thread, one store
+    auto Commit() noexcept -> void{
+        segment_->committed_offset_.store(write_offset_, std::memory_order_release);
+    }
+
+    // sequence number the next record gets
+    auto GetNextSequence() const noexcept{
+        return next_sequence_;
+    }
+
+    auto GetSegmentIndex() const noexcept{
+        return segment_index_;
+    }
+};
+
+}
@@ -0,0 +1,273 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "macros.h"
+#include "time_utils.h"
+
+namespace Common{
+
+/*
+Latency histograms for the probes along the exchange pipeline. Every thread records into its own
+LatencyRecorder, so a probe is a clock read plus a few integer instructions and a counter bump with no
+atomic read-modify-write and no sharing. Buckets are HDR style: exact below 2^LATENCY_SUB_BUCKET_BITS
+nanoseconds, then every power of two is split into 2^LATENCY_SUB_BUCKET_BITS equal buckets, so a
+percentile is within about 3% of the true value. Any thread can read the counters while the owner
+records, LatencyRegistry merges every thread's histograms when asked to dump them.
+*/
+
+constexpr int LATENCY_SUB_BUCKET_BITS = 5;
+constexpr uint64_t LATENCY_SUB_BUCKETS = 1ull << LATENCY_SUB_BUCKET_BITS;
+// values are capped at 2^LATENCY_MAX_VALUE_BITS - 1 ns, about 68 seconds
+constexpr int LATENCY_MAX_VALUE_BITS = 36;
+constexpr size_t LATENCY_HISTOGRAM_BUCKETS = (LATENCY_MAX_VALUE_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS;
+// probes are tagged with a small id, the exchange uses the client request type
+constexpr size_t LATENCY_MAX_TAGS = 8;
+// tag of probes taken before any request is decoded, one socket read can carry several requests
+constexpr uint8_t LATENCY_TAG_UNDECODED = LATENCY_MAX_TAGS - 1;
+
+// each probe records the time since the kernel received the request the work belongs to
+enum class LatencyStage: uint8_t{
+    // TCPSocket read the bytes
+    SOCKET_READ = 0,
+    // OrderServer::RecvCallback() checked the request
+    ORDER_SERVER_RECV = 1,
+    // the FIFO sequencer published the request to the matching engine
+    FIFO_SEQUENCED = 2,
+    // MatchingEngine::Run() took the request off the queue
+    ME_DEQUEUE = 3,
+    // ProcessClientRequest() returned
+    ME_PROCESSED = 4,
+    // the matching engine published a response to the order server
+    RESPONSE_ENQUEUED = 5,
+    // the order server wrote the response to the client's socket
+    SOCKET_SEND = 6,
+    COUNT = 7
+};
+
+inline auto LatencyStageToString(LatencyStage stage) -> std::string{
+    switch(stage){
+        case LatencyStage::SOCKET_READ:
+            return "SOCKET_READ";
+        case LatencyStage::ORDER_SERVER_RECV:
+            return "ORDER_SERVER_RECV";
+        case LatencyStage::FIFO_SEQUENCED:
+            return "FIFO_SEQUENCED";
+        case LatencyStage::ME_DEQUEUE:
+            return "ME_DEQUEUE";
+        case LatencyStage::ME_PROCESSED:
+            return "ME_PROCESSED";
+        case LatencyStage::RESPONSE_ENQUEUED:
+            return "RESPONSE_ENQUEUED";
+        case LatencyStage::SOCKET_SEND:
+            return "SOCKET_SEND";
+        case LatencyStage::COUNT:
+            return "COUNT";
+    }
+    return "UNKNOWN";
+}
+
+constexpr size_t LATENCY_STAGES = static_cast<size_t>(LatencyStage::COUNT);
+
+inline constexpr auto LatencyBucket(uint64_t value) noexcept -> size_t{
+    if(value < LATENCY_SUB_BUCKETS){
+        return value;
+    }
+    if(UNLIKELY(value >= (1ull << LATENCY_MAX_VALUE_BITS))){
+        value = (1ull << LATENCY_MAX_VALUE_BITS) - 1;
+    }
+    // the top LATENCY_SUB_BUCKET_BITS + 1 bits pick the bucket
+    const auto shift = std::bit_width(value) - 1 - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + ((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// the largest value that falls in the bucket
+inline constexpr auto LatencyBucketValue(size_t bucket) noexcept -> uint64_t{
+    if(bucket < LATENCY_SUB_BUCKETS){
+        return bucket;
+    }
+    const auto shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return ((bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+static_assert(LatencyBucket(LatencyBucketValue(100)) == 100);
+static_assert(LatencyBucket((1ull << LATENCY_MAX_VALUE_BITS) - 1) == LATENCY_HISTOGRAM_BUCKETS - 1);
+
+// written by one thread, readable from any
+class LatencyHistogram final{
+private:
+    std::array<std::atomic<uint64_t>, LATENCY_HISTOGRAM_BUCKETS> counts_ = {};
+    std::atomic<uint64_t> count_ = {0};
+    std::atomic<uint64_t> sum_ = {0};
+    std::atomic<uint64_t> max_ = {0};
+
+    static auto Increment(std::atomic<uint64_t>* counter, uint64_t value) noexcept{
+        counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+public:
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram(const LatencyHistogram&&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&&) = delete;
+
+    auto Record(Nanos latency) noexcept{
+        // the kernel's receive timestamp and our clock can disagree by a little
+        const auto value = static_cast<uint64_t>(std::max<Nanos>(latency, 0));
+        Increment(&counts_[LatencyBucket(value)], 1);
+        Increment(&count_, 1);
+        Increment(&sum_, value);
+        if(UNLIKELY(value > max_.load(std::memory_order_relaxed))){
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // adds another thread's counts into this one, only for histograms nobody records into
+    auto Merge(const LatencyHistogram& other) noexcept{
+        for(size_t i = 0; i < counts_.size(); ++i){
+            Increment(&counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+        }
+        Increment(&count_, other.count_.load(std::memory_order_relaxed));
+        Increment(&sum_, other.sum_.load(std::memory_order_relaxed));
+        max_.store(std::max(max_.load(std::memory_order_relaxed), other.max_.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    auto GetCount() const noexcept{
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    auto GetMax() const noexcept{
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    auto GetMean() const noexcept{
+        const auto count = GetCount();
+        return (count ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count : 0.0);
+    }
+
+    // upper bound of the bucket holding the given fraction of the samples, capped at the largest sample
+    auto GetPercentile(double fraction) const noexcept -> uint64_t{
+        const auto count = GetCount();
+        if(!count){
+            return 0;
+        }
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+        uint64_t seen = 0;
+        for(size_t i = 0; i < counts_.size(); ++i){
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if(seen >= rank){
+                return std::min(LatencyBucketValue(i), GetMax());
+            }
+        }
+        return GetMax();
+    }
+
+    auto ToString() const{
+        return "count:" + std::to_string(GetCount())
+               + " p50:" + std::to_string(GetPercentile(0.5))
+               + " p90:" + std::to_string(GetPercentile(0.9))
+               + " p99:" + std::to_string(GetPercentile(0.99))
+               + " p99.9:" + std::to_string(GetPercentile(0.999))
+               + " max:" + std::to_string(GetMax())
+               + " mean:" + std::to_string(static_cast<uint64_t>(GetMean()));
+    }
+};
+
+// one thread's histograms, one per stage and tag
+class LatencyRecorder final{
+private:
+    std::array<std::array<LatencyHistogram, LATENCY_MAX_TAGS>, LATENCY_STAGES> histograms_;
+
+public:
+    LatencyRecorder() = default;
+    LatencyRecorder(const LatencyRecorder&) = delete;
+    LatencyRecorder(const LatencyRecorder&&) = delete;
+    LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+    LatencyRecorder& operator=(const LatencyRecorder&&) = delete;
+
+    auto Record(LatencyStage stage, uint8_t tag, Nanos latency) noexcept{
+        histograms_[static_cast<size_t>(stage)][tag & (LATENCY_MAX_TAGS - 1)].Record(latency);
+    }
+
+    auto GetHistogram(LatencyStage stage, uint8_t tag) const noexcept -> const LatencyHistogram&{
+        return histograms_[static_cast<size_t>(stage)][tag & (LATENCY_MAX_TAGS - 1)];
+    }
+};
+
+static_assert((LATENCY_MAX_TAGS & (LATENCY_MAX_TAGS - 1)) == 0, "tags are masked into range");
+
+typedef std::string (*LatencyTagToString)(uint8_t tag);
+
+// owns every thread's recorder, threads find theirs through a thread_local pointer
+class LatencyRegistry final{
+private:
+    std::mutex recorders_mutex_;
+    std::vector<std::unique_ptr<LatencyRecorder>> recorders_;
+
+public:
+    LatencyRegistry() = default;
+    LatencyRegistry(const LatencyRegistry&) = delete;
+    LatencyRegistry(const LatencyRegistry&&) = delete;
+    LatencyRegistry& operator=(const LatencyRegistry&) = delete;
+    LatencyRegistry& operator=(const LatencyRegistry&&) = delete;
+
+    static auto Instance() noexcept -> LatencyRegistry*{
+        static LatencyRegistry registry;
+        return &registry;
+    }
+
+    // a new recorder, kept until the process exits so its counts outlive the thread
+    auto AddRecorder() -> LatencyRecorder*{
+        std::lock_guard<std::mutex> lock(recorders_mutex_);
+        recorders_.push_back(std::make_unique<LatencyRecorder>());
+        return recorders_.back().get();
+    }
+
+    // percentiles in nanoseconds for every stage and tag that saw samples, merged over all threads,
+    // each stage is followed by the tags merged together
+    auto Dump(std::ostream& os, LatencyTagToString tag_to_string) -> void{
+        std::lock_guard<std::mutex> lock(recorders_mutex_);
+        for(size_t stage = 0; stage < LATENCY_STAGES; ++stage){
+            const auto latency_stage = static_cast<LatencyStage>(stage);
+            auto all = std::make_unique<LatencyHistogram>();
+            for(size_t tag = 0; tag < LATENCY_MAX_TAGS; ++tag){
+                auto merged = std::make_unique<LatencyHistogram>();
+                for(const auto& recorder : recorders_){
+                    merged->Merge(recorder->GetHistogram(latency_stage, tag));
+                }
+                if(merged->GetCount()){
+                    os << LatencyStageToString(latency_stage) << " " << tag_to_string(tag) << " " << merged->ToString() << "\n";
+                    all->Merge(*merged);
+                }
+            }
+            if(all->GetCount()){
+                os << LatencyStageToString(latency_stage) << " ALL " << all->ToString() << "\n";
+            }
+        }
+        os.flush();
+    }
+};
+
+// the calling thread's recorder, registered the first time the thread records
+inline auto ThreadLatencyRecorder() noexcept -> LatencyRecorder*{
+    thread_local LatencyRecorder* recorder = nullptr;
+    if(UNLIKELY(!recorder)){
+        recorder = LatencyRegistry::Instance()->AddRecorder();
+    }
+    return recorder;
+}
+
+// records the time from start_time to now for the stage, returns now so the next probe can reuse it
+inline auto LatencyProbe(LatencyStage stage, uint8_t tag, Nanos start_time, Nanos now) noexcept{
+    ThreadLatencyRecorder()->Record(stage, tag, now - start_time);
+    return now;
+}
+
+}
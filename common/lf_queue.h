@@ -2,7 +2,10 @@
 #include <iostream>
 #include <vector>
 #include <atomic>
+#include <bit>
+#include <span>
 #include "macros.h"
+#include "idle_strategy.h"
 
 namespace Common{
 
@@ -53,4 +56,136 @@ public:
     }
 };
 
+// Single-producer/single-consumer version of LFQueue used for every queue hop in the exchange.
+// - the producer and consumer cursors live on their own cache lines so the two threads never
+//   write to the same line
+// - each side keeps a cached copy of the other side's cursor and only reloads the shared one
+//   when the cached value says the queue is full (producer) or empty (consumer)
+// - cursors only move forward and are masked with capacity-1 (capacity is rounded up to a power
+//   of two), so there is no modulo and no shared num_elements_ counter
+// - cursors are published with release stores and observed with acquire loads instead of the
+//   sequentially consistent operations LFQueue uses
+// - batches: the producer can write several elements (GetNextToWriteTo()/AdvanceWriteIndex() or
+//   GetWriteSpan()) and make them visible with one PublishWriteIndex(), and the consumer can take
+//   every ready element with GetReadSpan() and release them with one UpdateReadIndex(n)
+template<typename T>
+class SPSCLFQueue final{
+private:
+    std::vector<T> store_;
+    const size_t mask_;
+
+    // written by the producer only, pending_write_index_ runs ahead of next_write_index_ by the
+    // number of elements written but not yet published
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> next_write_index_ = {0};
+    size_t pending_write_index_ = 0;
+    size_t cached_read_index_ = 0;
+    // the consumer's idle strategy, woken after every publish
+    IdleStrategy* reader_idle_ = nullptr;
+
+    // written by the consumer only
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> next_read_index_ = {0};
+    size_t cached_write_index_ = 0;
+
+public:
+    /* Constructors */
+    // pre-allocation of vector storage, rounded up to the next power of two
+    explicit SPSCLFQueue(std::size_t num_elems): store_(std::bit_ceil(num_elems), T()), mask_(store_.size() - 1){
+
+    }
+
+    // deleting defaults to reduce latency
+    SPSCLFQueue() = delete;
+    SPSCLFQueue(const SPSCLFQueue&) = delete;
+    SPSCLFQueue(const SPSCLFQueue&&) = delete;
+    SPSCLFQueue& operator=(const SPSCLFQueue&) = delete;
+    SPSCLFQueue& operator=(const SPSCLFQueue&&) = delete;
+
+    // returns nullptr if the queue is full, LFQueue would silently overwrite unread elements instead
+    auto GetNextToWriteTo() noexcept -> T*{
+        if(UNLIKELY(pending_write_index_ - cached_read_index_ == store_.size())){
+            cached_read_index_ = next_read_index_.load(std::memory_order_acquire);
+            if(pending_write_index_ - cached_read_index_ == store_.size()){
+                return nullptr;
+            }
+        }
+        return &store_[pending_write_index_ & mask_];
+    }
+
+    // up to num_elems contiguous free slots starting at the next write position, fewer if the
+    // queue is nearly full or the slots would wrap past the end of store_
+    auto GetWriteSpan(std::size_t num_elems) noexcept -> std::span<T>{
+        const auto write_offset = pending_write_index_ & mask_;
+        const auto wanted = std::min(num_elems, store_.size() - write_offset);
+        if(UNLIKELY(store_.size() - (pending_write_index_ - cached_read_index_) < wanted)){
+            cached_read_index_ = next_read_index_.load(std::memory_order_acquire);
+        }
+        const auto free_elems = store_.size() - (pending_write_index_ - cached_read_index_);
+        return {&store_[write_offset], std::min(wanted, free_elems)};
+    }
+
+    // slots from the next write position to the end of store_, a write span never goes past them
+    auto SlotsBeforeWrap() const noexcept{
+        return store_.size() - (pending_write_index_ & mask_);
+    }
+
+    auto GetNextToRead() noexcept -> T*{
+        const auto read_index = next_read_index_.load(std::memory_order_relaxed);
+        if(read_index == cached_write_index_){
+            cached_write_index_ = next_write_index_.load(std::memory_order_acquire);
+            if(read_index == cached_write_index_){
+                return nullptr;
+            }
+        }
+        return &store_[read_index & mask_];
+    }
+
+    // every element published so far that is contiguous in store_ starting at the read position,
+    // release them with UpdateReadIndex(span.size()) once processed
+    auto GetReadSpan() noexcept -> std::span<T>{
+        const auto read_index = next_read_index_.load(std::memory_order_relaxed);
+        cached_write_index_ = next_write_index_.load(std::memory_order_acquire);
+        const auto read_offset = read_index & mask_;
+        return {&store_[read_offset], std::min(cached_write_index_ - read_index, store_.size() - read_offset)};
+    }
+
+    // only exact when called from the producer or consumer thread, otherwise a snapshot
+    auto Size() const noexcept{
+        // read cursor first so the result can never underflow
+        const auto read_index = next_read_index_.load(std::memory_order_acquire);
+        return next_write_index_.load(std::memory_order_acquire) - read_index;
+    }
+
+    auto Capacity() const noexcept{
+        return store_.size();
+    }
+
+    // moves past written elements without making them visible to the consumer
+    auto AdvanceWriteIndex(std::size_t num_elems = 1) noexcept{
+        pending_write_index_ += num_elems;
+    }
+
+    // makes every advanced element visible to the consumer with a single store
+    auto PublishWriteIndex() noexcept{
+        next_write_index_.store(pending_write_index_, std::memory_order_release);
+        if(reader_idle_){
+            reader_idle_->Unpark();
+        }
+    }
+
+    // lets a consumer that parks when the queue is empty be woken by the producer, set it before the
+    // producer starts and clear it before the strategy goes away
+    auto SetReaderIdleStrategy(IdleStrategy* idle_strategy) noexcept{
+        reader_idle_ = idle_strategy;
+    }
+
+    auto UpdateWriteIndex() noexcept{
+        AdvanceWriteIndex();
+        PublishWriteIndex();
+    }
+
+    auto UpdateReadIndex(std::size_t num_elems = 1) noexcept{
+        next_read_index_.store(next_read_index_.load(std::memory_order_relaxed) + num_elems, std::memory_order_release);
+    }
+};
+
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <cstdlib>
+#include "thread_utils.h"
+#include "lf_queue.h"
+#include "benchmark_utils.h"
+
+/* Compares LFQueue and SPSCLFQueue between two threads:
+   - ping-pong: one message in flight, reports per-hop latency (round trip / 2)
+   - streaming: producer pushes as fast as the consumer drains, reports throughput
+   - batched streaming: same as streaming using SPSCLFQueue's span/publish batch API
+   Usage: lf_queue_benchmark [ping_pong_iterations] [streaming_messages] [producer_core] [consumer_core] */
+
+using namespace Common;
+
+// one cache line per message, roughly the size of the exchange's request/response structs
+struct BenchMessage{
+    size_t seq_ = 0;
+    char payload_[56];
+};
+
+constexpr size_t BENCH_QUEUE_SIZE = 64 * 1024;
+
+// LFQueue has no full check, so the producer has to keep one slot free itself
+auto GetWriteSlot(LFQueue<BenchMessage>& queue) noexcept{
+    while(queue.Size() >= BENCH_QUEUE_SIZE - 1){
+    }
+    return queue.GetNextToWriteTo();
+}
+
+auto GetWriteSlot(SPSCLFQueue<BenchMessage>& queue) noexcept{
+    auto slot = queue.GetNextToWriteTo();
+    while(!slot){
+        slot = queue.GetNextToWriteTo();
+    }
+    return slot;
+}
+
+template<typename Q>
+auto GetReadSlot(Q& queue) noexcept{
+    auto slot = queue.GetNextToRead();
+    while(!slot){
+        slot = queue.GetNextToRead();
+    }
+    return slot;
+}
+
+template<typename Q>
+auto RunPingPong(const std::string& name, size_t iterations, int ping_core, int pong_core){
+    // the calling thread pings
+    if(ping_core >= 0){
+        ASSERT(SetThreadCore(ping_core), "Failed to pin " + name + " ping thread to core " + std::to_string(ping_core));
+    }
+    Q ping(BENCH_QUEUE_SIZE);
+    Q pong(BENCH_QUEUE_SIZE);
+
+    auto echo = [&](){
+        for(size_t i = 0; i < iterations; ++i){
+            auto request = GetReadSlot(ping);
+            auto reply = GetWriteSlot(pong);
+            reply->seq_ = request->seq_;
+            ping.UpdateReadIndex();
+            pong.UpdateWriteIndex();
+        }
+    };
+    auto echo_thread = CreateAndStartThread(pong_core, name + "/Pong", echo);
+
+    std::vector<Nanos> samples;
+    samples.reserve(iterations);
+    for(size_t i = 0; i < iterations; ++i){
+        const auto start = GetCurrentNanos();
+        GetWriteSlot(ping)->seq_ = i;
+        ping.UpdateWriteIndex();
+        auto reply = GetReadSlot(pong);
+        if(UNLIKELY(reply->seq_ != i)){
+            FATAL(name + " ping-pong out of sequence");
+        }
+        pong.UpdateReadIndex();
+        samples.push_back((GetCurrentNanos() - start) / 2);
+    }
+    echo_thread->join();
+    delete echo_thread;
+    PrintLatencyStats(name + " ping-pong hop ns", samples);
+}
+
+template<typename Q>
+auto RunStreaming(const std::string& name, size_t messages, int producer_core){
+    Q queue(BENCH_QUEUE_SIZE);
+    std::atomic<bool> go = {false};
+
+    auto produce = [&](){
+        while(!go){
+        }
+        for(size_t i = 0; i < messages; ++i){
+            GetWriteSlot(queue)->seq_ = i;
+            queue.UpdateWriteIndex();
+        }
+    };
+
+    auto producer_thread = CreateAndStartThread(producer_core, name + "/Producer", produce);
+    const auto start = GetCurrentNanos();
+    go = true;
+    for(size_t i = 0; i < messages; ++i){
+        auto message = GetReadSlot(queue);
+        if(UNLIKELY(message->seq_ != i)){
+            FATAL(name + " streaming out of sequence");
+        }
+        queue.UpdateReadIndex();
+    }
+    const auto elapsed = GetCurrentNanos() - start;
+    producer_thread->join();
+    delete producer_thread;
+    PrintThroughput(name + " streaming", messages, elapsed);
+}
+
+// producer fills up to BENCH_BATCH_SIZE slots per publish, consumer drains everything ready per release
+constexpr size_t BENCH_BATCH_SIZE = 64;
+
+auto RunBatchedStreaming(const std::string& name, size_t messages, int producer_core){
+    SPSCLFQueue<BenchMessage> queue(BENCH_QUEUE_SIZE);
+    std::atomic<bool> go = {false};
+
+    auto produce = [&](){
+        while(!go){
+        }
+        for(size_t i = 0; i < messages;){
+            auto slots = queue.GetWriteSpan(std::min(BENCH_BATCH_SIZE, messages - i));
+            for(auto& slot : slots){
+                slot.seq_ = i++;
+            }
+            queue.AdvanceWriteIndex(slots.size());
+            queue.PublishWriteIndex();
+        }
+    };
+
+    auto producer_thread = CreateAndStartThread(producer_core, name + "/Producer", produce);
+    const auto start = GetCurrentNanos();
+    go = true;
+    for(size_t i = 0; i < messages;){
+        const auto ready = queue.GetReadSpan();
+        for(const auto& message : ready){
+            if(UNLIKELY(message.seq_ != i++)){
+                FATAL(name + " batched streaming out of sequence");
+            }
+        }
+        queue.UpdateReadIndex(ready.size());
+    }
+    const auto elapsed = GetCurrentNanos() - start;
+    producer_thread->join();
+    delete producer_thread;
+    PrintThroughput(name + " batched streaming", messages, elapsed);
+}
+
+int main(int argc, char** argv){
+    const size_t ping_pong_iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    const size_t streaming_messages = argc > 2 ? std::atol(argv[2]) : 10000000;
+    const int producer_core = argc > 3 ? std::atoi(argv[3]) : -1;
+    const int consumer_core = argc > 4 ? std::atoi(argv[4]) : -1;
+
+    // the main thread plays the consumer in the streaming run and the pinging side in the ping-pong run
+    if(consumer_core >= 0){
+        ASSERT(SetThreadCore(consumer_core), "Failed to pin main thread to core " + std::to_string(consumer_core));
+    }
+
+    RunPingPong<LFQueue<BenchMessage>>("LFQueue", ping_pong_iterations, consumer_core, producer_core);
+    RunPingPong<SPSCLFQueue<BenchMessage>>("SPSCLFQueue", ping_pong_iterations, consumer_core, producer_core);
+    RunStreaming<LFQueue<BenchMessage>>("LFQueue", streaming_messages, producer_core);
+    RunStreaming<SPSCLFQueue<BenchMessage>>("SPSCLFQueue", streaming_messages, producer_core);
+    RunBatchedStreaming("SPSCLFQueue", streaming_messages, producer_core);
+    return 0;
+}
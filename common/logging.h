@@ -1,222 +1,654 @@
 #pragma once
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <array>
+#include <vector>
+#include <span>
+#include <memory>
+#include <mutex>
 #include <cstdio>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <charconv>
+#include <algorithm>
+#include <concepts>
+#include <type_traits>
 #include "types.h"
 #include "macros.h"
 #include "lf_queue.h"
 #include "thread_utils.h"
 #include "time_utils.h"
+#include "stats_segment.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 
 namespace Common{
 
+/*
+Log() does not format on the calling thread. Each call copies its arguments as raw bytes into one
+variable-size record on the Logger's lock-free queue, and the backend thread that LogBackend shares
+between all Loggers formats the record into the file. The format string is a template argument, so it
+is parsed at compile time, and each (format, argument types) pair gets its own decoder function whose address is the format's id in the record header.
+Arguments can be:
+- arithmetic values, copied as they are
+- C strings, std::string and std::string_view, copied as a length and the characters
+- trivially copyable structs with a ToString() member such as MEClientResponse, copied as they are and
+  turned into text by ToString() on the backend thread
+- LogTime{}, which takes no space in the record and prints the time the record was logged. Every record
+  carries a raw clock reading taken in Log(), it is only turned into text on the backend thread
+*/
+
+// records are made of whole blocks so a record always starts on its own cache line
+constexpr size_t LOG_BLOCK_SIZE = CACHE_LINE_SIZE;
+// 128MB of queue per Logger
+constexpr size_t LOG_QUEUE_SIZE = 2 * 1024 * 1024;
+// the backend thread formats into LOG_WRITE_BUFFERS buffers of about LOG_WRITE_BUFFER_SIZE bytes
+// before writing them out
+constexpr size_t LOG_WRITE_BUFFER_SIZE = 256 * 1024;
+constexpr size_t LOG_WRITE_BUFFERS = 8;
+constexpr size_t LOG_MAX_FILE_SIZE = 1024 * 1024 * 1024;
+constexpr size_t LOG_MAX_ROTATED_FILES = 4;
+// the backend thread backs off to sleeps of up to this long when no Logger has anything new
+constexpr Nanos LOG_BACKEND_MAX_SLEEP_NANOS = 10 * NANOS_TO_MILLIS;
+constexpr auto LOG_BACKEND_THREAD_NAME = "Common/LogBackend";
+
+struct alignas(LOG_BLOCK_SIZE) LogBlock{
+    std::byte bytes_[LOG_BLOCK_SIZE];
+};
 
-constexpr size_t LOG_QUEUE_SIZE = 8 * 1024 * 1024;
+// appends the text of one record to the output, reading the arguments from the record payload
+typedef void (*LogDecoder)(const std::byte* payload, Nanos time, std::string* out);
 
-enum class LogType: int8_t{
-    CHAR = 0,
-    INTEGER = 1,
-    LONG_INTEGER = 2,
-    LONG_LONG_INTEGER = 3,
-    UNSIGNED_INTEGER = 4,
-    UNSIGNED_LONG_INTEGER = 5,
-    UNSIGNED_LONG_LONG_INTEGER = 6,
-    FLOAT = 7,
-    DOUBLE = 8
+struct LogRecordHeader{
+    // nullptr for the padding record that fills the blocks up to the end of the queue
+    LogDecoder decoder_ = nullptr;
+    Nanos time_ = 0;
+    uint32_t num_blocks_ = 0;
 };
 
-// struct that will be passed to the lock-free queue in order to log events by a non-critical path thread
-struct LogElement{
-    LogType type_ = LogType::CHAR;
-    union{
-        char c;
-        int i;
-        long l;
-        long long ll;
-        unsigned int u;
-        unsigned long ul;
-        unsigned long long ull;
-        float f;
-        double d;
-    } u_;
+// Log() argument standing for the time the record was logged, printed like GetCurrentTimeStr()
+struct LogTime{
 };
 
-class Logger final{
-private:
-    const std::string file_name_;
-    std::ofstream file_;
-    LFQueue<LogElement> queue_;
-    std::atomic<bool> running_ = {true};
-    std::thread* logger_thread_ = nullptr;
-
-public:
-    void FlushQueue() noexcept{
-        // need to create a loop to consume every element on the queue, check it's log type, 
-        // store the correct variable from the union and write that value to the file
-        // then sleep for a millisecond when the lock-free queue is empty
-
-        // keep looping
-        while(running_){
-            for(auto next = queue_.GetNextToRead(); queue_.Size() && next; next = queue_.GetNextToRead()){
-                switch (next->type_){
-                    case LogType::CHAR:
-                        file_ << next->u_.c;
-                        break;
-                    
-                    case LogType::INTEGER:
-                        file_ << next->u_.i;
-                        break;
+// ctime() only runs when the second changes, records logged within the same second reuse the text
+inline auto AppendLogTime(Nanos time, std::string* out){
+    thread_local time_t last_second = -1;
+    thread_local std::string last_time_str;
+    const time_t second = time / NANOS_TO_SECS;
+    if(second != last_second){
+        char buffer[32];
+        last_time_str.assign(ctime_r(&second, buffer));
+        // drop the newline ctime() ends with
+        if(!last_time_str.empty()){
+            last_time_str.pop_back();
+        }
+        last_second = second;
+    }
+    out->append(last_time_str);
+}
 
-                    case LogType::LONG_INTEGER:
-                        file_ << next->u_.l;
-                        break;
+// format string as a template argument: Log<"Integer:% String:%\n">(int_val, str_val)
+template<size_t N>
+struct LogFormat{
+    char chars_[N];
 
-                    case LogType::LONG_LONG_INTEGER:
-                        file_ << next->u_.ll;
-                        break;
+    constexpr LogFormat(const char (&format)[N]) noexcept{
+        std::copy_n(format, N, chars_);
+    }
 
-                    case LogType::UNSIGNED_INTEGER:
-                        file_ << next->u_.u;
-                        break;
+    // number of % placeholders, %% is a literal %
+    constexpr auto NumArgs() const noexcept{
+        size_t num_args = 0;
+        for(size_t i = 0; i + 1 < N; ++i){
+            if(chars_[i] == '%'){
+                if(chars_[i + 1] == '%'){
+                    ++i;
+                }else{
+                    ++num_args;
+                }
+            }
+        }
+        return num_args;
+    }
+};
 
-                    case LogType::UNSIGNED_LONG_INTEGER:
-                        file_ << next->u_.ul;
-                        break;
+template<typename T>
+concept LogString = std::is_convertible_v<const T&, std::string_view>;
 
-                    case LogType::UNSIGNED_LONG_LONG_INTEGER:
-                        file_ << next->u_.ull;
-                        break;
+template<typename T>
+concept LogNumber = std::is_arithmetic_v<T>;
 
-                    case LogType::FLOAT:
-                        file_ << next->u_.f;
-                        break;
+template<typename T>
+concept LogStruct = std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T> &&
+                    requires(const T& value){ {value.ToString()} -> std::convertible_to<std::string>; };
 
-                    case LogType::DOUBLE:
-                        file_ << next->u_.d;
-                        break;
+// how an argument of type T is stored in the record, strings are read back as views into the payload
+template<typename T>
+using LogWireType = std::conditional_t<LogString<T>, std::string_view, std::remove_cvref_t<T>>;
 
-                    default:
-                        break;
-                }
-                queue_.UpdateReadIndex();
-                // next = queue_.GetNextToRead();
+template<typename T>
+inline auto ToLogString(const T& value) noexcept -> std::string_view{
+    if constexpr(std::is_pointer_v<T>){
+        return value ? std::string_view(value) : std::string_view();
+    }else{
+        return value;
+    }
+}
+
+template<typename T>
+inline auto LogArgSize(const T& value) noexcept -> size_t{
+    if constexpr(std::is_same_v<T, LogTime>){
+        return 0;
+    }else if constexpr(LogString<T>){
+        return sizeof(uint32_t) + ToLogString(value).size();
+    }else{
+        static_assert(LogNumber<T> || LogStruct<T>, "Log() arguments must be numbers, strings or trivially copyable structs with ToString()");
+        return sizeof(T);
+    }
+}
+
+template<typename T>
+inline auto EncodeLogArg(std::byte** payload, const T& value) noexcept{
+    if constexpr(std::is_same_v<T, LogTime>){
+        return;
+    }else if constexpr(LogString<T>){
+        const auto view = ToLogString(value);
+        const auto size = static_cast<uint32_t>(view.size());
+        std::memcpy(*payload, &size, sizeof(size));
+        std::memcpy(*payload + sizeof(size), view.data(), size);
+        *payload += sizeof(size) + size;
+    }else{
+        std::memcpy(*payload, &value, sizeof(T));
+        *payload += sizeof(T);
+    }
+}
+
+template<typename T>
+inline auto DecodeLogArg(const std::byte** payload, Nanos time, std::string* out){
+    if constexpr(std::is_same_v<T, LogTime>){
+        AppendLogTime(time, out);
+    }else if constexpr(std::is_same_v<T, std::string_view>){
+        uint32_t size = 0;
+        std::memcpy(&size, *payload, sizeof(size));
+        out->append(reinterpret_cast<const char*>(*payload + sizeof(size)), size);
+        *payload += sizeof(size) + size;
+    }else{
+        T value;
+        std::memcpy(&value, *payload, sizeof(T));
+        *payload += sizeof(T);
+        if constexpr(std::is_same_v<T, char>){
+            out->push_back(value);
+        }else if constexpr(std::is_same_v<T, bool>){
+            out->push_back(value ? '1' : '0');
+        }else if constexpr(LogNumber<T>){
+            char buffer[64];
+            const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            out->append(buffer, result.ptr);
+        }else{
+            out->append(value.ToString());
+        }
+    }
+}
+
+// copies format text up to the next placeholder, %% becomes %, returns the position after the placeholder
+inline auto AppendLogText(const char* format, std::string* out) noexcept -> const char*{
+    while(*format){
+        if(*format == '%'){
+            if(UNLIKELY(*(format + 1) == '%')){
+                ++format;
+            }else{
+                return format + 1;
             }
-            file_.flush();
-            using namespace std::literals::chrono_literals;
-            std::this_thread::sleep_for(10ms);
         }
+        out->push_back(*format++);
     }
+    return format;
+}
+
+template<LogFormat Format, typename... WireTypes>
+inline auto DecodeLogRecord([[maybe_unused]] const std::byte* payload, [[maybe_unused]] Nanos time, std::string* out) -> void{
+    const char* format = Format.chars_;
+    ((format = AppendLogText(format, out), DecodeLogArg<WireTypes>(&payload, time, out)), ...);
+    AppendLogText(format, out);
+}
+
+// what Log() does when the queue has no room for a record
+enum class LogOverflowPolicy: uint8_t{
+    // the record is dropped and counted
+    DROP = 0,
+    // the caller waits for the backend thread to make room
+    BLOCK = 1,
+    // the record goes to an unbounded buffer behind a mutex until the backend thread catches up,
+    // records keep going there while it is not empty so the file stays in order
+    SPILL = 2
+};
 
-    explicit Logger(const std::string& file_name): file_name_(file_name), queue_(LOG_QUEUE_SIZE){
-        file_.open(file_name_);
-        ASSERT(file_.is_open(), "Could not open log file: " + file_name_);
-        logger_thread_ = CreateAndStartThread(-1, "Common/Logger", [this](){FlushQueue();});
-        ASSERT(logger_thread_ != nullptr, "Failed to start Logger thread.");
+inline auto LogOverflowPolicyToString(LogOverflowPolicy policy) -> std::string{
+    switch(policy){
+        case LogOverflowPolicy::DROP:
+            return "DROP";
+        case LogOverflowPolicy::BLOCK:
+            return "BLOCK";
+        case LogOverflowPolicy::SPILL:
+            return "SPILL";
     }
+    return "UNKNOWN";
+}
+
+struct LogConfig{
+    LogOverflowPolicy overflow_policy_ = LogOverflowPolicy::DROP;
+    size_t queue_blocks_ = LOG_QUEUE_SIZE;
+    // the file is rotated once it would grow past this, 0 never rotates
+    size_t max_file_size_ = LOG_MAX_FILE_SIZE;
+    // rotated files are kept as <file>.1 (newest) to <file>.max_rotated_files_
+    size_t max_rotated_files_ = LOG_MAX_ROTATED_FILES;
+};
 
-    Logger() = delete;
-    Logger(const Logger&) = delete;
-    Logger(const Logger&&) = delete;
-    Logger& operator=(const Logger&) = delete;
-    Logger& operator=(const Logger&&) = delete;
+struct LoggerStats{
+    uint64_t records_ = 0;
+    uint64_t dropped_ = 0;
+    uint64_t blocked_ = 0;
+    uint64_t spilled_ = 0;
+    uint64_t bytes_written_ = 0;
+    uint64_t rotations_ = 0;
+    // failed writes and rotations that could not open a new file, and the bytes the failed writes lost
+    uint64_t write_errors_ = 0;
+    uint64_t lost_bytes_ = 0;
+};
 
-    ~Logger(){
-        std::string time_str;
-        std::cerr << "Flushing and closing logger for: " << file_name_ << std::endl;
-        while(queue_.Size()){
-            using namespace std::literals::chrono_literals;
-            std::this_thread::sleep_for(1s);
-        }
-        running_ = false;
-        logger_thread_->join();
-        file_.close();
-        std::cerr << Common::GetCurrentTimeStr(&time_str) << " Logger for " << file_name_ << " exiting." << std::endl;
-    }
+class Logger;
 
-    auto PushValue(const LogElement& log_element) noexcept{
-        *(queue_.GetNextToWriteTo()) = log_element;
-        queue_.UpdateWriteIndex();
-    }
+/*
+One thread formats and writes the records of every Logger in the process, so a component that adds a
+Logger adds a queue and a file but no thread. The thread starts with the first Logger, or earlier through
+Start() to pin it to a core, and polls the registered Loggers in turn, sleeping when none of them had
+anything new.
+*/
+class LogBackend final{
+private:
+    // held while the backend thread polls, so a Logger is never polled after Unregister() returns
+    std::mutex loggers_mutex_;
+    std::vector<Logger*> loggers_;
+    std::atomic<bool> running_ = {false};
+    std::thread* backend_thread_ = nullptr;
+    // BACKOFF unless the thread placement config picks another strategy for Common/LogBackend
+    std::unique_ptr<IdleStrategy> idle_strategy_;
+
+    auto StartLocked(int core_id) noexcept -> void;
+    auto Run() noexcept -> void;
 
-    auto PushValue(const char value) noexcept {
-        PushValue(LogElement{LogType::CHAR, {.c = value}});
+public:
+    LogBackend() = default;
+    LogBackend(const LogBackend&) = delete;
+    LogBackend(const LogBackend&&) = delete;
+    LogBackend& operator=(const LogBackend&) = delete;
+    LogBackend& operator=(const LogBackend&&) = delete;
+
+    ~LogBackend();
+
+    // the backend every Logger registers with
+    static auto Instance() noexcept -> LogBackend*{
+        static LogBackend backend;
+        return &backend;
     }
 
-    auto PushValue(const int value) noexcept{
-        PushValue(LogElement{LogType::INTEGER, {.i = value}});
+    // starts the backend thread on core_id, -1 leaves it unpinned. Does nothing once the thread is running,
+    // so it has to be called before the first Logger is created to pin the thread
+    auto Start(int core_id) noexcept -> void;
+
+    auto Register(Logger* logger) noexcept -> void;
+    auto Unregister(Logger* logger) noexcept -> void;
+};
+
+class Logger final{
+private:
+    const std::string file_name_;
+    const LogConfig config_;
+    int fd_ = -1;
+    size_t file_size_ = 0;
+    SPSCLFQueue<LogBlock> queue_;
+
+    // records that did not fit in the queue under LogOverflowPolicy::SPILL
+    std::mutex spill_mutex_;
+    std::vector<LogBlock> spill_blocks_;
+    std::atomic<bool> spill_pending_ = {false};
+
+    // text waiting to be written, the backend thread fills the buffers in turn and
+    // hands all of them to one writev()
+    std::array<std::string, LOG_WRITE_BUFFERS> write_buffers_;
+    size_t write_buffer_index_ = 0;
+    std::vector<LogBlock> spill_read_blocks_;
+
+    // published in the stats segment as log.<file_name>.<stat>, each one is written by one thread only,
+    // the producer's or the backend thread's
+    StatsCounter records_;
+    StatsCounter dropped_;
+    StatsCounter blocked_;
+    StatsCounter spilled_;
+    StatsCounter bytes_written_;
+    StatsCounter rotations_;
+    StatsCounter write_errors_;
+    StatsCounter lost_bytes_;
+    StatsCounter queue_depth_;
+
+    static auto Increment(StatsCounter* counter, uint64_t value = 1) noexcept{
+        counter->Add(value);
     }
 
-    auto PushValue(const long value) noexcept{
-        PushValue(LogElement{LogType::LONG_INTEGER, {.l = value}});
+    // contiguous room for num_blocks at the write position, nullptr if the queue is full. Records never
+    // wrap: when the room before the end of the queue is too small it is filled with a padding record
+    auto ReserveBlocks(size_t num_blocks) noexcept -> LogBlock*{
+        auto blocks = queue_.GetWriteSpan(num_blocks);
+        if(LIKELY(blocks.size() == num_blocks)){
+            return blocks.data();
+        }
+        const auto slots_before_wrap = queue_.SlotsBeforeWrap();
+        if(slots_before_wrap >= num_blocks || blocks.size() < slots_before_wrap){
+            return nullptr;
+        }
+        new(blocks.data()) LogRecordHeader{nullptr, 0, static_cast<uint32_t>(blocks.size())};
+        queue_.AdvanceWriteIndex(blocks.size());
+        blocks = queue_.GetWriteSpan(num_blocks);
+        return (blocks.size() == num_blocks ? blocks.data() : nullptr);
     }
 
-    auto PushValue(const long long value) noexcept{
-        PushValue(LogElement{LogType::LONG_LONG_INTEGER, {.ll = value}});
+    // formats the records in blocks into the write buffers, returns the number of blocks used
+    auto DecodeRecords(std::span<const LogBlock> blocks) noexcept{
+        size_t num_blocks = 0;
+        while(num_blocks < blocks.size()){
+            const auto header = reinterpret_cast<const LogRecordHeader*>(blocks[num_blocks].bytes_);
+            if(LIKELY(header->decoder_)){
+                auto buffer = &write_buffers_[write_buffer_index_];
+                header->decoder_(blocks[num_blocks].bytes_ + sizeof(LogRecordHeader), header->time_, buffer);
+                if(buffer->size() >= LOG_WRITE_BUFFER_SIZE && ++write_buffer_index_ == write_buffers_.size()){
+                    WriteBuffers();
+                }
+            }
+            num_blocks += header->num_blocks_;
+        }
+        return num_blocks;
     }
 
-    auto PushValue(const unsigned value) noexcept{
-        PushValue(LogElement{LogType::UNSIGNED_INTEGER, {.u = value}});
+    // formats every record published so far, returns the number of blocks read
+    auto DrainQueue() noexcept{
+        size_t total_blocks = 0;
+        for(auto blocks = queue_.GetReadSpan(); !blocks.empty(); blocks = queue_.GetReadSpan()){
+            // records are published whole and never wrap, so the span holds whole records
+            const auto num_blocks = DecodeRecords(blocks);
+            queue_.UpdateReadIndex(num_blocks);
+            total_blocks += num_blocks;
+        }
+        return total_blocks;
     }
 
-    auto PushValue(const unsigned long value) noexcept{
-        PushValue(LogElement{LogType::UNSIGNED_LONG_INTEGER, {.ul = value}});
+    // spilled records are newer than everything already in the queue, the producer does not use
+    // the queue while spill_pending_ is set, so draining the queue under the lock keeps the order
+    auto DrainSpill() noexcept{
+        {
+            std::lock_guard<std::mutex> lock(spill_mutex_);
+            DrainQueue();
+            spill_read_blocks_.swap(spill_blocks_);
+            spill_pending_.store(false, std::memory_order_release);
+        }
+        DecodeRecords(spill_read_blocks_);
+        spill_read_blocks_.clear();
     }
 
-    auto PushValue(const unsigned long long value) noexcept{
-        PushValue(LogElement{LogType::UNSIGNED_LONG_LONG_INTEGER, {.ull = value}});
+    // the new file is opened before anything is renamed, when that fails the old file stays open and in
+    // place and the next attempt waits for another max_file_size_ bytes
+    auto RotateFile() noexcept{
+        const auto new_file_name = file_name_ + ".new";
+        const auto fd = open(new_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        file_size_ = 0;
+        if(UNLIKELY(fd < 0)){
+            Increment(&write_errors_);
+            std::cerr << "Could not rotate log file " << file_name_ << " error: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        if(config_.max_rotated_files_){
+            for(auto i = config_.max_rotated_files_; i > 1; --i){
+                std::rename((file_name_ + "." + std::to_string(i - 1)).c_str(), (file_name_ + "." + std::to_string(i)).c_str());
+            }
+            std::rename(file_name_.c_str(), (file_name_ + ".1").c_str());
+        }
+        std::rename(new_file_name.c_str(), file_name_.c_str());
+        close(fd_);
+        fd_ = fd;
+        Increment(&rotations_);
     }
 
-    auto PushValue(const float value) noexcept{
-        PushValue(LogElement{LogType::FLOAT, {.f = value}});
+    // writes every filled buffer with one writev(), rotating the file first if it would grow too large
+    auto WriteBuffers() noexcept -> void{
+        std::array<iovec, LOG_WRITE_BUFFERS> iov;
+        int iov_count = 0;
+        size_t total_bytes = 0;
+        for(auto& buffer : write_buffers_){
+            if(!buffer.empty()){
+                iov[iov_count++] = {buffer.data(), buffer.size()};
+                total_bytes += buffer.size();
+            }
+        }
+        if(!total_bytes){
+            return;
+        }
+        if(config_.max_file_size_ && file_size_ && file_size_ + total_bytes > config_.max_file_size_){
+            RotateFile();
+        }
+
+        auto iov_begin = iov.data();
+        auto bytes_left = total_bytes;
+        while(bytes_left && iov_count){
+            const auto written = writev(fd_, iov_begin, iov_count);
+            if(UNLIKELY(written < 0)){
+                if(errno == EINTR){
+                    continue;
+                }
+                // the rest of the buffers is lost, ENOSPC or EBADF won't go away by retrying
+                Increment(&write_errors_);
+                Increment(&lost_bytes_, bytes_left);
+                break;
+            }
+            bytes_left -= written;
+            // skip what a partial write already wrote
+            for(auto n = static_cast<size_t>(written); n;){
+                if(n >= iov_begin->iov_len){
+                    n -= iov_begin->iov_len;
+                    ++iov_begin;
+                    --iov_count;
+                }else{
+                    iov_begin->iov_base = static_cast<char*>(iov_begin->iov_base) + n;
+                    iov_begin->iov_len -= n;
+                    n = 0;
+                }
+            }
+        }
+        file_size_ += total_bytes - bytes_left;
+        Increment(&bytes_written_, total_bytes - bytes_left);
+
+        for(auto& buffer : write_buffers_){
+            buffer.clear();
+        }
+        write_buffer_index_ = 0;
     }
-    
-    auto PushValue(const double value) noexcept{
-        PushValue(LogElement{LogType::DOUBLE, {.d = value}});
+
+    friend class LogBackend;
+
+    // called by the backend thread: formats everything the producer published, then whatever it spilled,
+    // and writes it out. Returns false when there was nothing new
+    auto Poll() noexcept{
+        const auto num_blocks = DrainQueue();
+        const auto spilled = spill_pending_.load(std::memory_order_acquire);
+        if(spilled){
+            DrainSpill();
+        }
+        WriteBuffers();
+        queue_depth_.Set(queue_.Size());
+        return (num_blocks || spilled);
     }
 
-    auto PushValue(const char* value) noexcept{
-        while(*value){
-            PushValue(*value);
-            ++value;
+public:
+    explicit Logger(const std::string& file_name, const LogConfig& config = LogConfig()):
+                    file_name_(file_name), config_(config), queue_(config.queue_blocks_),
+                    records_("log." + file_name + ".records"), dropped_("log." + file_name + ".dropped"),
+                    blocked_("log." + file_name + ".blocked"), spilled_("log." + file_name + ".spilled"),
+                    bytes_written_("log." + file_name + ".bytes"), rotations_("log." + file_name + ".rotations"),
+                    write_errors_("log." + file_name + ".write_errors"), lost_bytes_("log." + file_name + ".lost_bytes"),
+                    queue_depth_("log." + file_name + ".queue_blocks", StatKind::GAUGE){
+        // a Logger opened again on the same file takes over the previous one's stats
+        for(auto stat : {&records_, &dropped_, &blocked_, &spilled_, &bytes_written_, &rotations_, &write_errors_, &lost_bytes_, &queue_depth_}){
+            stat->Set(0);
+        }
+        fd_ = open(file_name_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ASSERT(fd_ >= 0, "Could not open log file: " + file_name_);
+        for(auto& buffer : write_buffers_){
+            buffer.reserve(LOG_WRITE_BUFFER_SIZE * 2);
         }
+        // calibrates the clock Log() reads now rather than in the first Log() call
+        TscClock::Instance();
+        LogBackend::Instance()->Register(this);
+    }
+
+    Logger() = delete;
+    Logger(const Logger&) = delete;
+    Logger(const Logger&&) = delete;
+    Logger& operator=(const Logger&) = delete;
+    Logger& operator=(const Logger&&) = delete;
+
+    ~Logger(){
+        std::string time_str;
+        std::cerr << "Flushing and closing logger for: " << file_name_ << std::endl;
+        LogBackend::Instance()->Unregister(this);
+        // the backend no longer polls this Logger, write out whatever it had not reached yet
+        Poll();
+        close(fd_);
+        const auto stats = GetStats();
+        std::cerr << Common::GetCurrentTimeStr(&time_str) << " Logger for " << file_name_ << " exiting."
+                  << " records:" << stats.records_ << " dropped:" << stats.dropped_ << " blocked:" << stats.blocked_
+                  << " spilled:" << stats.spilled_ << " bytes:" << stats.bytes_written_ << " rotations:" << stats.rotations_
+                  << " write_errors:" << stats.write_errors_ << " lost_bytes:" << stats.lost_bytes_ << std::endl;
     }
 
-    auto PushValue(const std::string& value) noexcept{
-        PushValue(value.c_str());
+    auto GetStats() const noexcept -> LoggerStats{
+        return LoggerStats{records_.Get(), dropped_.Get(), blocked_.Get(), spilled_.Get(), bytes_written_.Get(), rotations_.Get(), write_errors_.Get(), lost_bytes_.Get()};
     }
 
     // function used by performant thread to push log to lock-free queue
-    // Example: log("Integer:% String:% Double:%", int_val, str_val, dbl_val); 
-    template< typename T, typename... A>
-    auto Log(const char* s, const T &value, A... args) noexcept{
-        while(*s){
-            if(*s == '%'){
-                if(UNLIKELY(*(s+1) == '%')){
-                    ++s;
-                }else{
-                    PushValue(value);
-                    Log(s + 1, args...);
-                    return;
+    // Example: Log<"% Integer:% String:% Double:%\n">(LogTime{}, int_val, str_val, dbl_val);
+    // If the backend thread has fallen behind the record is dropped, waited for or spilled
+    // depending on the LogOverflowPolicy
+    template<LogFormat Format, typename... Args>
+    auto Log(const Args&... args) noexcept{
+        static_assert(Format.NumArgs() == sizeof...(Args), "number of Log() arguments does not match the % placeholders in the format");
+
+        const auto record_size = sizeof(LogRecordHeader) + (LogArgSize(args) + ... + 0);
+        const auto num_blocks = (record_size + LOG_BLOCK_SIZE - 1) / LOG_BLOCK_SIZE;
+        const auto time = GetTscNanos();
+        const auto write_record = [&](LogBlock* blocks){
+            new(blocks) LogRecordHeader{&DecodeLogRecord<Format, LogWireType<Args>...>, time, static_cast<uint32_t>(num_blocks)};
+            auto payload = blocks->bytes_ + sizeof(LogRecordHeader);
+            (EncodeLogArg(&payload, args), ...);
+        };
+
+        if(LIKELY(!spill_pending_.load(std::memory_order_relaxed))){
+            auto blocks = ReserveBlocks(num_blocks);
+            if(UNLIKELY(!blocks)){
+                switch(config_.overflow_policy_){
+                    case LogOverflowPolicy::DROP:
+                        Increment(&dropped_);
+                        return;
+                    case LogOverflowPolicy::BLOCK:
+                        Increment(&blocked_);
+                        queue_.PublishWriteIndex();
+                        while(!(blocks = ReserveBlocks(num_blocks))){
+                            std::this_thread::yield();
+                        }
+                        break;
+                    case LogOverflowPolicy::SPILL:
+                        break;
                 }
             }
-            PushValue(*s++);
+            if(LIKELY(blocks)){
+                write_record(blocks);
+                queue_.AdvanceWriteIndex(num_blocks);
+                queue_.PublishWriteIndex();
+                Increment(&records_);
+                return;
+            }
         }
-        FATAL("Extra arguments provided to log()");
+
+        std::lock_guard<std::mutex> lock(spill_mutex_);
+        const auto offset = spill_blocks_.size();
+        spill_blocks_.resize(offset + num_blocks);
+        write_record(&spill_blocks_[offset]);
+        spill_pending_.store(true, std::memory_order_release);
+        Increment(&spilled_);
+        Increment(&records_);
     }
+};
 
-    auto Log(const char* s) noexcept{
-        while(*s){
-            if(*s == '%'){
-                if(UNLIKELY(*(s+1) == '%')){
-                    ++s;
-                }else{
-                    FATAL("missing arguments to log()");
-                }
+inline LogBackend::~LogBackend(){
+    running_ = false;
+    if(backend_thread_){
+        backend_thread_->join();
+        delete backend_thread_;
+    }
+    // Loggers that were never destroyed still get their records written
+    for(auto logger : loggers_){
+        logger->Poll();
+    }
+}
+
+inline auto LogBackend::StartLocked(int core_id) noexcept -> void{
+    if(backend_thread_){
+        return;
+    }
+    const auto placement = ThreadPlacementConfig::Instance()->Get(LOG_BACKEND_THREAD_NAME, ThreadPlacement{core_id, 0, -1, IdleStrategyType::BACKOFF});
+    idle_strategy_ = std::make_unique<IdleStrategy>(placement.idle_strategy_, LOG_BACKEND_MAX_SLEEP_NANOS);
+    running_ = true;
+    backend_thread_ = CreateAndStartThread(core_id, LOG_BACKEND_THREAD_NAME, [this](){Run();});
+    ASSERT(backend_thread_ != nullptr, "Failed to start LogBackend thread.");
+}
+
+inline auto LogBackend::Start(int core_id) noexcept -> void{
+    std::lock_guard<std::mutex> lock(loggers_mutex_);
+    StartLocked(core_id);
+}
+
+inline auto LogBackend::Register(Logger* logger) noexcept -> void{
+    std::lock_guard<std::mutex> lock(loggers_mutex_);
+    StartLocked(-1);
+    // a parked backend is woken by every record the Logger publishes
+    logger->queue_.SetReaderIdleStrategy(idle_strategy_.get());
+    loggers_.push_back(logger);
+}
+
+inline auto LogBackend::Unregister(Logger* logger) noexcept -> void{
+    std::lock_guard<std::mutex> lock(loggers_mutex_);
+    loggers_.erase(std::remove(loggers_.begin(), loggers_.end(), logger), loggers_.end());
+}
+
+inline auto LogBackend::Run() noexcept -> void{
+    // keep looping: poll every Logger and idle when none of them had anything new
+    while(running_){
+        bool busy = false;
+        {
+            std::lock_guard<std::mutex> lock(loggers_mutex_);
+            for(auto logger : loggers_){
+                busy |= logger->Poll();
             }
-            PushValue(*s++);
         }
+        // keeps GetTscNanos() on the hot threads a plain read
+        TscClock::Instance().RecalibrateIfDue();
+        idle_strategy_->Idle(busy, [this](){
+            std::lock_guard<std::mutex> lock(loggers_mutex_);
+            return std::any_of(loggers_.begin(), loggers_.end(), [](const Logger* logger){ return logger->queue_.Size() != 0; });
+        });
     }
-};
+}
 
-}
\ No newline at end of file
+}
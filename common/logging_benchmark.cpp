@@ -0,0 +1,219 @@
+#include <cstdlib>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include "logging.h"
+#include "benchmark_utils.h"
+
+/* Nanoseconds per Log() call on the calling thread, Logger against a copy of the previous
+   implementation that pushed one LogElement per character and per argument:
+   - engine line: the matching engine's "Sending %" line, the legacy call site formats the message
+     with ToString() before logging it, Logger copies the struct and formats it on the logger thread
+   - numbers line: the socket read line, a time string and five integers
+   Every call takes the time the way its call site does: the legacy logger and the "time string" runs
+   call GetCurrentTimeStr() per call, the other binary runs pass LogTime{} and leave the formatting of
+   the time to the logger thread
+   - burst: the engine line in a tight loop into a 4096 block queue that cannot keep up, once per
+     LogOverflowPolicy, with what reached the file, what was dropped or spilled and how long the logger
+     thread needed to write the rest after the burst
+   Usage: logging_benchmark [calls] */
+
+using namespace Common;
+
+// previous Logger, one queue element per character
+class LegacyLogger final{
+private:
+    enum class LogType: int8_t{
+        CHAR = 0,
+        INTEGER = 1,
+        LONG_INTEGER = 2,
+        UNSIGNED_LONG_INTEGER = 3
+    };
+
+    struct LogElement{
+        LogType type_ = LogType::CHAR;
+        union{
+            char c;
+            int i;
+            long l;
+            unsigned long ul;
+        } u_;
+    };
+
+    std::ofstream file_;
+    SPSCLFQueue<LogElement> queue_;
+    std::atomic<bool> running_ = {true};
+    std::thread* logger_thread_ = nullptr;
+
+    auto FlushQueue() noexcept{
+        while(running_){
+            for(auto next = queue_.GetNextToRead(); next; next = queue_.GetNextToRead()){
+                switch(next->type_){
+                    case LogType::CHAR: file_ << next->u_.c; break;
+                    case LogType::INTEGER: file_ << next->u_.i; break;
+                    case LogType::LONG_INTEGER: file_ << next->u_.l; break;
+                    case LogType::UNSIGNED_LONG_INTEGER: file_ << next->u_.ul; break;
+                }
+                queue_.UpdateReadIndex();
+            }
+            file_.flush();
+            using namespace std::literals::chrono_literals;
+            std::this_thread::sleep_for(10ms);
+        }
+    }
+
+    auto PushValue(const LogElement& log_element) noexcept{
+        auto next_write = queue_.GetNextToWriteTo();
+        if(UNLIKELY(!next_write)){
+            return;
+        }
+        *next_write = log_element;
+        queue_.UpdateWriteIndex();
+    }
+
+    auto PushValue(const char value) noexcept{ PushValue(LogElement{LogType::CHAR, {.c = value}}); }
+    auto PushValue(const int value) noexcept{ PushValue(LogElement{LogType::INTEGER, {.i = value}}); }
+    auto PushValue(const long value) noexcept{ PushValue(LogElement{LogType::LONG_INTEGER, {.l = value}}); }
+    auto PushValue(const unsigned long value) noexcept{ PushValue(LogElement{LogType::UNSIGNED_LONG_INTEGER, {.ul = value}}); }
+
+    auto PushValue(const char* value) noexcept{
+        while(*value){
+            PushValue(*value);
+            ++value;
+        }
+    }
+
+    auto PushValue(const std::string& value) noexcept{
+        PushValue(value.c_str());
+    }
+
+public:
+    explicit LegacyLogger(const std::string& file_name): queue_(8 * 1024 * 1024){
+        file_.open(file_name);
+        logger_thread_ = CreateAndStartThread(-1, "Bench/LegacyLogger", [this](){FlushQueue();});
+    }
+
+    ~LegacyLogger(){
+        while(queue_.Size()){
+            using namespace std::literals::chrono_literals;
+            std::this_thread::sleep_for(10ms);
+        }
+        running_ = false;
+        logger_thread_->join();
+    }
+
+    template<typename T, typename... A>
+    auto Log(const char* s, const T& value, A... args) noexcept{
+        while(*s){
+            if(*s == '%'){
+                if(UNLIKELY(*(s + 1) == '%')){
+                    ++s;
+                }else{
+                    PushValue(value);
+                    Log(s + 1, args...);
+                    return;
+                }
+            }
+            PushValue(*s++);
+        }
+    }
+
+    auto Log(const char* s) noexcept{
+        while(*s){
+            PushValue(*s++);
+        }
+    }
+};
+
+// same fields and ToString() shape as MEClientResponse
+#pragma pack(push, 1)
+struct BenchResponse{
+    uint8_t type_ = 1;
+    uint64_t client_id_ = 7;
+    uint64_t ticker_id_ = 3;
+    uint64_t client_order_id_ = 123456;
+    uint64_t market_order_id_ = 987654;
+    int8_t side_ = 1;
+    int64_t price_ = 10050;
+    uint32_t exec_qty_ = 10;
+    uint32_t leaves_qty_ = 90;
+
+    auto ToString() const{
+        std::stringstream ss;
+        ss << "MEClientResponse [type: " << static_cast<int>(type_) << " client: " << client_id_
+           << " ticker: " << ticker_id_ << " client_order_id: " << client_order_id_
+           << " market_order_id: " << market_order_id_ << " side: " << static_cast<int>(side_)
+           << " exec_qty: " << exec_qty_ << " leaves_qty: " << leaves_qty_ << " price: " << price_ << "]";
+        return ss.str();
+    }
+};
+#pragma pack(pop)
+
+template<typename F>
+auto TimeCalls(const std::string& name, size_t calls, F&& log_call){
+    std::vector<Nanos> samples;
+    samples.reserve(calls);
+    for(size_t i = 0; i < calls; ++i){
+        const auto start = GetCurrentNanos();
+        log_call(i);
+        samples.push_back(GetCurrentNanos() - start);
+    }
+    PrintLatencyStats(name, samples);
+}
+
+auto RunBurst(LogOverflowPolicy policy, size_t calls){
+    BenchResponse response;
+    auto logger = new Logger("logging_benchmark_burst.log", LogConfig{.overflow_policy_ = policy, .queue_blocks_ = 4096});
+    TimeCalls("burst " + LogOverflowPolicyToString(policy) + " ns", calls, [&](size_t i){
+        response.price_ = i;
+        logger->Log<"%:% %() % Sending %\n">(__FILE__, __LINE__, __FUNCTION__, LogTime{}, response);
+    });
+    // the destructor returns once everything queued and spilled is in the file
+    const auto stats = logger->GetStats();
+    const auto start = GetCurrentNanos();
+    delete logger;
+    const auto drain_time = GetCurrentNanos() - start;
+    PrintMetrics("burst " + LogOverflowPolicyToString(policy), {{"records", stats.records_}, {"dropped", stats.dropped_},
+                 {"blocked", stats.blocked_}, {"spilled", stats.spilled_}, {"drain_ms", drain_time / NANOS_TO_MILLIS}});
+}
+
+int main(int argc, char** argv){
+    const size_t calls = argc > 1 ? std::atol(argv[1]) : 20000;
+    std::string time_str;
+    BenchResponse response;
+
+    {
+        LegacyLogger legacy("logging_benchmark_legacy.log");
+        TimeCalls("legacy engine line ns", calls, [&](size_t i){
+            response.price_ = i;
+            legacy.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, GetCurrentTimeStr(&time_str), response.ToString());
+        });
+        TimeCalls("legacy numbers line ns", calls, [&](size_t i){
+            legacy.Log("%:% %() % read socket:% len:% utime:% ktime:% diff:%\n", __FILE__, __LINE__, __FUNCTION__, GetCurrentTimeStr(&time_str),
+                       5, static_cast<long>(i), static_cast<long>(i), static_cast<long>(i), 0l);
+        });
+    }
+    {
+        Logger logger("logging_benchmark.log");
+        TimeCalls("binary engine line time string ns", calls, [&](size_t i){
+            response.price_ = i;
+            logger.Log<"%:% %() % Sending %\n">(__FILE__, __LINE__, __FUNCTION__, GetCurrentTimeStr(&time_str), response);
+        });
+        TimeCalls("binary engine line ns", calls, [&](size_t i){
+            response.price_ = i;
+            logger.Log<"%:% %() % Sending %\n">(__FILE__, __LINE__, __FUNCTION__, LogTime{}, response);
+        });
+        TimeCalls("binary numbers line time string ns", calls, [&](size_t i){
+            logger.Log<"%:% %() % read socket:% len:% utime:% ktime:% diff:%\n">(__FILE__, __LINE__, __FUNCTION__, GetCurrentTimeStr(&time_str),
+                                                                                  5, static_cast<long>(i), static_cast<long>(i), static_cast<long>(i), 0l);
+        });
+        TimeCalls("binary numbers line ns", calls, [&](size_t i){
+            logger.Log<"%:% %() % read socket:% len:% utime:% ktime:% diff:%\n">(__FILE__, __LINE__, __FUNCTION__, LogTime{},
+                                                                                  5, static_cast<long>(i), static_cast<long>(i), static_cast<long>(i), 0l);
+        });
+    }
+    RunBurst(LogOverflowPolicy::DROP, calls);
+    RunBurst(LogOverflowPolicy::BLOCK, calls);
+    RunBurst(LogOverflowPolicy::SPILL, calls);
+    return 0;
+}
@@ -30,9 +30,9 @@ int main(int, char**){
     std::string ss = "test string";
     
     Logger logger("logging_example.log");
-    logger.Log("Logging a char:% an int:% and an unsigned:%\n", c, i, ul);
-    logger.Log("Logging a C-string:'%'\n", s);
-    logger.Log("Logging a string:'%'\n", ss);
+    logger.Log<"Logging a char:% an int:% and an unsigned:%\n">(c, i, ul);
+    logger.Log<"Logging a C-string:'%'\n">(s);
+    logger.Log<"Logging a string:'%'\n">(ss);
 
     return 0;
 }
\ No newline at end of file
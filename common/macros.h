@@ -8,6 +8,10 @@
 #define LIKELY(x) __builtin_expect(!!(x), 1)
 #define UNLIKELY(x) __builtin_expect(!!(x), 0)
 
+// size of a cache line on the x86-64 and ARM64 cores we run on, used to keep data written by
+// different threads from sharing a line (false sharing)
+constexpr size_t CACHE_LINE_SIZE = 64;
+
 inline auto ASSERT(bool cond, const std::string& msg) noexcept{
     if(UNLIKELY(!cond)){
         std::cerr << msg << std::endl;
@@ -2,6 +2,8 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <new>
+#include <utility>
 #include "macros.h"
 
 namespace Common {
@@ -79,4 +81,124 @@ public:
     }
 };
 
+// Memory pool with O(1) Allocate() and Deallocate(). Free blocks are linked through their own storage
+// (intrusive free list) so there is no scan for the next free block and no is_free_ flag padding every
+// block. Blocks that have never been handed out are taken from the untouched tail of store_, which is
+// left uninitialized, so the pool only commits the memory it actually uses. Builds without NDEBUG keep
+// a separate in-use bitmap to catch double frees and frees of blocks that were never allocated.
+template <typename T>
+class FreeListMemPool final{
+private:
+    // a block holds either a live T or, once freed, the link to the next free block
+    union ObjectBlock{
+        ObjectBlock* next_free_;
+        alignas(T) unsigned char object_[sizeof(T)];
+    };
+
+    ObjectBlock* store_ = nullptr;
+    const size_t num_blocks_ = 0;
+    // false when store_ was handed in by the caller, who frees it
+    const bool owns_store_ = true;
+    // head of the list of blocks returned through Deallocate()
+    ObjectBlock* free_list_ = nullptr;
+    // blocks at and after this index have never been allocated
+    size_t next_untouched_index_ = 0;
+    size_t num_in_use_ = 0;
+#ifndef NDEBUG
+    std::vector<bool> in_use_;
+#endif
+
+public:
+    // what a caller providing the pool's storage has to allocate for num_elements
+    static constexpr auto StorageBytes(std::size_t num_elements) noexcept{
+        return num_elements * sizeof(ObjectBlock);
+    }
+
+    static constexpr auto StorageAlignment() noexcept{
+        return alignof(ObjectBlock);
+    }
+
+    /* Constructors */
+    // storage, when given, holds StorageBytes(num_elements) aligned to StorageAlignment() and outlives the pool
+    explicit FreeListMemPool(std::size_t num_elements, void* storage = nullptr):
+             store_(storage ? static_cast<ObjectBlock*>(storage) : new ObjectBlock[num_elements]), num_blocks_(num_elements), owns_store_(!storage)
+#ifndef NDEBUG
+    , in_use_(num_elements, false)
+#endif
+    {
+        ASSERT(reinterpret_cast<const void*>(store_[0].object_) == &store_[0], "T Object should start at the beginning of ObjectBlock.");
+    }
+
+    ~FreeListMemPool(){
+        if(owns_store_){
+            delete[] store_;
+        }
+        store_ = nullptr;
+    }
+
+    // Deleting default constructors & destructors to decrease latency
+    FreeListMemPool() = delete;
+    FreeListMemPool(const FreeListMemPool&) = delete;
+    FreeListMemPool(const FreeListMemPool&&) = delete;
+    FreeListMemPool& operator=(const FreeListMemPool&) = delete;
+    FreeListMemPool& operator=(const FreeListMemPool&&) = delete;
+
+    // constructs T in place from the forwarded arguments
+    template<typename... Args>
+    T* Allocate(Args&&... args) noexcept{
+        auto obj_block = free_list_;
+        if(LIKELY(obj_block)){
+            free_list_ = obj_block->next_free_;
+        }else{
+            if(UNLIKELY(next_untouched_index_ == num_blocks_)){
+                FATAL("Memory pool out of space!");
+            }
+            obj_block = &store_[next_untouched_index_++];
+        }
+#ifndef NDEBUG
+        in_use_[obj_block - store_] = true;
+#endif
+        ++num_in_use_;
+        return new(obj_block->object_) T(std::forward<Args>(args)...);
+    }
+
+    // blocks can be addressed by their index in the pool, which lets containers link them
+    // with narrower handles than pointers
+    auto IndexOf(const T* elem) const noexcept -> size_t{
+        return reinterpret_cast<const ObjectBlock*>(elem) - store_;
+    }
+
+    auto ObjectAt(size_t index) const noexcept -> T*{
+        return reinterpret_cast<T*>(store_[index].object_);
+    }
+
+    // number of blocks ever handed out, the pool's memory is only committed up to here
+    auto HighWaterMark() const noexcept{
+        return next_untouched_index_;
+    }
+
+    // blocks currently allocated
+    auto InUse() const noexcept{
+        return num_in_use_;
+    }
+
+    auto Deallocate(const T* elem) noexcept{
+        auto obj_block = reinterpret_cast<ObjectBlock*>(const_cast<T*>(elem));
+        const auto elem_index = obj_block - store_;
+        if(UNLIKELY(elem_index < 0 || static_cast<size_t>(elem_index) >= num_blocks_)){
+            FATAL("Element being deallocated does not belong to this memory pool");
+        }
+#ifndef NDEBUG
+        if(UNLIKELY(!in_use_[elem_index])){
+            FATAL("Expected in-use ObjectBlock at index: " + std::to_string(elem_index));
+        }
+        in_use_[elem_index] = false;
+#endif
+        elem->~T();
+        obj_block->next_free_ = free_list_;
+        free_list_ = obj_block;
+        --num_in_use_;
+    }
+};
+
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <random>
+#include "mem_pool.h"
+#include "benchmark_utils.h"
+
+/* Random add/cancel churn against MemPool and FreeListMemPool sized like the matching engine's order_pool_.
+   The pool is filled to a target occupancy and then every step either allocates a new block or frees a
+   random live one, so free blocks end up scattered the same way a fragmented order book leaves them.
+   Usage: mem_pool_benchmark [churn_ops] [pool_size] */
+
+using namespace Common;
+
+// same size as MEOrder
+struct BenchOrder{
+    uint64_t ids_[4];
+    int64_t price_;
+    uint32_t qty_;
+    uint64_t priority_;
+    BenchOrder* prev_;
+    BenchOrder* next_;
+
+    BenchOrder() = default;
+    BenchOrder(uint64_t id, int64_t price, uint32_t qty) noexcept: ids_{id, id, id, id}, price_(price), qty_(qty), priority_(id), prev_(nullptr), next_(nullptr){
+    }
+};
+
+template<typename Pool>
+auto RunChurn(const std::string& name, size_t pool_size, double occupancy, size_t churn_ops){
+    Pool pool(pool_size);
+    std::mt19937_64 rng(42);
+    std::vector<BenchOrder*> live;
+    live.reserve(pool_size);
+
+    const auto target = static_cast<size_t>(pool_size * occupancy);
+    for(size_t i = 0; i < target; ++i){
+        live.push_back(pool.Allocate(i, 100, 10));
+    }
+
+    // pre-generate the operations so the random number generator stays out of the timed section,
+    // allocations are only chosen while below target so the pool hovers around the requested occupancy
+    std::vector<size_t> victims(churn_ops);
+    for(auto& victim : victims){
+        victim = rng();
+    }
+
+    std::vector<Nanos> allocate_samples, deallocate_samples;
+    allocate_samples.reserve(churn_ops);
+    deallocate_samples.reserve(churn_ops);
+
+    const auto start = GetCurrentNanos();
+    for(size_t i = 0; i < churn_ops; ++i){
+        if(live.size() < target || live.size() == pool_size - 1){
+            if(live.size() < pool_size - 1){
+                const auto op_start = GetCurrentNanos();
+                live.push_back(pool.Allocate(i, 100, 10));
+                allocate_samples.push_back(GetCurrentNanos() - op_start);
+                continue;
+            }
+        }
+        const auto victim = victims[i] % live.size();
+        const auto op_start = GetCurrentNanos();
+        pool.Deallocate(live[victim]);
+        deallocate_samples.push_back(GetCurrentNanos() - op_start);
+        live[victim] = live.back();
+        live.pop_back();
+    }
+    const auto elapsed = GetCurrentNanos() - start;
+
+    const auto label = name + " occupancy:" + std::to_string(static_cast<int>(occupancy * 100)) + "%";
+    PrintLatencyStats(label + " Allocate ns", allocate_samples);
+    PrintLatencyStats(label + " Deallocate ns", deallocate_samples);
+    PrintThroughput(label + " churn", churn_ops, elapsed);
+
+    for(auto order : live){
+        pool.Deallocate(order);
+    }
+}
+
+int main(int argc, char** argv){
+    const size_t churn_ops = argc > 1 ? std::atol(argv[1]) : 2000000;
+    const size_t pool_size = argc > 2 ? std::atol(argv[2]) : 1024 * 1024;
+
+    for(const auto occupancy : {0.5, 0.9, 0.99}){
+        RunChurn<MemPool<BenchOrder>>("MemPool", pool_size, occupancy, churn_ops);
+        RunChurn<FreeListMemPool<BenchOrder>>("FreeListMemPool", pool_size, occupancy, churn_ops);
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "macros.h"
+
+namespace Common{
+
+/*
+Hardware event counts of the calling thread between Start() and Stop(), read through perf_event_open(2).
+The events are opened as one group, so the kernel schedules them onto the PMU together and every count
+covers the same instructions. Only user space is counted, which perf_event_paranoid 2 (the usual default)
+still allows. Counts accumulate over every Start()/Stop() pair until Reset(), so a benchmark can count
+just its timed sections and divide by the number of operations.
+Where the kernel exposes no PMU (most VMs and containers) or refuses the events, Available() is false,
+Start() and Stop() do nothing and every count stays 0.
+*/
+
+enum class PerfEvent : uint8_t{
+    CYCLES = 0,
+    INSTRUCTIONS = 1,
+    BRANCHES = 2,
+    BRANCH_MISSES = 3
+};
+
+constexpr size_t PERF_NUM_EVENTS = 4;
+
+inline auto PerfEventToString(PerfEvent event) -> std::string{
+    switch(event){
+        case PerfEvent::CYCLES:
+            return "cycles";
+        case PerfEvent::INSTRUCTIONS:
+            return "instructions";
+        case PerfEvent::BRANCHES:
+            return "branches";
+        case PerfEvent::BRANCH_MISSES:
+            return "branch_misses";
+    }
+    return "unknown";
+}
+
+class PerfCounters final{
+private:
+    // fds_[0] leads the group
+    std::array<int, PERF_NUM_EVENTS> fds_;
+    std::array<uint64_t, PERF_NUM_EVENTS> totals_ = {};
+    bool available_ = false;
+
+    // PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING layout of a group read
+    struct GroupReading{
+        uint64_t num_events_;
+        uint64_t time_enabled_;
+        uint64_t time_running_;
+        uint64_t values_[PERF_NUM_EVENTS];
+    };
+
+    static auto Config(PerfEvent event) noexcept -> uint64_t{
+        switch(event){
+            case PerfEvent::CYCLES:
+                return PERF_COUNT_HW_CPU_CYCLES;
+            case PerfEvent::INSTRUCTIONS:
+                return PERF_COUNT_HW_INSTRUCTIONS;
+            case PerfEvent::BRANCHES:
+                return PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+            case PerfEvent::BRANCH_MISSES:
+                return PERF_COUNT_HW_BRANCH_MISSES;
+        }
+        return PERF_COUNT_HW_CPU_CYCLES;
+    }
+
+    static auto Open(PerfEvent event, int group_fd) noexcept -> int{
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = Config(event);
+        // the group starts stopped, Start() enables it
+        attr.disabled = (group_fd == -1);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+
+    auto Close() noexcept{
+        for(auto& fd : fds_){
+            if(fd >= 0){
+                close(fd);
+            }
+            fd = -1;
+        }
+        available_ = false;
+    }
+
+public:
+    PerfCounters(){
+        fds_.fill(-1);
+        for(size_t i = 0; i < PERF_NUM_EVENTS; ++i){
+            fds_[i] = Open(static_cast<PerfEvent>(i), fds_[0]);
+            if(fds_[i] < 0){
+                // said once per process, every benchmark result would repeat it otherwise
+                static bool reported = false;
+                if(!reported){
+                    std::cerr << "Perf counters unavailable, " << PerfEventToString(static_cast<PerfEvent>(i))
+                              << " error: " << std::strerror(errno) << std::endl;
+                    reported = true;
+                }
+                Close();
+                return;
+            }
+        }
+        available_ = true;
+    }
+
+    ~PerfCounters(){
+        Close();
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters(const PerfCounters&&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&&) = delete;
+
+    auto Available() const noexcept{
+        return available_;
+    }
+
+    auto Start() noexcept{
+        if(LIKELY(available_)){
+            ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    // adds the counts since Start() to the totals, scaled up if the group shared the PMU with other groups
+    auto Stop() noexcept{
+        if(UNLIKELY(!available_)){
+            return;
+        }
+        ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        GroupReading reading;
+        if(UNLIKELY(read(fds_[0], &reading, sizeof(reading)) != static_cast<ssize_t>(sizeof(reading)) || !reading.time_running_)){
+            return;
+        }
+        const auto scale = static_cast<double>(reading.time_enabled_) / reading.time_running_;
+        for(size_t i = 0; i < PERF_NUM_EVENTS; ++i){
+            totals_[i] += static_cast<uint64_t>(reading.values_[i] * scale);
+        }
+    }
+
+    auto Get(PerfEvent event) const noexcept{
+        return totals_[static_cast<size_t>(event)];
+    }
+
+    auto Reset() noexcept{
+        totals_.fill(0);
+    }
+};
+
+}
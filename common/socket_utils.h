@@ -75,10 +75,9 @@ namespace Common{
     }
 
     auto CreateSocket(Logger &logger, const std::string& t_ip, const std::string& iface, int port, bool is_udp, bool is_blocking, bool is_listening, int ttl, bool needs_so_timestamp) -> int{
-        std::string time_str;
         const auto ip = t_ip.empty() ? GetIfaceIP(iface) : t_ip;
-        logger.Log("%:% %() % ip:% iface:% port:% is_udp:% is_blocking:% is_listening:% ttl:% SO_time:%\n", __FILE__, __LINE__, __FUNCTION__,
-        Common::GetCurrentTimeStr(&time_str), ip, iface, port, is_udp, is_blocking, is_listening, ttl, needs_so_timestamp);
+        logger.Log<"%:% %() % ip:% iface:% port:% is_udp:% is_blocking:% is_listening:% ttl:% SO_time:%\n">(__FILE__, __LINE__, __FUNCTION__,
+        Common::LogTime{}, ip, iface, port, is_udp, is_blocking, is_listening, ttl, needs_so_timestamp);
 
         addrinfo hints{};
         hints.ai_family = AF_INET;
@@ -93,7 +92,7 @@ namespace Common{
         addrinfo *result = nullptr;
         const auto rc = getaddrinfo(ip.c_str(), std::to_string(port).c_str(), &hints, &result);
         if(rc){
-            logger.Log("getaddrinfo() failed. error:% errno:%\n", gai_strerror(rc), strerror(errno));
+            logger.Log<"getaddrinfo() failed. error:% errno:%\n">(gai_strerror(rc), strerror(errno));
             return -1;
         }
 
@@ -103,41 +102,41 @@ namespace Common{
         for(addrinfo* rp = result; rp; rp = rp->ai_next){
             fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
             if(fd == -1){
-                logger.Log("socket() failed. errno:%\n", strerror(errno));
+                logger.Log<"socket() failed. errno:%\n">(strerror(errno));
                 return -1;
             }
             
             // set socket to be non-blocking and disable Nagle's algorithm
             if(!is_blocking){
                 if(!SetNonBlocking(fd)){
-                    logger.Log("SetNonBlocking() failed. errno:%\n", strerror(errno));
+                    logger.Log<"SetNonBlocking() failed. errno:%\n">(strerror(errno));
                     return -1;
                 }
                 if(!is_udp && !SetNoDelay(fd)){
-                    logger.Log("SetNoDelay() failed. errno:%\n", strerror(errno));
+                    logger.Log<"SetNoDelay() failed. errno:%\n">(strerror(errno));
                     return -1;
                 }
             }
 
             // connect socket to the target address if it is not a listening socket
             if(!is_listening && connect(fd, rp->ai_addr, rp->ai_addrlen) == 1 && !WouldBlock()){
-                logger.Log("Connect() failed. errno:%\n", strerror(errno));
+                logger.Log<"Connect() failed. errno:%\n">(strerror(errno));
                 return -1;
             }
             
             // make the socket a listening socket if is_listening = true
             if(is_listening && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one)) == -1){
-                logger.Log("setsockopt() SO_REUSEADDR failed. errno:%\n", strerror(errno));
+                logger.Log<"setsockopt() SO_REUSEADDR failed. errno:%\n">(strerror(errno));
                 return -1;
             }
             
             if(is_listening && bind(fd, rp->ai_addr, rp->ai_addrlen) == -1){
-                logger.Log("bind() failed. errno:%\n", strerror(errno));
+                logger.Log<"bind() failed. errno:%\n">(strerror(errno));
                 return -1;
             }
 
             if(!is_udp && is_listening && listen(fd, MAXTCPServerBacklog) < 0){
-                logger.Log("listen() failed. errno:%\n", strerror(errno));
+                logger.Log<"listen() failed. errno:%\n">(strerror(errno));
                 return -1;
             }
 
@@ -145,19 +144,19 @@ namespace Common{
             if(is_udp && ttl){
                 const bool is_multicast = atoi(ip.c_str()) & 0xe0;
                 if(is_multicast && !SetMcastTTL(fd, ttl)){
-                    logger.Log("SetMcast() failed. errno:%\n", strerror(errno));
+                    logger.Log<"SetMcast() failed. errno:%\n">(strerror(errno));
                     return -1;
                 }
 
                 if(!is_multicast && !SetTTL(fd, ttl)){
-                    logger.Log("SetTTL() failed. errno:%\n", strerror(errno));
+                    logger.Log<"SetTTL() failed. errno:%\n">(strerror(errno));
                     return -1;
                 }
             }
 
             // give access for timestamps of incoming packets
             if(needs_so_timestamp && !SetSOTimestamp(fd)){
-                logger.Log("SetSOTimestamp() failed. errno:%\n", strerror(errno));
+                logger.Log<"SetSOTimestamp() failed. errno:%\n">(strerror(errno));
                 return -1;
             }
         }
@@ -0,0 +1,190 @@
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "macros.h"
+#include "types.h"
+#include "time_utils.h"
+
+namespace Common{
+
+/*
+Counters and gauges published into a POSIX shared memory segment so a separate process (tools/stats_reader)
+can watch the exchange without going through its threads, sockets or log files. Every stat has exactly one
+writing thread and sits alone on a cache line, so an update is a relaxed load and store into memory
+nothing else writes. Stats are registered by name when their owner is constructed, registering a name that
+already exists hands back the same slot.
+Only a process that calls Publish() before registering its first stat shares them, the exchange under
+STATS_SEGMENT_NAME, everything else (benchmarks, tools) keeps its stats in private memory unless it opts in
+under a name of its own, so it can never disturb the exchange's segment. Publish() unlinks a segment left
+behind under the name and creates a new one, a reader still mapping the old one keeps reading it instead of
+faulting. The header records the capacity, the segment is sized for the stats the process expects. The
+writing process never unmaps the segment, threads may still update stats while static objects are being
+destroyed, and leaves it behind at exit so the last values can still be read.
+*/
+
+constexpr auto STATS_SEGMENT_NAME = "/low_latency_exchange_stats";
+// slots for the stats whose number doesn't grow with the ticker universe
+constexpr size_t STATS_BASE_SLOTS = 4096;
+constexpr size_t STATS_NAME_SIZE = 48;
+constexpr uint64_t STATS_SEGMENT_MAGIC = 0x5354415453454731; // "STATSEG1"
+
+enum class StatKind: uint8_t{
+    // only goes up, the reader prints it as a rate
+    COUNTER = 0,
+    // current level, such as a queue depth
+    GAUGE = 1
+};
+
+inline auto StatKindToString(StatKind kind) -> std::string{
+    switch(kind){
+        case StatKind::COUNTER:
+            return "COUNTER";
+        case StatKind::GAUGE:
+            return "GAUGE";
+    }
+    return "UNKNOWN";
+}
+
+struct alignas(CACHE_LINE_SIZE) StatSlot{
+    std::atomic<uint64_t> value_ = {0};
+    StatKind kind_ = StatKind::COUNTER;
+    char name_[STATS_NAME_SIZE] = {};
+};
+static_assert(sizeof(StatSlot) == CACHE_LINE_SIZE);
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "stats are shared with other processes");
+
+struct alignas(CACHE_LINE_SIZE) StatsSegmentHeader{
+    uint64_t magic_ = STATS_SEGMENT_MAGIC;
+    // slots following the header
+    uint64_t capacity_ = 0;
+    int64_t pid_ = 0;
+    Nanos start_time_ = 0;
+    // slots below this are named and in use, published with a release store after the slot is filled in
+    std::atomic<uint64_t> num_slots_ = {0};
+};
+
+inline constexpr auto StatsSegmentSize(size_t capacity) noexcept{
+    return sizeof(StatsSegmentHeader) + capacity * sizeof(StatSlot);
+}
+
+class StatsSegment final{
+private:
+    StatsSegmentHeader* header_ = nullptr;
+    StatSlot* slots_ = nullptr;
+    // held while registering, never while updating
+    std::mutex mutex_;
+    // slots handed out before Publish(), without it or once the segment is full, they work but nobody can see them
+    std::vector<std::unique_ptr<StatSlot>> private_slots_;
+    // every slot handed out by its name, so registering stays cheap with thousands of stats
+    std::unordered_map<std::string, StatSlot*> slots_by_name_;
+
+public:
+    StatsSegment() = default;
+    StatsSegment(const StatsSegment&) = delete;
+    StatsSegment(const StatsSegment&&) = delete;
+    StatsSegment& operator=(const StatsSegment&) = delete;
+    StatsSegment& operator=(const StatsSegment&&) = delete;
+
+    // the segment every stat of this process goes into, private until Publish()
+    static auto Instance() noexcept -> StatsSegment*{
+        static StatsSegment segment;
+        return &segment;
+    }
+
+    // creates the shared segment name with room for capacity stats, every stat registered from then on is
+    // visible to readers. Called once, by the process that owns name, before it registers any stat
+    auto Publish(const std::string& name, size_t capacity) -> bool{
+        std::lock_guard<std::mutex> lock(mutex_);
+        ASSERT(!header_ && slots_by_name_.empty(), "Stats segment " + name + " published after stats were registered");
+        // a reader of the previous run's segment keeps its mapping, it never sees this one shrink under it
+        shm_unlink(name.c_str());
+        const auto size = StatsSegmentSize(capacity);
+        const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if(fd < 0 || ftruncate(fd, size) != 0){
+            std::cerr << "Could not create stats segment " << name << " error: " << std::strerror(errno) << std::endl;
+            if(fd >= 0){
+                close(fd);
+            }
+            return false;
+        }
+        auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(memory == MAP_FAILED){
+            std::cerr << "Could not map stats segment " << name << " error: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        header_ = new(memory) StatsSegmentHeader();
+        header_->capacity_ = capacity;
+        header_->pid_ = getpid();
+        header_->start_time_ = GetCurrentNanos();
+        slots_ = reinterpret_cast<StatSlot*>(header_ + 1);
+        return true;
+    }
+
+    // the slot for name, a new one or the one already registered under that name
+    auto AddStat(const std::string& name, StatKind kind) -> StatSlot*{
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto num_slots = (header_ ? header_->num_slots_.load(std::memory_order_relaxed) : 0);
+        const auto short_name = name.substr(0, STATS_NAME_SIZE - 1);
+        const auto existing = slots_by_name_.find(short_name);
+        if(existing != slots_by_name_.end()){
+            return existing->second;
+        }
+        if(!header_ || num_slots == header_->capacity_){
+            private_slots_.push_back(std::make_unique<StatSlot>());
+            return (slots_by_name_[short_name] = private_slots_.back().get());
+        }
+        auto slot = new(&slots_[num_slots]) StatSlot();
+        slot->kind_ = kind;
+        std::strncpy(slot->name_, short_name.c_str(), STATS_NAME_SIZE - 1);
+        header_->num_slots_.store(num_slots + 1, std::memory_order_release);
+        return (slots_by_name_[short_name] = slot);
+    }
+};
+
+// a handle on one stat, only one thread may update it
+class StatsCounter final{
+private:
+    StatSlot* slot_ = nullptr;
+
+    // stands in for stats nobody registered, such as those of a socket that is not part of a server
+    static auto Unregistered() noexcept -> StatSlot*{
+        static StatSlot slot;
+        return &slot;
+    }
+
+public:
+    StatsCounter(): slot_(Unregistered()){
+
+    }
+
+    explicit StatsCounter(const std::string& name, StatKind kind = StatKind::COUNTER): slot_(StatsSegment::Instance()->AddStat(name, kind)){
+
+    }
+
+    auto Add(uint64_t value) noexcept{
+        slot_->value_.store(slot_->value_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    auto Increment() noexcept{
+        Add(1);
+    }
+
+    auto Set(uint64_t value) noexcept{
+        slot_->value_.store(value, std::memory_order_relaxed);
+    }
+
+    auto Get() const noexcept{
+        return slot_->value_.load(std::memory_order_relaxed);
+    }
+};
+
+}
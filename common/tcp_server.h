@@ -10,18 +10,23 @@ public:
     std::vector<TCPSocket*> sockets_, receive_sockets_, send_sockets_, disconnected_sockets_;
     std::function<void(TCPSocket *s, Nanos rx_time)> recv_callback_;
     std::function<void()> recv_finished_callback_;
-    std::string time_str_;
+    // called once for every socket that disconnected, just before it is deleted
+    std::function<void(TCPSocket* s)> disconnect_callback_;
     Logger &logger_;
+    // published as tcp.<port>.<stat> once Listen() knows the port, written by the thread polling the server
+    StatsCounter num_sockets_;
+    StatsCounter rx_bytes_;
+    StatsCounter tx_bytes_;
 
     auto DefaultRecvCallback(TCPSocket* socket, Nanos rx_time) noexcept{
-        logger_.Log("%:% %() % TCPServer::DefaultRecvCallback() socket:% len:% rx:%\n",
-        __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
+        logger_.Log<"%:% %() % TCPServer::DefaultRecvCallback() socket:% len:% rx:%\n">(
+        __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
         socket->fd_, socket->next_rcv_valid_index_, rx_time);
     }
 
     auto DefaultRecvFinishedCallback() noexcept{
-        logger_.Log("%:% %() % TCPServer::DefaultRecvFinishedCallback()\n", __FILE__,
-        __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_));
+        logger_.Log<"%:% %() % TCPServer::DefaultRecvFinishedCallback()\n">(__FILE__,
+        __LINE__, __FUNCTION__, Common::LogTime{});
     }
 
     explicit TCPServer(Logger& logger): listener_socket_(logger), logger_(logger){
@@ -59,6 +64,11 @@ public:
         + std::string(std::strerror(errno)));
 
         ASSERT(epoll_add(&listener_socket_), "epoll_ctl() failed. error: " + std::string(std::strerror(errno)));
+
+        const auto stats_prefix = "tcp." + std::to_string(port);
+        num_sockets_ = StatsCounter(stats_prefix + ".sockets", StatKind::GAUGE);
+        rx_bytes_ = StatsCounter(stats_prefix + ".rx_bytes");
+        tx_bytes_ = StatsCounter(stats_prefix + ".tx_bytes");
     }
 
     auto Del(TCPSocket* socket){
@@ -66,14 +76,22 @@ public:
         sockets_.erase(std::remove(sockets_.begin(), sockets_.end(), socket), sockets_.end());
         receive_sockets_.erase(std::remove(receive_sockets_.begin(), receive_sockets_.end(), socket), receive_sockets_.end());
         send_sockets_.erase(std::remove(send_sockets_.begin(), send_sockets_.end(), socket), send_sockets_.end());
+        num_sockets_.Set(sockets_.size());
     }
 
     auto Poll() noexcept -> void{
         const int max_events = 1 + sockets_.size();
 
         for(auto socket: disconnected_sockets_){
+            logger_.Log<"%:% %() % disconnected socket:%\n">(
+            __FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, socket->fd_);
             Del(socket);
+            if(disconnect_callback_){
+                disconnect_callback_(socket);
+            }
+            delete socket;
         }
+        disconnected_sockets_.clear();
 
         const int n = epoll_wait(efd_, events_, max_events, 0);
 
@@ -84,75 +102,85 @@ public:
 
             if(event.events & EPOLLIN){
                 if(socket == &listener_socket_){
-                    logger_.Log("%:% %() % EPOLLIN listener_socket:%\n", 
-                    __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
+                    logger_.Log<"%:% %() % EPOLLIN listener_socket:%\n">(
+                    __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
                     socket->fd_);
                     have_new_connection = true;
                     continue;
                 }
-                logger_.Log("%:% %() % EPOLLIN socket:%\n",
-                __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_), socket->fd_);
+                logger_.Log<"%:% %() % EPOLLIN socket:%\n">(
+                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, socket->fd_);
                 if(std::find(receive_sockets_.begin(), receive_sockets_.end(), socket) == receive_sockets_.end()){
                     receive_sockets_.push_back(socket);
                 }
             }
 
             if(event.events & EPOLLOUT){
-                logger_.Log("%:% %() % EPOLLOUT socket:%\n", 
-                __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_), socket->fd_);
+                logger_.Log<"%:% %() % EPOLLOUT socket:%\n">(
+                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, socket->fd_);
                 if(std::find(send_sockets_.begin(), send_sockets_.end(), socket) == send_sockets_.end()){
                     send_sockets_.push_back(socket);
                 }
             }
 
             if(event.events & (EPOLLERR | EPOLLHUP)){
-                logger_.Log("%:% %() % EPOLLERR socket:%\n", 
-                __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_), socket->fd_);
+                logger_.Log<"%:% %() % EPOLLERR socket:%\n">(
+                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, socket->fd_);
                 if(std::find(disconnected_sockets_.begin(), disconnected_sockets_.end(), socket) == disconnected_sockets_.end()){
                     disconnected_sockets_.push_back(socket);
                 }
             }
+        }
 
-            while(have_new_connection){
-                logger_.Log("%:% %() % have_new_connection\n",
-                __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_));
-                sockaddr_storage addr;
-                socklen_t addr_len = sizeof(addr);
-                int fd = accept(listener_socket_.fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
-                if(fd == -1){
-                    break;
-                }
+        // accepted after the events are handled, the listener's event skips the rest of the loop body
+        while(have_new_connection){
+            logger_.Log<"%:% %() % have_new_connection\n">(
+            __FILE__, __LINE__, __FUNCTION__, Common::LogTime{});
+            sockaddr_storage addr;
+            socklen_t addr_len = sizeof(addr);
+            int fd = accept(listener_socket_.fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+            if(fd == -1){
+                break;
+            }
 
-                ASSERT(SetNonBlocking(fd) && SetNoDelay(fd), 
-                "Failed to set non-blocking or no-delay on socket:"
-                + std::to_string(fd));
+            ASSERT(SetNonBlocking(fd) && SetNoDelay(fd), 
+            "Failed to set non-blocking or no-delay on socket:"
+            + std::to_string(fd));
 
-                logger_.Log("%:% %() % accepted socket:%\n", 
-                __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_), fd);
+            logger_.Log<"%:% %() % accepted socket:%\n">(
+            __FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, fd);
 
-                TCPSocket* socket = new TCPSocket(logger_);
-                socket->fd_ = fd;
-                socket->recv_callback_ = recv_callback_;
-                ASSERT(epoll_add(socket), "Unable to add socket. error: " + std::string(std::strerror(errno)));
+            TCPSocket* socket = new TCPSocket(logger_);
+            socket->fd_ = fd;
+            socket->recv_callback_ = recv_callback_;
+            socket->rx_bytes_ = rx_bytes_;
+            socket->tx_bytes_ = tx_bytes_;
+            ASSERT(epoll_add(socket), "Unable to add socket. error: " + std::string(std::strerror(errno)));
 
-                if(std::find(sockets_.begin(), sockets_.end(), socket) == sockets_.end()){
-                    sockets_.push_back(socket);
-                }
+            if(std::find(sockets_.begin(), sockets_.end(), socket) == sockets_.end()){
+                sockets_.push_back(socket);
+            }
+            num_sockets_.Set(sockets_.size());
 
-                if(std::find(receive_sockets_.begin(), receive_sockets_.end(), socket) == receive_sockets_.end()){
-                    receive_sockets_.push_back(socket);
-                }
+            if(std::find(receive_sockets_.begin(), receive_sockets_.end(), socket) == receive_sockets_.end()){
+                receive_sockets_.push_back(socket);
             }
-        }   
+        }
     }
 
-    auto SendAndRecv() noexcept -> void{
+    // true when any socket received data
+    auto SendAndRecv() noexcept -> bool{
         auto recv = false;
 
         for(auto socket: receive_sockets_){
             if(socket->SendAndRecv()){
                 recv = true;
             }
+            // removed by the next Poll(), after the data read with the disconnect has been handled
+            if(UNLIKELY(socket->recv_disconnected_ || socket->send_disconnected_)
+               && std::find(disconnected_sockets_.begin(), disconnected_sockets_.end(), socket) == disconnected_sockets_.end()){
+                disconnected_sockets_.push_back(socket);
+            }
         }
 
         if(recv){
@@ -162,6 +190,7 @@ public:
         for(auto socket: send_sockets_){
             socket->SendAndRecv();
         }
+        return recv;
     }
 
     TCPServer() = delete;
@@ -2,6 +2,8 @@
 #include <functional>
 #include "socket_utils.h"
 #include "logging.h"
+#include "latency_histogram.h"
+#include "stats_segment.h"
 
 namespace Common{
     constexpr size_t TCPBufferSize = 64*1024*1024;
@@ -20,13 +22,16 @@ namespace Common{
 
         std::function<void(TCPSocket* s, Nanos rx_time)> recv_callback_;
 
-        std::string time_str_;
+        // TCPServer points these at its stats, they count nowhere visible otherwise
+        StatsCounter rx_bytes_;
+        StatsCounter tx_bytes_;
+
         Logger& logger_;
 
         // log information confirming that the callback was invoked
         auto DefaultRecvCallback(TCPSocket* socket, Nanos rx_time) noexcept{
-            logger_.Log("%:% %() %TCPSocket::DefaultRecvCallback() socket:% len:% rx:%\n",
-            __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
+            logger_.Log<"%:% %() %TCPSocket::DefaultRecvCallback() socket:% len:% rx:%\n">(
+            __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
             socket->fd_, socket->next_rcv_valid_index_, rx_time);
         }
 
@@ -95,6 +100,7 @@ namespace Common{
             const auto n_rcv = recvmsg(fd_, &msg, MSG_DONTWAIT);
             if(n_rcv > 0){
                 next_rcv_valid_index_ += n_rcv;
+                rx_bytes_.Add(n_rcv);
 
                 Nanos kernel_time = 0;
                 struct timeval time_kernel;
@@ -106,13 +112,23 @@ namespace Common{
                     kernel_time = time_kernel.tv_sec * NANOS_TO_SECS + time_kernel.tv_usec * NANOS_TO_MICROS;
                 }
 
-                const auto user_time = GetCurrentNanos();
+                const auto user_time = GetTscNanos();
 
-                logger_.Log("%:% %() % read socket:% len:% utime:% ktime:% diff:%\n", 
-                __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
+                logger_.Log<"%:% %() % read socket:% len:% utime:% ktime:% diff:%\n">(
+                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
                 fd_, next_rcv_valid_index_, user_time, kernel_time, (user_time - kernel_time));
 
+                // without a kernel timestamp the latency probes measure from the read
+                if(LIKELY(kernel_time)){
+                    LatencyProbe(LatencyStage::SOCKET_READ, LATENCY_TAG_UNDECODED, kernel_time, user_time);
+                }else{
+                    kernel_time = user_time;
+                }
+
                 recv_callback_(this, kernel_time);
+            }else if(n_rcv == 0 || !WouldBlock()){
+                // 0 is the peer's orderly shutdown
+                recv_disconnected_ = true;
             }
 
             ssize_t n_send = std::min(TCPBufferSize, next_send_valid_index_);
@@ -129,9 +145,10 @@ namespace Common{
                     break;
                 }
 
-                logger_.Log("%:% %() % send socket:% len:%\n",
+                logger_.Log<"%:% %() % send socket:% len:%\n">(
                 __FILE__, __LINE__, __FUNCTION__,
-                Common::GetCurrentTimeStr(&time_str_), fd_, n);
+                Common::LogTime{}, fd_, n);
+                tx_bytes_.Add(n);
 
                 n_send -= n;
                 ASSERT(n==n_send_this_msg, "Don't support partial send lengths yet.");
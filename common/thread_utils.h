@@ -1,12 +1,132 @@
 #pragma once
 #include <iostream>
 #include <atomic>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "idle_strategy.h"
 
 namespace Common{
 
+/*
+Where a named thread runs: the core it is pinned to, an optional SCHED_FIFO priority and an optional NUMA
+node its memory is allocated from. CreateAndStartThread() applies the placement configured for the
+thread's name and reads every setting back before the thread's function runs, a thread whose placement
+could not be applied is not started. The idle strategy is not applied here, the component that owns the
+thread's polling loop reads it from the config.
+*/
+struct ThreadPlacement{
+    // -1 lets the thread float
+    int core_id_ = -1;
+    // 1-99 runs the thread under SCHED_FIFO, 0 keeps the default scheduler
+    int sched_fifo_priority_ = 0;
+    // -1 keeps the default memory policy, otherwise the thread only allocates from this node
+    int numa_node_ = -1;
+    // what the thread's polling loop does when it finds no work
+    IdleStrategyType idle_strategy_ = IdleStrategyType::BUSY_SPIN;
+
+    auto ToString() const{
+        return "core:" + std::to_string(core_id_) + " sched_fifo:" + std::to_string(sched_fifo_priority_) + " numa:" + std::to_string(numa_node_);
+    }
+};
+
+// thread name to placement, loaded once at startup before the threads it names are created
+class ThreadPlacementConfig final{
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, ThreadPlacement> placements_;
+
+public:
+    ThreadPlacementConfig() = default;
+    ThreadPlacementConfig(const ThreadPlacementConfig&) = delete;
+    ThreadPlacementConfig(const ThreadPlacementConfig&&) = delete;
+    ThreadPlacementConfig& operator=(const ThreadPlacementConfig&) = delete;
+    ThreadPlacementConfig& operator=(const ThreadPlacementConfig&&) = delete;
+
+    static auto Instance() noexcept -> ThreadPlacementConfig*{
+        static ThreadPlacementConfig config;
+        return &config;
+    }
+
+    auto Set(const std::string& name, const ThreadPlacement& placement){
+        std::lock_guard<std::mutex> lock(mutex_);
+        placements_[name] = placement;
+    }
+
+    // the placement configured for name, or the caller's default when there is none
+    auto Get(const std::string& name, const ThreadPlacement& default_placement) -> ThreadPlacement{
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = placements_.find(name);
+        return (it == placements_.end() ? default_placement : it->second);
+    }
+
+    // one thread per line: <name> <core> [sched_fifo_priority] [numa_node] [idle_strategy], # starts a comment.
+    // Every field present has to parse completely and nothing may follow the idle strategy
+    auto Load(const std::string& file_name) -> bool{
+        std::ifstream file(file_name);
+        if(!file){
+            std::cerr << "Could not open thread placement config " << file_name << std::endl;
+            return false;
+        }
+        // the whole token is a number, "3x" or "PARK" is not
+        const auto parse_int = [](const std::string& token, int* value){
+            const auto end = token.data() + token.size();
+            const auto [ptr, error] = std::from_chars(token.data(), end, *value);
+            return (error == std::errc() && ptr == end);
+        };
+        std::string line;
+        for(size_t line_number = 1; std::getline(file, line); ++line_number){
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string name;
+            if(!(fields >> name)){
+                continue;
+            }
+            std::vector<std::string> tokens;
+            for(std::string token; fields >> token;){
+                tokens.push_back(token);
+            }
+            const auto where = file_name + ":" + std::to_string(line_number) + " ";
+            ThreadPlacement placement;
+            if(tokens.empty() || !parse_int(tokens[0], &placement.core_id_)){
+                std::cerr << where << "expected a core for " << name << std::endl;
+                return false;
+            }
+            if(tokens.size() > 4){
+                std::cerr << where << "unexpected " << tokens[4] << " after the idle strategy of " << name << std::endl;
+                return false;
+            }
+            if(tokens.size() > 1 && (!parse_int(tokens[1], &placement.sched_fifo_priority_)
+                                     || placement.sched_fifo_priority_ < 0 || placement.sched_fifo_priority_ > 99)){
+                std::cerr << where << "SCHED_FIFO priority must be 0-99 for " << name << ", got " << tokens[1] << std::endl;
+                return false;
+            }
+            if(tokens.size() > 2 && !parse_int(tokens[2], &placement.numa_node_)){
+                std::cerr << where << "expected a NUMA node for " << name << ", got " << tokens[2] << std::endl;
+                return false;
+            }
+            if(tokens.size() > 3 && !IdleStrategyTypeFromString(tokens[3], &placement.idle_strategy_)){
+                std::cerr << where << "unknown idle strategy " << tokens[3] << " for " << name << std::endl;
+                return false;
+            }
+            Set(name, placement);
+        }
+        return true;
+    }
+};
+
 inline auto SetThreadCore(int core_id) noexcept{
     cpu_set_t cpuset;
     CPU_ZERO(&cpuset);
@@ -14,31 +134,69 @@ inline auto SetThreadCore(int core_id) noexcept{
     return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0);
 }
 
-// Variadic template feature: allows you to create an object with a variable number of types and arguments
+// applies the placement to the calling thread and reads it back, returns what failed or an empty string
+inline auto ApplyThreadPlacement(const ThreadPlacement& placement) noexcept -> std::string{
+    if(placement.core_id_ >= 0){
+        cpu_set_t cpuset;
+        if(!SetThreadCore(placement.core_id_)
+           || pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0
+           || CPU_COUNT(&cpuset) != 1 || !CPU_ISSET(placement.core_id_, &cpuset)){
+            return "core affinity " + std::to_string(placement.core_id_) + " not applied";
+        }
+    }
+    if(placement.numa_node_ >= 0){
+        // raw syscalls so the build does not need libnuma
+        unsigned long node_mask = 1ul << placement.numa_node_;
+        int mode = -1;
+        unsigned long read_mask = 0;
+        if(placement.numa_node_ >= static_cast<int>(sizeof(node_mask) * 8)
+           || syscall(SYS_set_mempolicy, MPOL_BIND, &node_mask, sizeof(node_mask) * 8 + 1) != 0
+           || syscall(SYS_get_mempolicy, &mode, &read_mask, sizeof(read_mask) * 8 + 1, nullptr, 0) != 0
+           || mode != MPOL_BIND || read_mask != node_mask){
+            return "NUMA node " + std::to_string(placement.numa_node_) + ": " + std::strerror(errno);
+        }
+    }
+    if(placement.sched_fifo_priority_ > 0){
+        sched_param param{};
+        param.sched_priority = placement.sched_fifo_priority_;
+        int policy = -1;
+        if(const auto error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param); error != 0){
+            return "SCHED_FIFO priority " + std::to_string(placement.sched_fifo_priority_) + ": " + std::strerror(error);
+        }
+        if(pthread_getschedparam(pthread_self(), &policy, &param) != 0 || policy != SCHED_FIFO
+           || param.sched_priority != placement.sched_fifo_priority_){
+            return "SCHED_FIFO priority " + std::to_string(placement.sched_fifo_priority_) + " did not stick";
+        }
+    }
+    return {};
+}
+
+// Variadic template feature: allows you to create an object with a variable number of types and arguments.
+// core_id is the placement used when the config has nothing for name. The function and its arguments are
+// copied into the new thread, and the call returns as soon as the thread reports its placement.
 template<typename T, typename... A>
 inline auto CreateAndStartThread(int core_id, const std::string &name, T &&func, A &&... args) noexcept{
-    // initialize atomic boolean variables so no race conditions can occur between threads
-    std::atomic<bool> running(false), failed(false);
-    // lambda function to try to set thread core affinity (specify a cpu core that a thread runs on)
-    auto thread_body = [&]{
-        if(core_id >= 0 && !SetThreadCore(core_id)){
-            std::cerr << "Failed to set core affinity for " << name << " " << pthread_self() << " to " << core_id << std::endl;
-            failed = true;
+    const auto placement = ThreadPlacementConfig::Instance()->Get(name, ThreadPlacement{core_id});
+    // the new thread reports whether its placement was applied, the promise outlives this call
+    std::promise<bool> started;
+    auto placed = started.get_future();
+    auto thread_body = [name, placement, started = std::move(started)](auto&& thread_func, auto&&... thread_args) mutable{
+        // the kernel keeps 15 characters of a thread name, enough for ps and top to tell ours apart
+        pthread_setname_np(pthread_self(), name.substr(name.rfind('/') + 1).substr(0, 15).c_str());
+        if(const auto error = ApplyThreadPlacement(placement); !error.empty()){
+            std::cerr << "Failed to place " << name << " " << pthread_self() << " " << placement.ToString() << " " << error << std::endl;
+            started.set_value(false);
             return;
         }
-        std::cout << "Set core affinity for " << name << " " << pthread_self() << " to " << core_id << std::endl;
-        running = true;
+        std::cout << "Placed " << name << " " << pthread_self() << " " << placement.ToString() << std::endl;
+        started.set_value(true);
          // uses generic programming to indicate that a function "func" will be called
         // with an argument list "args"
-        std::forward<T>(func)((std::forward<A>(args))...);
+        std::forward<decltype(thread_func)>(thread_func)(std::forward<decltype(thread_args)>(thread_args)...);
     };
-    auto t = new std::thread(thread_body);
-    while(!running && !failed){
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(1s);
-    }
-    if(failed){
-        // have main thread wait for for child thread to complete execution 
+    auto t = new std::thread(std::move(thread_body), std::forward<T>(func), std::forward<A>(args)...);
+    if(!placed.get()){
+        // have main thread wait for for child thread to complete execution
         t->join();
         delete t;
         t = nullptr;
@@ -46,4 +204,4 @@ inline auto CreateAndStartThread(int core_id, const std::string &name, T &&func,
     return t;
 }
 
-}
\ No newline at end of file
+}
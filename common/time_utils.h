@@ -1,7 +1,16 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <cstdint>
 #include <string>
+#include <time.h>
+#include "macros.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 namespace Common{
     typedef int64_t Nanos;
@@ -15,11 +24,210 @@ namespace Common{
         return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     }
 
+    inline auto ClockNanos(clockid_t clock_id) noexcept -> Nanos{
+        timespec ts;
+        clock_gettime(clock_id, &ts);
+        return ts.tv_sec * NANOS_TO_SECS + ts.tv_nsec;
+    }
+
+    // whether ReadCycles() ticks at a constant rate whatever the core's frequency or sleep state:
+    // the invariant TSC on x86-64, the generic timer's virtual counter on ARM64
+    inline auto HasInvariantCycleCounter() noexcept{
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        return (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)));
+#elif defined(__aarch64__)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // raw cycle counter, falls back to CLOCK_MONOTONIC nanoseconds where there is no counter to read
+    inline auto ReadCycles() noexcept -> uint64_t{
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t cycles;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(cycles));
+        return cycles;
+#else
+        return ClockNanos(CLOCK_MONOTONIC);
+#endif
+    }
+
+    // the counter is calibrated over this long at startup, then again every TSC_RECALIBRATION_NANOS
+    constexpr Nanos TSC_CALIBRATION_NANOS = 10 * NANOS_TO_MILLIS;
+    constexpr Nanos TSC_RECALIBRATION_NANOS = 1 * NANOS_TO_SECS;
+    // nanoseconds per cycle are kept as a fixed point multiplier with this many fraction bits
+    constexpr int TSC_SHIFT = 32;
+
+    /*
+    Wall clock time from the cycle counter: a read is the counter plus a multiply and a shift instead of a
+    clock_gettime() call. The rate is measured against CLOCK_MONOTONIC from the first calibration to the
+    latest one, so the estimate keeps getting more precise, and every recalibration re-anchors the clock to
+    CLOCK_REALTIME so it follows NTP whichever way the counter drifted. Now() only reads: a background
+    thread (the LogBackend's) calls RecalibrateIfDue() and readers see either the old or the new
+    calibration through a sequence lock. A re-anchor can move the clock back by the drift it corrects, so
+    Now() never returns less than it last returned on the same thread. Without an invariant counter Now()
+    is GetCurrentNanos().
+    */
+    class TscClock final{
+    private:
+        struct Sample{
+            uint64_t cycles_ = 0;
+            Nanos monotonic_ = 0;
+            Nanos realtime_ = 0;
+        };
+
+        const bool invariant_ = HasInvariantCycleCounter();
+        Sample first_sample_;
+
+        // calibration in use, written under the sequence lock
+        std::atomic<uint32_t> sequence_ = {0};
+        std::atomic<uint64_t> base_cycles_ = {0};
+        std::atomic<Nanos> base_nanos_ = {0};
+        std::atomic<uint64_t> multiplier_ = {0};
+        // cycles after base_cycles_ at which RecalibrateIfDue() recalibrates
+        std::atomic<uint64_t> recalibration_cycles_ = {0};
+        std::atomic<bool> recalibrating_ = {false};
+
+        static auto Convert(uint64_t cycles, uint64_t base_cycles, Nanos base_nanos, uint64_t multiplier) noexcept -> Nanos{
+            // 128 bit products so a distant base never overflows, a reading taken just before the
+            // recalibration is older than the base
+            if(LIKELY(cycles >= base_cycles)){
+                return base_nanos + static_cast<Nanos>((static_cast<unsigned __int128>(cycles - base_cycles) * multiplier) >> TSC_SHIFT);
+            }
+            return base_nanos - static_cast<Nanos>((static_cast<unsigned __int128>(base_cycles - cycles) * multiplier) >> TSC_SHIFT);
+        }
+
+        // clock readings paired with the counter, keeps the pair read with the least time in between
+        static auto TakeSample() noexcept{
+            Sample best;
+            uint64_t best_gap = UINT64_MAX;
+            for(int i = 0; i < 8; ++i){
+                const auto before = ReadCycles();
+                const auto monotonic = ClockNanos(CLOCK_MONOTONIC);
+                const auto realtime = ClockNanos(CLOCK_REALTIME);
+                const auto after = ReadCycles();
+                if(after - before < best_gap){
+                    best_gap = after - before;
+                    best = Sample{before + (after - before) / 2, monotonic, realtime};
+                }
+            }
+            return best;
+        }
+
+        static auto Multiplier(const Sample& from, const Sample& to) noexcept -> uint64_t{
+            const auto cycles = to.cycles_ - from.cycles_;
+            const auto nanos = static_cast<uint64_t>(to.monotonic_ - from.monotonic_);
+            return (cycles ? static_cast<uint64_t>((static_cast<unsigned __int128>(nanos) << TSC_SHIFT) / cycles) : (1ull << TSC_SHIFT));
+        }
+
+        auto Publish(uint64_t base_cycles, Nanos base_nanos, uint64_t multiplier) noexcept{
+            const auto sequence = sequence_.load(std::memory_order_relaxed);
+            sequence_.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            base_cycles_.store(base_cycles, std::memory_order_relaxed);
+            base_nanos_.store(base_nanos, std::memory_order_relaxed);
+            multiplier_.store(multiplier, std::memory_order_relaxed);
+            recalibration_cycles_.store(static_cast<uint64_t>((static_cast<unsigned __int128>(TSC_RECALIBRATION_NANOS) << TSC_SHIFT) / multiplier),
+                                        std::memory_order_relaxed);
+            sequence_.store(sequence + 2, std::memory_order_release);
+        }
+
+    public:
+        TscClock() noexcept{
+            if(!invariant_){
+                return;
+            }
+            first_sample_ = TakeSample();
+            auto sample = TakeSample();
+            while(sample.monotonic_ - first_sample_.monotonic_ < TSC_CALIBRATION_NANOS){
+                sample = TakeSample();
+            }
+            Publish(sample.cycles_, sample.realtime_, Multiplier(first_sample_, sample));
+        }
+
+        TscClock(const TscClock&) = delete;
+        TscClock(const TscClock&&) = delete;
+        TscClock& operator=(const TscClock&) = delete;
+        TscClock& operator=(const TscClock&&) = delete;
+
+        // calibrated by the first call
+        static auto Instance() noexcept -> TscClock&{
+            static TscClock clock;
+            return clock;
+        }
+
+        auto IsInvariant() const noexcept{
+            return invariant_;
+        }
+
+        // counter ticks per second according to the current calibration
+        auto GetCyclesPerSecond() const noexcept{
+            const auto multiplier = multiplier_.load(std::memory_order_relaxed);
+            return (multiplier ? static_cast<double>(1ull << TSC_SHIFT) * NANOS_TO_SECS / multiplier : 0.0);
+        }
+
+        // wall clock nanoseconds at a counter reading taken by ReadCycles()
+        auto ToNanos(uint64_t cycles) const noexcept -> Nanos{
+            while(true){
+                const auto sequence = sequence_.load(std::memory_order_acquire);
+                const auto base_cycles = base_cycles_.load(std::memory_order_relaxed);
+                const auto base_nanos = base_nanos_.load(std::memory_order_relaxed);
+                const auto multiplier = multiplier_.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(LIKELY(!(sequence & 1) && sequence == sequence_.load(std::memory_order_relaxed))){
+                    return Convert(cycles, base_cycles, base_nanos, multiplier);
+                }
+            }
+        }
+
+        // re-measures the rate and re-anchors to CLOCK_REALTIME, one thread at a time does the work
+        auto Recalibrate() noexcept{
+            if(!invariant_ || recalibrating_.exchange(true, std::memory_order_acquire)){
+                return;
+            }
+            const auto sample = TakeSample();
+            Publish(sample.cycles_, sample.realtime_, Multiplier(first_sample_, sample));
+            recalibrating_.store(false, std::memory_order_release);
+        }
+
+        // recalibrates once the calibration is older than TSC_RECALIBRATION_NANOS, for a background thread
+        // to call on every pass of its loop, it costs a counter read otherwise
+        auto RecalibrateIfDue() noexcept{
+            if(!invariant_){
+                return;
+            }
+            const auto age = static_cast<int64_t>(ReadCycles() - base_cycles_.load(std::memory_order_relaxed));
+            if(UNLIKELY(age > static_cast<int64_t>(recalibration_cycles_.load(std::memory_order_relaxed)))){
+                Recalibrate();
+            }
+        }
+
+        auto Now() noexcept -> Nanos{
+            if(UNLIKELY(!invariant_)){
+                return GetCurrentNanos();
+            }
+            // this thread's last reading, a re-anchor that moved the clock back holds it there until it catches up
+            thread_local Nanos last_now = 0;
+            last_now = std::max(last_now, ToNanos(ReadCycles()));
+            return last_now;
+        }
+    };
+
+    // GetCurrentNanos() from the cycle counter, for timestamps on hot paths
+    inline auto GetTscNanos() noexcept{
+        return TscClock::Instance().Now();
+    }
+
     inline auto& GetCurrentTimeStr(std::string* time_str){
         const auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
         time_str->assign(ctime(&time));
+        // drop the newline ctime() ends with
         if(!time_str->empty()){
-            time_str->at(time_str->length()-1) = '\0';
+            time_str->pop_back();
         }
         return *time_str;
     }
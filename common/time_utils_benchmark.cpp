@@ -0,0 +1,57 @@
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include "time_utils.h"
+#include "benchmark_utils.h"
+
+/* Cost of one clock read and how far the cycle counter clock strays from the wall clock:
+   - per read: back to back reads of GetCurrentNanos() (std::chrono::system_clock), clock_gettime() on
+     CLOCK_MONOTONIC and CLOCK_REALTIME, the raw ReadCycles() and GetTscNanos()
+   - drift: GetTscNanos() - GetCurrentNanos() sampled every 10ms for the given number of seconds, which
+     spans several recalibrations
+   Usage: time_utils_benchmark [reads] [drift_seconds] */
+
+using namespace Common;
+
+template<typename F>
+auto TimeReads(const std::string& name, size_t reads, F&& read){
+    uint64_t sink = 0;
+    const auto start = GetCurrentNanos();
+    for(size_t i = 0; i < reads; ++i){
+        sink += read();
+    }
+    PrintThroughput(name, reads, GetCurrentNanos() - start);
+    // keeps the reads from being optimized away
+    if(sink == 1){
+        std::cout << sink << std::endl;
+    }
+}
+
+int main(int argc, char** argv){
+    const size_t reads = argc > 1 ? std::atol(argv[1]) : 10000000;
+    const int drift_seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    auto& clock = TscClock::Instance();
+    PrintMetrics("TscClock", {{"invariant_counter", clock.IsInvariant()}, {"cycles_per_sec", static_cast<uint64_t>(clock.GetCyclesPerSecond())}});
+
+    TimeReads("GetCurrentNanos", reads, [](){ return GetCurrentNanos(); });
+    TimeReads("clock_gettime CLOCK_MONOTONIC", reads, [](){ return ClockNanos(CLOCK_MONOTONIC); });
+    TimeReads("clock_gettime CLOCK_REALTIME", reads, [](){ return ClockNanos(CLOCK_REALTIME); });
+    TimeReads("ReadCycles", reads, [](){ return ReadCycles(); });
+    TimeReads("GetTscNanos", reads, [](){ return GetTscNanos(); });
+
+    std::vector<Nanos> drift;
+    const auto end = GetCurrentNanos() + drift_seconds * NANOS_TO_SECS;
+    while(GetCurrentNanos() < end){
+        const auto tsc = GetTscNanos();
+        const auto wall = GetCurrentNanos();
+        drift.push_back(std::abs(tsc - wall));
+        // what the LogBackend thread does in a process that logs
+        clock.RecalibrateIfDue();
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(10ms);
+    }
+    PrintLatencyStats("abs(GetTscNanos - GetCurrentNanos) ns", drift);
+    PrintMetrics("TscClock after recalibration", {{"cycles_per_sec", static_cast<uint64_t>(clock.GetCyclesPerSecond())}});
+    return 0;
+}
@@ -4,12 +4,21 @@
 #include "macros.h"
 
 namespace Common{
-    constexpr size_t ME_MAX_TICKERS = 8;
+    // ticker ids run from 0 to ME_MAX_TICKERS - 1, the exchange's universe lists the ones that exist
+    constexpr size_t ME_MAX_TICKERS = 64 * 1024;
+    // tickers 0 to ME_DEFAULT_TICKERS - 1 exist when no ticker universe is loaded
+    constexpr size_t ME_DEFAULT_TICKERS = 8;
+    // the order server's sequencer tracks the shards it wrote to in one 64 bit mask
+    constexpr size_t ME_MAX_SHARDS = 64;
     constexpr size_t ME_MAX_CLIENT_UPDATES = 256*1024;
     constexpr size_t ME_MAX_MARKET_UPDATES = 256*1024;
     constexpr size_t ME_MAX_NUM_CLIENTS = 256;
+    // requests the order server can read in one pass before the FIFO sequencer publishes them
+    constexpr size_t ME_MAX_PENDING_REQUESTS = 1024;
+    // the most orders one book can hold and its default capacity
     constexpr size_t ME_MAX_ORDER_IDS = 1024 * 1024;
-    constexpr size_t ME_MAX_PRICE_LEVELS = 256;
+    // default width of the price band an order book can hold levels for, rounded up to a power of two
+    constexpr size_t ME_MAX_PRICE_LEVELS = 64 * 1024;
 
     typedef uint64_t OrderId;
     constexpr auto OrderId_INVALID = std::numeric_limits<OrderId>::max();
@@ -1,8 +1,19 @@
 #include <csignal>
 #include "matcher/matching_engine.cpp"
+#include "order_server/order_server.cpp"
 
 Common::Logger* logger = nullptr;
-Exchange::MatchingEngine* matching_engine = nullptr;
+std::vector<Exchange::MatchingEngine*> matching_engines;
+Exchange::OrderServer* order_server = nullptr;
+// set by SIGUSR1, the main loop dumps the latency histograms
+volatile std::sig_atomic_t dump_latency = 0;
+
+auto DumpLatency(){
+    Common::LatencyRegistry::Instance()->Dump(std::cout, [](uint8_t tag){
+        return (tag == Common::LATENCY_TAG_UNDECODED ? std::string("UNDECODED")
+                                                     : Exchange::ClientRequestTypeToString(static_cast<Exchange::ClientRequestType>(tag)));
+    });
+}
 
 void signal_handler(int){
     using namespace std::literals::chrono_literals;
@@ -11,30 +22,90 @@ void signal_handler(int){
     delete logger; 
     logger = nullptr;
     
-    delete matching_engine;
-    matching_engine = nullptr;
+    delete order_server;
+    order_server = nullptr;
+
+    for(auto& matching_engine : matching_engines){
+        delete matching_engine;
+        matching_engine = nullptr;
+    }
+
+    DumpLatency();
 
     std::this_thread::sleep_for(10s);
     exit(EXIT_SUCCESS);
 }
 
-int main(int, char**){
+// Usage: exchange [thread placement config] [matching engine shards] [ticker universe] [journal sync policy],
+// see exchange_threads.conf and exchange_tickers.conf. Each shard runs its own matching engine thread for the
+// tickers TickerIdToShard() gives it, 1 shard by default. Without a ticker universe tickers 0 to
+// ME_DEFAULT_TICKERS - 1 are listed. Every shard journals the requests it processes with the BATCH policy
+// unless the fourth argument names another JournalSyncPolicy, or OFF for no journal
+int main(int argc, char** argv){
+    // loaded before the first Logger so the log backend thread is placed too
+    if(argc > 1 && *argv[1]){
+        ASSERT(Common::ThreadPlacementConfig::Instance()->Load(argv[1]), "Invalid thread placement config " + std::string(argv[1]));
+    }
+    const size_t num_shards = (argc > 2 ? std::stoul(argv[2]) : 1);
+    ASSERT(num_shards >= 1 && num_shards <= ME_MAX_SHARDS, "Matching engine shards must be 1-" + std::to_string(ME_MAX_SHARDS));
+    // the matching engines and the order server only read the universe, it is complete before they start
+    if(argc > 3 && *argv[3]){
+        ASSERT(Exchange::METickerUniverse::Instance()->Load(argv[3]), "Invalid ticker universe " + std::string(argv[3]));
+    }
+    // only the exchange shares its stats, with room for every listed ticker's, before the first stat is registered
+    Common::StatsSegment::Instance()->Publish(Common::STATS_SEGMENT_NAME,
+                                              Common::STATS_BASE_SLOTS + Exchange::METickerUniverse::Instance()->GetNumListed() * Exchange::ME_STATS_PER_TICKER);
     logger = new Common::Logger("exchange_main.log");
     std::signal(SIGINT, signal_handler);
+    std::signal(SIGUSR1, [](int){ dump_latency = 1; });
     const int sleep_time = 100*1000;
+    logger->Log<"%:% %() % Listing % tickers\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                Exchange::METickerUniverse::Instance()->GetNumListed());
+    const std::string journal_policy = (argc > 4 && *argv[4] ? argv[4] : "BATCH");
+    Common::JournalConfig journal_config;
+    ASSERT(journal_policy == "OFF" || Common::JournalSyncPolicyFromString(journal_policy, &journal_config.sync_policy_),
+           "Unknown journal sync policy " + journal_policy);
+
+    // every shard gets its own queues, they are never freed
+    std::vector<Exchange::ClientRequestLFQueue*> client_requests;
+    std::vector<Exchange::ClientResponseLFQueue*> client_responses;
+    std::vector<Exchange::MEMarketUpdateLFQueue*> market_updates;
+    for(size_t shard = 0; shard < num_shards; ++shard){
+        client_requests.push_back(new Exchange::ClientRequestLFQueue(ME_MAX_CLIENT_UPDATES));
+        client_responses.push_back(new Exchange::ClientResponseLFQueue(ME_MAX_CLIENT_UPDATES));
+        market_updates.push_back(new Exchange::MEMarketUpdateLFQueue(ME_MAX_MARKET_UPDATES));
+    }
+
+    logger->Log<"%:% %() % Starting Matching Engine...\n">(__FILE__, __LINE__,
+                __FUNCTION__, Common::LogTime{});
+    // the placement config picks each polling loop's idle strategy, busy spinning when it has none
+    const auto idle_strategy = [](const std::string& thread_name){
+        return Common::ThreadPlacementConfig::Instance()->Get(thread_name, Common::ThreadPlacement{}).idle_strategy_;
+    };
+    for(size_t shard = 0; shard < num_shards; ++shard){
+        const auto thread_name = "Exchange/MatchingEngine" + Exchange::MatchingEngine::ShardSuffix(shard, num_shards);
+        matching_engines.push_back(new Exchange::MatchingEngine(client_requests[shard], client_responses[shard], market_updates[shard],
+                                                                idle_strategy(thread_name), shard, num_shards,
+                                                                (journal_policy == "OFF" ? nullptr : &journal_config)));
+        matching_engines.back()->Start();
+    }
 
-    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
-    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
-    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    const std::string order_gw_iface = "lo";
+    const int order_gw_port = 12345;
+    logger->Log<"%:% %() % Starting Order Server...\n">(__FILE__, __LINE__,
+                __FUNCTION__, Common::LogTime{});
+    order_server = new Exchange::OrderServer(client_requests, client_responses, order_gw_iface, order_gw_port,
+                                             idle_strategy("Exchange/OrderServer"));
+    order_server->Start();
 
-    std::string time_str;
-    logger->Log("%:% %() % Starting Matching Engine...\n", __FILE__, __LINE__,
-                __FUNCTION__, Common::GetCurrentTimeStr(&time_str));
-    matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates);
-    matching_engine -> Start();
     while(true){
-        logger->Log("%:% %() % Sleeping for a few milliseconds...\n", __FILE__, __LINE__,
-                    __FUNCTION__, Common::GetCurrentTimeStr(&time_str));
+        logger->Log<"%:% %() % Sleeping for a few milliseconds...\n">(__FILE__, __LINE__,
+                    __FUNCTION__, Common::LogTime{});
+        // a signal cuts the sleep short
         usleep(sleep_time*1000);
+        if(dump_latency){
+            dump_latency = 0;
+            DumpLatency();
+        }
     }
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <sstream>
 #include "../../common/types.h"
+#include "../../common/lf_queue.h"
 
 using namespace Common;
 
@@ -77,6 +78,6 @@ struct MDPMarketUpdate{
 };
 #pragma pack(pop)
 
-typedef Common::LFQueue<Exchange::MEMarketUpdate> MEMarketUpdateLFQueue;
-typedef Common::LFQueue<Exchange::MDPMarketUpdate> MDPMarketUpdateLFQueue;
+typedef Common::SPSCLFQueue<Exchange::MEMarketUpdate> MEMarketUpdateLFQueue;
+typedef Common::SPSCLFQueue<Exchange::MDPMarketUpdate> MDPMarketUpdateLFQueue;
 }
\ No newline at end of file
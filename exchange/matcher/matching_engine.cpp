@@ -1,48 +1,236 @@
 #include "matching_engine.h"
+#include "me_order_book.h"
 
 namespace Exchange{
 MatchingEngine::MatchingEngine(ClientRequestLFQueue* client_requests, 
                                 ClientResponseLFQueue* client_responses, 
-                                MEMarketUpdateLFQueue* market_updates):
+                                MEMarketUpdateLFQueue* market_updates,
+                                IdleStrategyType idle_strategy,
+                                size_t shard_id, size_t num_shards,
+                                const JournalConfig* journal_config):
+                                ticker_order_book_(METickerUniverse::Instance()->Size(), nullptr),
+                                shard_id_(shard_id), num_shards_(num_shards),
                                 incoming_requests_(client_requests), 
                                 outgoing_ogw_responses_(client_responses),
                                 outgoing_md_updates_(market_updates),
-                                logger_("exchange_matching_engine.log"){
-    for(size_t i = 0; i < ticker_order_book_.size(); ++i){
-        ticker_order_book_[i] = new MEOrderBook(i, &logger_, this);
+                                // the engine's log is its record of every request and response, a burst spills instead of losing lines
+                                logger_("exchange_matching_engine" + (num_shards == 1 ? std::string() : "_" + ShardSuffix(shard_id, num_shards)) + ".log",
+                                        LogConfig{.overflow_policy_ = LogOverflowPolicy::SPILL}),
+                                idle_strategy_(idle_strategy),
+                                ticker_stats_(METickerUniverse::Instance()->Size()),
+                                request_queue_depth_(StatPrefix(shard_id, num_shards) + "request_queue_depth", StatKind::GAUGE),
+                                market_update_queue_depth_(StatPrefix(shard_id, num_shards) + "market_update_queue_depth", StatKind::GAUGE),
+                                mass_cancels_(StatPrefix(shard_id, num_shards) + "mass_cancels"),
+                                mass_canceled_orders_(StatPrefix(shard_id, num_shards) + "mass_canceled_orders"),
+                                books_(StatPrefix(shard_id, num_shards) + "books", StatKind::GAUGE),
+                                book_arena_bytes_(StatPrefix(shard_id, num_shards) + "book_arena_bytes", StatKind::GAUGE){
+    ASSERT(num_shards >= 1 && num_shards <= ME_MAX_SHARDS && shard_id < num_shards,
+           "Invalid matching engine shard " + std::to_string(shard_id) + " of " + std::to_string(num_shards));
+    // books are created as their tickers first trade, see MaterializeOrderBook()
+    if(journal_config){
+        journal_ = new Journal(JournalPrefix(shard_id, num_shards), *journal_config, StatPrefix(shard_id, num_shards) + "journal.",
+                               "Exchange/Journal" + ShardSuffix(shard_id, num_shards));
     }
+    incoming_requests_->SetReaderIdleStrategy(&idle_strategy_);
 }
 
 MatchingEngine::~MatchingEngine(){
     run_ = false;
-    using namespace std::literals::chrono_literals;
-    std::this_thread::sleep_for(1s);
+    // Run() sees run_ within one pass, a send waiting on a full queue gives up, then the books can go
+    if(thread_){
+        thread_->join();
+        delete thread_;
+        thread_ = nullptr;
+    }
+    incoming_requests_->SetReaderIdleStrategy(nullptr);
     incoming_requests_ = nullptr;
     outgoing_ogw_responses_ = nullptr;
     outgoing_md_updates_ = nullptr;
-    for(auto& order_book : ticker_order_book_){
-        delete order_book;
-        order_book = nullptr;
+    // the books live in book_arena_, which releases their memory when it is destroyed after this
+    for(const auto ticker_id : materialized_tickers_){
+        ticker_order_book_[ticker_id]->~MEOrderBook();
+        ticker_order_book_[ticker_id] = nullptr;
+    }
+    materialized_tickers_.clear();
+    // syncs what the engine committed
+    delete journal_;
+    journal_ = nullptr;
+}
+
+auto MatchingEngine::MaterializeOrderBook(TickerId ticker_id) noexcept -> MEOrderBook*{
+    const auto& ticker_info = METickerUniverse::Instance()->Get(ticker_id);
+    auto order_book = book_arena_.New<MEOrderBook>(ticker_id, &logger_, this, ticker_info.price_levels_, ticker_info.max_orders_, &book_arena_);
+    ticker_order_book_[ticker_id] = order_book;
+    materialized_tickers_.push_back(ticker_id);
+
+    const auto prefix = "me.ticker." + std::to_string(ticker_id);
+    ticker_stats_[ticker_id] = METickerStats{StatsCounter(prefix + ".orders"), StatsCounter(prefix + ".cancels"), StatsCounter(prefix + ".replaces"), StatsCounter(prefix + ".fills"),
+                                             StatsCounter(prefix + ".levels", StatKind::GAUGE), StatsCounter(prefix + ".order_chunks", StatKind::GAUGE),
+                                             StatsCounter(prefix + ".best_bid", StatKind::GAUGE), StatsCounter(prefix + ".bid_qty", StatKind::GAUGE),
+                                             StatsCounter(prefix + ".best_ask", StatKind::GAUGE), StatsCounter(prefix + ".ask_qty", StatKind::GAUGE)};
+    books_.Set(materialized_tickers_.size());
+    book_arena_bytes_.Set(book_arena_.GetAllocatedBytes());
+    logger_.Log<"%:% %() % Created order book ticker:% symbol:% max_orders:% price_levels:%\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                ticker_id, ticker_info.symbol_, ticker_info.max_orders_, ticker_info.price_levels_);
+    return order_book;
+}
+
+auto MatchingEngine::ProcessClientRequest(const MEClientRequest* client_request) noexcept -> void{
+    // the only request that may name no ticker
+    if(client_request->type_ == ClientRequestType::MASS_CANCEL){
+        MassCancel(client_request);
+        PublishOutgoing();
+        return;
+    }
+    // find the security's corresponding order book, the order server only routes listed tickers this shard owns
+    if(UNLIKELY(client_request->ticker_id_ >= ticker_order_book_.size())){
+        FATAL("Ticker " + TickerIdToString(client_request->ticker_id_) + " is not listed");
+    }
+    auto order_book = ticker_order_book_[client_request -> ticker_id_];
+    if(UNLIKELY(!order_book)){
+        if(TickerIdToShard(client_request->ticker_id_, num_shards_) != shard_id_ || !METickerUniverse::Instance()->Contains(client_request->ticker_id_)){
+            FATAL("Ticker " + TickerIdToString(client_request->ticker_id_) + " is not listed or not owned by matching engine shard " + std::to_string(shard_id_));
+        }
+        // a ticker that never traded has no orders to cancel or replace
+        if(client_request->type_ != ClientRequestType::NEW){
+            RejectWithoutOrderBook(client_request);
+            PublishOutgoing();
+            return;
+        }
+        order_book = MaterializeOrderBook(client_request->ticker_id_);
+    }
+    auto& ticker_stats = ticker_stats_[client_request->ticker_id_];
+    switch(client_request->type_){
+        case ClientRequestType::NEW:
+            {
+                ticker_stats.orders_.Increment();
+                order_book -> Add(client_request->client_id_, client_request->order_id_, 
+                                client_request->ticker_id_, client_request->side_, 
+                                client_request->price_, client_request->qty_);
+            }
+            break;
+
+        case ClientRequestType::CANCEL:
+            {
+                ticker_stats.cancels_.Increment();
+             order_book->Cancel(client_request->client_id_, client_request->order_id_,
+                                client_request->ticker_id_);
+            }
+            break;
+
+        case ClientRequestType::REPLACE:
+            {
+                ticker_stats.replaces_.Increment();
+                order_book->Replace(client_request->client_id_, client_request->order_id_,
+                                    client_request->ticker_id_, client_request->side_,
+                                    client_request->price_, client_request->qty_);
+            }
+            break;
+
+        default:
+            {
+                FATAL("Received invalid client-request-type:" + ClientRequestTypeToString(client_request->type_));
+            }
+            break;
+    }
+    UpdateTickerStats(client_request->ticker_id_);
+    // one publish per queue for all the responses/updates this request produced
+    PublishOutgoing();
+}
+
+auto MatchingEngine::RejectWithoutOrderBook(const MEClientRequest* client_request) noexcept -> void{
+    MEClientResponse client_response{ClientResponseType::CANCEL_REJECTED, client_request->client_id_, client_request->ticker_id_,
+                                     client_request->order_id_, OrderId_INVALID, Side::INVALID, Price_INVALID, Qty_INVALID, Qty_INVALID};
+    switch(client_request->type_){
+        case ClientRequestType::CANCEL:
+            break;
+
+        case ClientRequestType::REPLACE:
+            {
+                client_response = {ClientResponseType::REPLACE_REJECTED, client_request->client_id_, client_request->ticker_id_, client_request->order_id_,
+                                   OrderId_INVALID, client_request->side_, client_request->price_, Qty_INVALID, Qty_INVALID};
+            }
+            break;
+
+        default:
+            {
+                FATAL("Received invalid client-request-type:" + ClientRequestTypeToString(client_request->type_));
+            }
+            break;
+    }
+    SendClientResponse(&client_response);
+}
+
+auto MatchingEngine::MassCancel(const MEClientRequest* client_request) noexcept -> void{
+    mass_cancels_.Increment();
+    size_t canceled = 0;
+    // only tickers that traded can hold orders
+    for(const auto ticker_id : materialized_tickers_){
+        if(client_request->ticker_id_ != TickerId_INVALID && client_request->ticker_id_ != ticker_id){
+            continue;
+        }
+        canceled += ticker_order_book_[ticker_id]->MassCancel(client_request->client_id_, ticker_id, client_request->side_);
+        UpdateTickerStats(ticker_id);
     }
+    mass_canceled_orders_.Add(canceled);
+    const MEClientResponse client_response{ClientResponseType::MASS_CANCELED, client_request->client_id_, client_request->ticker_id_,
+                                           OrderId_INVALID, OrderId_INVALID, client_request->side_, Price_INVALID,
+                                           static_cast<Qty>(canceled), Qty_INVALID};
+    SendClientResponse(&client_response);
 }
 
+auto MatchingEngine::UpdateTickerStats(TickerId ticker_id) noexcept -> void{
+    const auto order_book = ticker_order_book_[ticker_id];
+    auto& ticker_stats = ticker_stats_[ticker_id];
+    ticker_stats.levels_.Set(order_book->GetLevelsInUse());
+    ticker_stats.order_chunks_.Set(order_book->GetOrderChunksInUse());
+    const auto top_of_book = order_book->GetTopOfBook();
+    ticker_stats.best_bid_.Set(top_of_book.bid_.price_ == Price_INVALID ? 0 : top_of_book.bid_.price_);
+    ticker_stats.bid_qty_.Set(top_of_book.bid_.qty_);
+    ticker_stats.best_ask_.Set(top_of_book.ask_.price_ == Price_INVALID ? 0 : top_of_book.ask_.price_);
+    ticker_stats.ask_qty_.Set(top_of_book.ask_.qty_);
+}
+
+// drains every request that is ready in one pass and releases them with a single store
 auto MatchingEngine::Run() noexcept{
-    logger_.Log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_));
+    logger_.Log<"%:% %() %\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{});
     while(run_){
-        const auto me_client_request = incoming_requests_->GetNextToRead();
-        if(LIKELY(me_client_request)){
-            logger_.Log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_), me_client_request->ToString());
-            ProcessClientRequest(me_client_request);
-            incoming_requests_->UpdateReadIndex();
+        const auto me_client_requests = incoming_requests_->GetReadSpan();
+        if(LIKELY(!me_client_requests.empty())){
+            const auto dequeue_time = Common::GetTscNanos();
+            request_queue_depth_.Set(me_client_requests.size());
+            for(const auto& envelope : me_client_requests){
+                const auto& me_client_request = envelope.request_;
+                const auto tag = static_cast<uint8_t>(me_client_request.type_);
+                Common::LatencyProbe(LatencyStage::ME_DEQUEUE, tag, envelope.rx_time_, dequeue_time);
+                logger_.Log<"%:% %() % Processing %\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, me_client_request);
+
+                current_rx_time_ = envelope.rx_time_;
+                current_request_type_ = me_client_request.type_;
+                responses_sent_ = 0;
+                if(journal_){
+                    journal_->Append(me_client_request);
+                }
+                ProcessClientRequest(&me_client_request);
+
+                // ProcessClientRequest() published this request's responses, and probed them, as it returned
+                Common::LatencyProbe(LatencyStage::ME_PROCESSED, tag, envelope.rx_time_, Common::GetTscNanos());
+            }
+            incoming_requests_->UpdateReadIndex(me_client_requests.size());
+            if(journal_){
+                journal_->Commit();
+            }
+            market_update_queue_depth_.Set(outgoing_md_updates_->Size());
         }
+        idle_strategy_.Idle(!me_client_requests.empty(), [this](){ return incoming_requests_->Size() != 0; });
     }
 }
 
 // creates and launches a new thread, assigning it the MatchingEngine::Run() method
 auto MatchingEngine::Start() -> void{
     run_ = true;
-    ASSERT(Common::CreateAndStartThread(-1, "Exchange/MatchingEngine", [this]() {Run();}) != nullptr,
-            "Failed to start MatchingEngine thread.");
+    thread_ = Common::CreateAndStartThread(-1, GetThreadName(), [this]() {Run();});
+    ASSERT(thread_ != nullptr, "Failed to start " + GetThreadName() + " thread.");
 }
 
 auto MatchingEngine::Stop() -> void{
@@ -3,26 +3,104 @@
 #include "../../common/lf_queue.h"
 #include "../../common/macros.h"
 #include "../../common/logging.h"
+#include "../../common/latency_histogram.h"
+#include "../../common/stats_segment.h"
+#include "../../common/arena.h"
+#include "../../common/journal.h"
 #include "../order_server/client_request.h"
 #include "../order_server/client_response.h"
 #include "../market_data/market_update.h"
 #include "me_order.h"
-#include "me_order_book.h"
+#include "me_ticker_universe.h"
 
 namespace Exchange{
+// MEOrderBook calls back into MatchingEngine, so the book header includes this one and not the other way around
+class MEOrderBook;
+// indexed by ticker id, one slot per ticker of the universe, nullptr until the ticker's book is created
+typedef std::vector<MEOrderBook *> OrderBookHashMap;
+
+// published as me.ticker.<ticker_id>.<stat>, registered when the ticker's book is created
+struct METickerStats{
+    StatsCounter orders_;
+    StatsCounter cancels_;
+    StatsCounter replaces_;
+    // FILLED responses, one per side of every execution
+    StatsCounter fills_;
+    // objects live in the book's MEOrdersAtPrice and MEOrderChunk pools
+    StatsCounter levels_;
+    StatsCounter order_chunks_;
+    // top of book after the last request, prices are 0 while a side is empty
+    StatsCounter best_bid_;
+    StatsCounter bid_qty_;
+    StatsCounter best_ask_;
+    StatsCounter ask_qty_;
+};
+
+// stats a ticker registers when its book is created, for sizing the stats segment
+constexpr size_t ME_STATS_PER_TICKER = sizeof(METickerStats) / sizeof(StatsCounter);
+
+/*
+The exchange runs one MatchingEngine per shard, each on its own thread with its own request, response and
+market update queues. A shard owns the books of the tickers TickerIdToShard() maps to it and leaves the
+other slots of ticker_order_book_ empty, so a busy ticker only delays the tickers sharing its shard. With
+a single shard the engine owns every ticker and keeps the unsharded log, stat and thread names.
+
+The tickers come from METickerUniverse. A book is created on the first NEW for its ticker, sized by the
+ticker's capacity hints and placed in book_arena_, so listing thousands of tickers costs one pointer each
+until they trade. Requests find their book by indexing ticker_order_book_ with the ticker id.
+
+With a JournalConfig every request is appended to the shard's journal (exchange_journal[_<shard>].<n>)
+just before it is processed, and each batch read from the request queue is committed to the journal's sync
+thread as one. Responses don't wait for the sync, the journal is the record of what the engine processed.
+*/
 class MatchingEngine final{
 private:
-    // Need to create OrderBookHashMap class
     OrderBookHashMap ticker_order_book_;
+    // tickers whose book exists, in the order they first traded
+    std::vector<TickerId> materialized_tickers_;
+    // holds the books and their order storage, the destructor destroys the books before it goes
+    Arena book_arena_;
+    const size_t shard_id_ = 0;
+    const size_t num_shards_ = 1;
     ClientRequestLFQueue* incoming_requests_ = nullptr;
     ClientResponseLFQueue* outgoing_ogw_responses_ = nullptr;
     MEMarketUpdateLFQueue* outgoing_md_updates_ = nullptr;
     volatile bool run_ = false;
-    std::string time_str_;
+    // runs Run(), joined by the destructor
+    std::thread* thread_ = nullptr;
     Logger logger_;
+    // nullptr when the engine keeps no journal
+    Journal* journal_ = nullptr;
+    // what Run() does when the request queue is empty, a parked engine is woken by the order server's publish
+    IdleStrategy idle_strategy_;
+    // the request being processed, its responses carry these back to the order server for the latency probes
+    Nanos current_rx_time_ = 0;
+    ClientRequestType current_request_type_ = ClientRequestType::INVALID;
+    size_t responses_sent_ = 0;
+    std::vector<METickerStats> ticker_stats_;
+    // requests ready when the engine last read its queue, and market updates nobody has read yet
+    StatsCounter request_queue_depth_;
+    StatsCounter market_update_queue_depth_;
+    // MASS_CANCEL requests and the orders they removed
+    StatsCounter mass_cancels_;
+    StatsCounter mass_canceled_orders_;
+    // books created so far and the bytes the arena handed out for them
+    StatsCounter books_;
+    StatsCounter book_arena_bytes_;
+
+    // creates the book of a listed ticker this shard owns when it first trades
+    auto MaterializeOrderBook(TickerId ticker_id) noexcept -> MEOrderBook*;
+
+    // answers a CANCEL or REPLACE for a ticker that has no book yet
+    auto RejectWithoutOrderBook(const MEClientRequest* client_request) noexcept -> void;
+
+    // refreshes the ticker's gauges from its book, reads only the book's counters and best levels
+    auto UpdateTickerStats(TickerId ticker_id) noexcept -> void;
 
 public:
-    MatchingEngine(ClientRequestLFQueue* client_requests, ClientResponseLFQueue* client_responses, MEMarketUpdateLFQueue* market_updates);
+    MatchingEngine(ClientRequestLFQueue* client_requests, ClientResponseLFQueue* client_responses, MEMarketUpdateLFQueue* market_updates,
+                   IdleStrategyType idle_strategy = IdleStrategyType::BUSY_SPIN, size_t shard_id = 0, size_t num_shards = 1,
+                   const JournalConfig* journal_config = nullptr);
     ~MatchingEngine();
     auto Start() -> void;
     auto Stop() -> void;
@@ -30,49 +108,97 @@ public:
     
     // checks for the type of the MEClientRequest and forwards it
     // to the limit order book of the corresponding instrument
-    auto ProcessClientRequest(const MEClientRequest* client_request) noexcept{
-        // find the security's corresponding order book
-        auto order_book = ticker_order_book_[client_request -> ticker_id_];
-        switch(client_request->type_){
-            case ClientRequestType::NEW:
-                {
-                    order_book -> Add(client_request->client_id_, client_request->order_id_, 
-                                    client_request->ticker_id_, client_request->side_, 
-                                    client_request->price_, client_request->qty_);
-                }
-                break;
-
-            case ClientRequestType::CANCEL:
-                {
-                 order_book->Cancel(client_request->client_id_, client_request->order_id_,
-                                    client_request->ticker_id_);
-                }
-                break;
-
-            default:
-                {
-                    FATAL("Received invalid client-request-type:" + ClientRequestTypeToString(client_request->type_));
-                }
-                break;
-        }
-    }
+    auto ProcessClientRequest(const MEClientRequest* client_request) noexcept -> void;
+
+    // cancels the client's orders on the requested ticker or on all of them, then sends MASS_CANCELED
+    auto MassCancel(const MEClientRequest* client_request) noexcept -> void;
 
-    // writes client response to outgoing_ogw_responses_ lf queue
-    // and then advances the writer index
+    // writes client response to outgoing_ogw_responses_ lf queue and advances the writer index
+    // without publishing it, PublishOutgoing() makes every response and market update produced
+    // by one client request visible to the consumers with one store per queue
     auto SendClientResponse(const MEClientResponse* client_response) noexcept{
-        logger_.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
-                    client_response->ToString());
+        logger_.Log<"%:% %() % Sending %\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                    *client_response);
         auto next_write = outgoing_ogw_responses_->GetNextToWriteTo();
-        *next_write = std::move(*client_response);
-        outgoing_ogw_responses_->UpdateWriteIndex();
+        // back-pressure: publish what we have and wait for the order server to drain instead of
+        // overwriting unread responses, a stopped engine gives up since the order server may be gone
+        if(UNLIKELY(!next_write)){
+            outgoing_ogw_responses_->PublishWriteIndex();
+            while(!next_write && run_){
+                next_write = outgoing_ogw_responses_->GetNextToWriteTo();
+            }
+            if(UNLIKELY(!next_write)){
+                return;
+            }
+        }
+        *next_write = MEClientResponseEnvelope{*client_response, current_rx_time_, current_request_type_};
+        outgoing_ogw_responses_->AdvanceWriteIndex();
+        ++responses_sent_;
+        if(client_response->type_ == ClientResponseType::FILLED){
+            ticker_stats_[client_response->ticker_id_].fills_.Increment();
+        }
     }
 
     auto SendMarketUpdate(const MEMarketUpdate* market_update) noexcept{
-        logger_.Log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
-                    market_update->ToString());
+        logger_.Log<"%:% %() % Sending %\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                    *market_update);
         auto next_write = outgoing_md_updates_->GetNextToWriteTo();
+        if(UNLIKELY(!next_write)){
+            outgoing_md_updates_->PublishWriteIndex();
+            while(!next_write && run_){
+                next_write = outgoing_md_updates_->GetNextToWriteTo();
+            }
+            if(UNLIKELY(!next_write)){
+                return;
+            }
+        }
         *next_write = std::move(*market_update);
-        outgoing_md_updates_->UpdateWriteIndex();
+        outgoing_md_updates_->AdvanceWriteIndex();
+    }
+
+    // "" with a single shard, otherwise the shard id, appended to the shard's log, stat and thread names
+    static auto ShardSuffix(size_t shard_id, size_t num_shards) -> std::string{
+        return (num_shards == 1 ? std::string() : std::to_string(shard_id));
+    }
+
+    // me. for a single shard, me.shard<id>. otherwise, per-ticker stats keep me.ticker.<id>. since tickers aren't shared
+    static auto StatPrefix(size_t shard_id, size_t num_shards) -> std::string{
+        return (num_shards == 1 ? std::string("me.") : "me.shard" + ShardSuffix(shard_id, num_shards) + ".");
+    }
+
+    auto GetThreadName() const{
+        return "Exchange/MatchingEngine" + ShardSuffix(shard_id_, num_shards_);
+    }
+
+    // the journal's segment files are <prefix>.<n>
+    static auto JournalPrefix(size_t shard_id, size_t num_shards) -> std::string{
+        return "exchange_journal" + (num_shards == 1 ? std::string() : "_" + ShardSuffix(shard_id, num_shards));
+    }
+
+    // nullptr for tickers owned by another shard and for tickers that have not traded yet
+    auto GetOrderBook(TickerId ticker_id) const noexcept{
+        return ticker_order_book_.at(ticker_id);
+    }
+
+    auto GetNumOrderBooks() const noexcept{
+        return materialized_tickers_.size();
+    }
+
+    auto GetBookArenaBytes() const noexcept{
+        return book_arena_.GetAllocatedBytes();
+    }
+
+    auto PublishOutgoing() noexcept{
+        outgoing_ogw_responses_->PublishWriteIndex();
+        outgoing_md_updates_->PublishWriteIndex();
+        // the request's responses are visible to the order server from here
+        if(responses_sent_){
+            const auto published_time = Common::GetTscNanos();
+            for(size_t i = 0; i < responses_sent_; ++i){
+                Common::LatencyProbe(LatencyStage::RESPONSE_ENQUEUED, static_cast<uint8_t>(current_request_type_), current_rx_time_, published_time);
+            }
+            responses_sent_ = 0;
+        }
     }
     
     // deleted default, copy & move constructors and assignment-operators
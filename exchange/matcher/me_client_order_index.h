@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include "../../common/macros.h"
+#include "../../common/types.h"
+#include "me_order.h"
+
+using namespace Common;
+
+namespace Exchange{
+/*
+Open-addressing index from (ClientId, client OrderId) to the live MEOrder, replacing the
+ME_MAX_NUM_CLIENTS x ME_MAX_ORDER_IDS pointer arrays (2 GB per book).
+
+1. Both ids are packed into one 64-bit key: the client id in the top CLIENT_ID_BITS bits and the
+   client order id in the rest. Entries are 16 bytes so four share a cache line.
+
+2. Linear probing from a Fibonacci hash of the key. The table has at least twice as many slots as
+   the book can have live orders, so the load factor stays under 0.5 and probe sequences are short.
+
+3. Erase() uses backward-shift deletion instead of tombstones, so probe sequences don't get longer
+   as orders are added and canceled.
+
+4. The table is calloc'ed, which maps zero pages lazily, so resident memory follows the slots that
+   live orders actually touched. A caller can hand in zeroed memory of the same kind instead.
+*/
+class ClientOrderIndex final{
+private:
+    static constexpr int CLIENT_ID_BITS = std::bit_width(ME_MAX_NUM_CLIENTS - 1);
+    static constexpr int ORDER_ID_BITS = 64 - CLIENT_ID_BITS;
+
+    struct Entry{
+        uint64_t key_;
+        MEOrder* order_;
+    };
+
+    Entry* table_ = nullptr;
+    // false when the caller provided table_ and frees it
+    bool owns_table_ = true;
+    size_t mask_ = 0;
+    int shift_ = 0;
+    size_t size_ = 0;
+
+    static auto ToKey(ClientId client_id, OrderId client_order_id) noexcept -> uint64_t{
+        return (client_id << ORDER_ID_BITS) | client_order_id;
+    }
+
+    auto HomeSlot(uint64_t key) const noexcept -> size_t{
+        return (key * 0x9E3779B97F4A7C15ull) >> shift_;
+    }
+
+    // slot holding key, or the empty slot where the probe for key stopped
+    auto FindSlot(uint64_t key) const noexcept -> size_t{
+        auto slot = HomeSlot(key);
+        while(table_[slot].order_ && table_[slot].key_ != key){
+            slot = (slot + 1) & mask_;
+        }
+        return slot;
+    }
+
+public:
+    // whether the ids fit in a key, Insert() only takes ids that do
+    static auto IsValidKey(ClientId client_id, OrderId client_order_id) noexcept{
+        return client_id < ME_MAX_NUM_CLIENTS && (client_order_id >> ORDER_ID_BITS) == 0;
+    }
+
+    static auto CapacityFor(size_t max_live_orders) noexcept -> size_t{
+        return std::bit_ceil(std::max<size_t>(2 * max_live_orders, 2));
+    }
+
+    // what a caller providing the table has to allocate, zeroed, for max_live_orders
+    static auto StorageBytes(size_t max_live_orders) noexcept{
+        return CapacityFor(max_live_orders) * sizeof(Entry);
+    }
+
+    static constexpr auto StorageAlignment() noexcept{
+        return alignof(Entry);
+    }
+
+    // storage, when given, holds StorageBytes(max_live_orders) zeroed bytes and outlives the index
+    explicit ClientOrderIndex(size_t max_live_orders, void* storage = nullptr){
+        const auto capacity = CapacityFor(max_live_orders);
+        table_ = static_cast<Entry*>(storage ? storage : std::calloc(capacity, sizeof(Entry)));
+        owns_table_ = !storage;
+        ASSERT(table_ != nullptr, "Failed to allocate ClientOrderIndex of " + std::to_string(capacity) + " entries");
+        mask_ = capacity - 1;
+        shift_ = 64 - std::countr_zero(capacity);
+    }
+
+    ~ClientOrderIndex(){
+        if(owns_table_){
+            std::free(table_);
+        }
+        table_ = nullptr;
+    }
+
+    // deleted default, copy & move constructors and assignment-operators
+    ClientOrderIndex() = delete;
+    ClientOrderIndex(const ClientOrderIndex&) = delete;
+    ClientOrderIndex(const ClientOrderIndex&&) = delete;
+    ClientOrderIndex& operator=(const ClientOrderIndex&) = delete;
+    ClientOrderIndex& operator=(const ClientOrderIndex&&) = delete;
+
+    // nullptr if the order is not live or the ids are out of range
+    auto Find(ClientId client_id, OrderId client_order_id) const noexcept -> MEOrder*{
+        if(UNLIKELY(!IsValidKey(client_id, client_order_id))){
+            return nullptr;
+        }
+        return table_[FindSlot(ToKey(client_id, client_order_id))].order_;
+    }
+
+    // maps the ids to order, the ids must not be mapped already, the caller rejects a reused client order id
+    auto Insert(ClientId client_id, OrderId client_order_id, MEOrder* order) noexcept -> void{
+        if(UNLIKELY(!IsValidKey(client_id, client_order_id))){
+            FATAL("ClientOrderIndex key out of range client:" + ClientIdToString(client_id) + " oid:" + OrderIdToString(client_order_id));
+        }
+        const auto key = ToKey(client_id, client_order_id);
+        auto& entry = table_[FindSlot(key)];
+        ASSERT(entry.order_ == nullptr, "ClientOrderIndex already holds client:" + ClientIdToString(client_id) + " oid:" + OrderIdToString(client_order_id));
+        if(UNLIKELY(size_ == mask_)){
+            FATAL("ClientOrderIndex out of space!");
+        }
+        ++size_;
+        entry = {key, order};
+    }
+
+    auto Erase(ClientId client_id, OrderId client_order_id) noexcept -> void{
+        if(UNLIKELY(!IsValidKey(client_id, client_order_id))){
+            return;
+        }
+        auto hole = FindSlot(ToKey(client_id, client_order_id));
+        if(UNLIKELY(!table_[hole].order_)){
+            return;
+        }
+        --size_;
+        // shift back every following entry whose probe sequence passes through the hole
+        for(auto slot = (hole + 1) & mask_; table_[slot].order_; slot = (slot + 1) & mask_){
+            const auto home = HomeSlot(table_[slot].key_);
+            if(((slot - home) & mask_) >= ((slot - hole) & mask_)){
+                table_[hole] = table_[slot];
+                hole = slot;
+            }
+        }
+        table_[hole] = {0, nullptr};
+    }
+
+    auto Clear() noexcept{
+        for(size_t slot = 0; slot <= mask_; ++slot){
+            table_[slot] = {0, nullptr};
+        }
+        size_ = 0;
+    }
+
+    auto Size() const noexcept{
+        return size_;
+    }
+
+    auto Capacity() const noexcept{
+        return mask_ + 1;
+    }
+};
+}
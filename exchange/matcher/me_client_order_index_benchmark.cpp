@@ -0,0 +1,117 @@
+#include <cstdlib>
+#include <random>
+#include <unordered_set>
+#include <unistd.h>
+#include "../../common/benchmark_utils.h"
+#include "me_client_order_index.h"
+
+/* Resident memory and cancel (find + erase) latency of ClientOrderIndex against the flat
+   ME_MAX_NUM_CLIENTS x ME_MAX_ORDER_IDS pointer arrays it replaced. Live orders get random
+   client ids and client order ids, the flat arrays are calloc'ed so they only cost the pages
+   that get touched, which is the best case for them.
+   Usage: me_client_order_index_benchmark [live_orders] */
+
+using namespace Exchange;
+
+typedef std::array<std::array<MEOrder*, ME_MAX_ORDER_IDS>, ME_MAX_NUM_CLIENTS> FlatClientOrderMap;
+
+auto ResidentBytes() noexcept -> size_t{
+    size_t total_pages = 0, resident_pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if(statm){
+        if(fscanf(statm, "%zu %zu", &total_pages, &resident_pages) != 2){
+            resident_pages = 0;
+        }
+        fclose(statm);
+    }
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+struct Key{
+    ClientId client_id_;
+    OrderId client_order_id_;
+};
+
+auto PrintResident(const std::string& name, size_t live_orders, size_t bytes){
+    PrintMetrics(name, {{"live_orders", live_orders}, {"resident_bytes", bytes}, {"bytes_per_order", static_cast<double>(bytes) / live_orders}});
+}
+
+auto RunFlat(const std::vector<Key>& keys, std::vector<MEOrder>& orders, const std::vector<size_t>& cancel_order){
+    const auto rss_before = ResidentBytes();
+    auto flat = static_cast<FlatClientOrderMap*>(std::calloc(1, sizeof(FlatClientOrderMap)));
+    ASSERT(flat != nullptr, "Failed to allocate flat client order map");
+
+    const auto start = GetCurrentNanos();
+    for(size_t i = 0; i < keys.size(); ++i){
+        (*flat)[keys[i].client_id_][keys[i].client_order_id_] = &orders[i];
+    }
+    PrintThroughput("FlatClientOrderMap insert", keys.size(), GetCurrentNanos() - start);
+    PrintResident("FlatClientOrderMap", keys.size(), ResidentBytes() - rss_before);
+
+    std::vector<Nanos> samples;
+    samples.reserve(keys.size());
+    for(const auto i : cancel_order){
+        const auto op_start = GetCurrentNanos();
+        auto& slot = (*flat)[keys[i].client_id_][keys[i].client_order_id_];
+        if(UNLIKELY(slot != &orders[i])){
+            FATAL("FlatClientOrderMap lost an order");
+        }
+        slot = nullptr;
+        samples.push_back(GetCurrentNanos() - op_start);
+    }
+    PrintLatencyStats("FlatClientOrderMap cancel ns", samples);
+    std::free(flat);
+}
+
+auto RunIndex(const std::vector<Key>& keys, std::vector<MEOrder>& orders, const std::vector<size_t>& cancel_order){
+    const auto rss_before = ResidentBytes();
+    // sized the way MEOrderBook sizes it
+    auto index = new ClientOrderIndex(ME_MAX_ORDER_IDS);
+
+    const auto start = GetCurrentNanos();
+    for(size_t i = 0; i < keys.size(); ++i){
+        index->Insert(keys[i].client_id_, keys[i].client_order_id_, &orders[i]);
+    }
+    PrintThroughput("ClientOrderIndex insert", keys.size(), GetCurrentNanos() - start);
+    PrintResident("ClientOrderIndex", keys.size(), ResidentBytes() - rss_before);
+
+    std::vector<Nanos> samples;
+    samples.reserve(keys.size());
+    for(const auto i : cancel_order){
+        const auto op_start = GetCurrentNanos();
+        if(UNLIKELY(index->Find(keys[i].client_id_, keys[i].client_order_id_) != &orders[i])){
+            FATAL("ClientOrderIndex lost an order");
+        }
+        index->Erase(keys[i].client_id_, keys[i].client_order_id_);
+        samples.push_back(GetCurrentNanos() - op_start);
+    }
+    PrintLatencyStats("ClientOrderIndex cancel ns", samples);
+    ASSERT(index->Size() == 0, "ClientOrderIndex not empty after canceling every order");
+    delete index;
+}
+
+int main(int argc, char** argv){
+    const size_t live_orders = std::min<size_t>(argc > 1 ? std::atol(argv[1]) : 250000, ME_MAX_ORDER_IDS);
+
+    std::mt19937_64 rng(42);
+    std::unordered_set<uint64_t> used;
+    std::vector<Key> keys;
+    keys.reserve(live_orders);
+    while(keys.size() < live_orders){
+        const Key key{rng() % ME_MAX_NUM_CLIENTS, rng() % ME_MAX_ORDER_IDS};
+        if(used.insert(key.client_id_ * ME_MAX_ORDER_IDS + key.client_order_id_).second){
+            keys.push_back(key);
+        }
+    }
+    std::vector<MEOrder> orders(live_orders);
+
+    std::vector<size_t> cancel_order(live_orders);
+    for(size_t i = 0; i < live_orders; ++i){
+        cancel_order[i] = i;
+    }
+    std::shuffle(cancel_order.begin(), cancel_order.end(), rng);
+
+    RunFlat(keys, orders, cancel_order);
+    RunIndex(keys, orders, cancel_order);
+    return 0;
+}
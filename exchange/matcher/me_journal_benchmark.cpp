@@ -0,0 +1,159 @@
+#include <cstdlib>
+#include "../../common/benchmark_utils.h"
+#include "../../common/journal.h"
+#include "../order_server/client_request.h"
+
+/* Cost of journaling MEClientRequests the way MatchingEngine::Run() does, on the calling thread:
+   - crc32c: checksum of one journal record's sequence number and request, with the crc32 instruction
+     where the CPU has it and with the byte-wise table
+   - append <policy>: Append() of every request and a Commit() after every `batch` of them, per request.
+     The segment is large enough that no append switches segments. Under BATCH and PERIODIC the sync
+     thread msyncs the segment while the appends run
+   - append <policy> batch: the same appends timed per batch and divided by the batch size, for the tail
+   - rollover: a journal of small segments written by two Journal objects one after the other, as by an
+     exchange that restarted, then read back. The read must find every record in sequence
+   Every journal is read back and checked against what was appended. The segment files are written to the
+   working directory and removed afterwards.
+   Usage: me_journal_benchmark [requests] [batch] */
+
+using namespace Common;
+using namespace Exchange;
+
+constexpr auto BENCH_JOURNAL_PREFIX = "me_journal_benchmark";
+
+auto RemoveJournal(const std::string& prefix){
+    for(size_t index = 0; JournalSegmentExists(prefix, index); ++index){
+        unlink(JournalSegmentName(prefix, index).c_str());
+    }
+}
+
+auto MakeRequest(size_t i) noexcept{
+    return MEClientRequest{(i % 2 ? ClientRequestType::NEW : ClientRequestType::CANCEL), static_cast<ClientId>(i % 64), static_cast<TickerId>(i % 8),
+                           static_cast<OrderId>(i), (i % 3 ? Side::BUY : Side::SELL), static_cast<Price>(10000 + i % 50), static_cast<Qty>(1 + i % 100)};
+}
+
+// reads the journal back and checks it holds requests first to first + count - 1 in order
+auto VerifyJournal(const std::string& prefix, size_t count, uint64_t first_sequence = 1){
+    JournalReader reader(prefix);
+    JournalRecord record;
+    size_t read = 0;
+    while(reader.Next(&record)){
+        const auto expected = MakeRequest(read);
+        if(UNLIKELY(record.sequence_ != first_sequence + read || record.size_ != sizeof(MEClientRequest)
+                    || std::memcmp(record.payload_, &expected, sizeof(expected)) != 0)){
+            FATAL("journal " + prefix + " record " + std::to_string(read) + " does not match what was appended");
+        }
+        ++read;
+    }
+    if(UNLIKELY(read != count || !reader.GetError().empty() || reader.GetTornRecords())){
+        FATAL("journal " + prefix + " read " + std::to_string(read) + " of " + std::to_string(count) + " records " + reader.GetError());
+    }
+}
+
+auto RunCrc(size_t iterations){
+    // the check value of CRC-32C, and both implementations agreeing on every tail length
+    if(UNLIKELY(Crc32cSoftware("123456789", 9) != 0xe3069283)){
+        FATAL("crc32c software check value mismatch");
+    }
+#if defined(__x86_64__)
+    if(HasCrc32cInstruction()){
+        uint8_t bytes[64];
+        for(size_t i = 0; i < sizeof(bytes); ++i){
+            bytes[i] = static_cast<uint8_t>(i * 37 + 11);
+        }
+        for(size_t size = 0; size <= sizeof(bytes); ++size){
+            if(UNLIKELY(Crc32cHardware(bytes, size, 7) != Crc32cSoftware(bytes, size, 7))){
+                FATAL("crc32c hardware and software differ at " + std::to_string(size) + " bytes");
+            }
+        }
+    }
+#endif
+    uint8_t record[sizeof(uint64_t) + sizeof(MEClientRequest)] = {};
+    uint32_t sink = 0;
+    const auto size_name = std::to_string(sizeof(record)) + " bytes";
+#if defined(__x86_64__)
+    if(HasCrc32cInstruction()){
+        const auto start = GetCurrentNanos();
+        for(size_t i = 0; i < iterations; ++i){
+            record[0] = static_cast<uint8_t>(i);
+            sink += Crc32cHardware(record, sizeof(record));
+        }
+        PrintThroughput("crc32c hardware " + size_name, iterations, GetCurrentNanos() - start);
+    }
+#endif
+    const auto start = GetCurrentNanos();
+    for(size_t i = 0; i < iterations; ++i){
+        record[0] = static_cast<uint8_t>(i);
+        sink += Crc32cSoftware(record, sizeof(record));
+    }
+    PrintThroughput("crc32c software " + size_name, iterations, GetCurrentNanos() - start);
+    ASSERT(sink || iterations == 0, "crc32c optimized away");
+}
+
+auto RunAppend(JournalSyncPolicy policy, size_t requests, size_t batch){
+    const auto name = JournalSyncPolicyToString(policy);
+    const auto prefix = std::string(BENCH_JOURNAL_PREFIX) + "_" + name;
+    RemoveJournal(prefix);
+    std::vector<MEClientRequest> flow;
+    flow.reserve(requests);
+    for(size_t i = 0; i < requests; ++i){
+        flow.push_back(MakeRequest(i));
+    }
+    JournalConfig config{.sync_policy_ = policy};
+    config.segment_bytes_ = std::max(config.segment_bytes_, sizeof(JournalSegmentHeader) + requests * JournalRecordBytes(sizeof(MEClientRequest)));
+    std::vector<Nanos> samples;
+    samples.reserve(requests / batch + 1);
+    {
+        Journal journal(prefix, config, "bench.journal." + name + ".", "Bench/Journal" + name);
+        const auto start = GetCurrentNanos();
+        for(size_t i = 0; i < requests; i += batch){
+            const auto batch_start = GetCurrentNanos();
+            const auto batch_end = std::min(requests, i + batch);
+            for(size_t j = i; j < batch_end; ++j){
+                journal.Append(flow[j]);
+            }
+            journal.Commit();
+            samples.push_back((GetCurrentNanos() - batch_start) / static_cast<Nanos>(batch_end - i));
+        }
+        PrintThroughput("append " + name, requests, GetCurrentNanos() - start);
+    }
+    PrintLatencyStats("append " + name + " batch:" + std::to_string(batch) + " ns per request", samples);
+    VerifyJournal(prefix, requests);
+    RemoveJournal(prefix);
+}
+
+auto RunRollover(size_t requests){
+    const auto prefix = std::string(BENCH_JOURNAL_PREFIX) + "_rollover";
+    RemoveJournal(prefix);
+    JournalConfig config{.sync_policy_ = JournalSyncPolicy::BATCH};
+    // room for about a thousand records per segment
+    config.segment_bytes_ = 1000 * JournalRecordBytes(sizeof(MEClientRequest));
+    size_t segments = 0;
+    for(const auto& [first, last] : {std::pair<size_t, size_t>{0, requests / 2}, {requests / 2, requests}}){
+        Journal journal(prefix, config, "bench.journal.rollover.", "Bench/JournalRoll");
+        ASSERT(journal.GetNextSequence() == first + 1, "restarted journal did not continue the sequence");
+        for(size_t i = first; i < last; ++i){
+            journal.Append(MakeRequest(i));
+            if(i % 16 == 15){
+                journal.Commit();
+            }
+        }
+        segments = journal.GetSegmentIndex() + 1;
+    }
+    VerifyJournal(prefix, requests);
+    PrintMetrics("rollover", {{"records", requests}, {"segments", segments}});
+    RemoveJournal(prefix);
+}
+
+int main(int argc, char** argv){
+    const size_t requests = argc > 1 ? std::atol(argv[1]) : 1000000;
+    const size_t batch = std::max<size_t>(argc > 2 ? std::atol(argv[2]) : 16, 1);
+
+    PrintMetrics("record", {{"request_bytes", sizeof(MEClientRequest)}, {"journal_bytes", JournalRecordBytes(sizeof(MEClientRequest))}});
+    RunCrc(requests);
+    for(const auto policy : {JournalSyncPolicy::NONE, JournalSyncPolicy::BATCH, JournalSyncPolicy::PERIODIC}){
+        RunAppend(policy, requests, batch);
+    }
+    RunRollover(std::min<size_t>(requests, 20000));
+    return 0;
+}
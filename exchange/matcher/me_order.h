@@ -1,63 +1,118 @@
 #pragma once
 #include <array>
+#include <vector>
 #include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include "../../common/types.h"
 
 using namespace Common;
 
 namespace Exchange{
+/*
+Resting order record, only what matching reads and writes: the fill quantity and the ids and priority
+that go out in the fill and market update messages. Side and price are the same for every order at a
+level and live in MEOrdersAtPrice, the ticker lives in the book. Orders are stored back to back in
+MEOrderChunk slots, a slot whose qty_ is 0 holds no order.
+*/
 struct MEOrder{
-    TickerId ticker_id_ = TickerId_INVALID;
+    Qty qty_ = 0;
     ClientId client_id_ = ClientId_INVALID;
     OrderId client_order_id_ = OrderId_INVALID;
     OrderId market_order_id_ = OrderId_INVALID;
-    Side side_ = Side::INVALID;
-    Price price_ = Price_INVALID;
-    Qty qty_ = Qty_INVALID;
     Priority priority_ = Priority_INVALID;
-    MEOrder* prev_order_ = nullptr;
-    MEOrder* next_order_ = nullptr;
-    // only needed for MemPool
+
     MEOrder() = default;
-    MEOrder(TickerId ticker_id, ClientId client_id, OrderId client_order_id, OrderId market_order_id, 
-            Side side, Price price, Qty qty, Priority priority, MEOrder* prev_order, MEOrder* next_order) noexcept:
-            ticker_id_(ticker_id), client_id_(client_id), client_order_id_(client_order_id), 
-            market_order_id_(market_order_id), side_(side), price_(price), qty_(qty), priority_(priority),
-            prev_order_(prev_order), next_order_(next_order){
+    MEOrder(ClientId client_id, OrderId client_order_id, OrderId market_order_id, Qty qty, Priority priority) noexcept:
+            qty_(qty), client_id_(client_id), client_order_id_(client_order_id), market_order_id_(market_order_id),
+            priority_(priority){
 
             }
-    
+
     auto ToString() const -> std::string{
         std::stringstream ss;
         ss << "MEOrder" << " ["
-        << "ticker: " << TickerIdToString(ticker_id_)
+        << "client: " << ClientIdToString(client_id_)
         << " client_order_id: " << OrderIdToString(client_order_id_)
         << " market_order_id: " << OrderIdToString(market_order_id_)
-        << " side: " << SideToString(side_)
-        << " price: " << PriceToString(price_)
         << " qty: " << QtyToString(qty_)
         << " priority: " << PriorityToString(priority_)
-        << " previous_pointer: " << OrderIdToString(prev_order_ ? prev_order_->market_order_id_ : OrderId_INVALID)
-        << " next_pointer: " << OrderIdToString(next_order_ ? next_order_->market_order_id_ : OrderId_INVALID)
         << "]";
 
         return ss.str();
     }
 };
 
-typedef std::array<MEOrder*, ME_MAX_ORDER_IDS> OrderHashMap;
-typedef std::array<OrderHashMap, ME_MAX_NUM_CLIENTS> ClientOrderHashmap;
+// chunks are linked by their index in the book's chunk pool
+typedef uint32_t MEOrderChunkIndex;
+constexpr auto MEOrderChunkIndex_INVALID = std::numeric_limits<MEOrderChunkIndex>::max();
+static_assert(ME_MAX_ORDER_IDS < MEOrderChunkIndex_INVALID, "every order may need its own chunk");
+
+struct MEOrdersAtPrice;
+
+// chunks are aligned to their size, so the chunk holding an order is found by masking the order's address
+constexpr size_t ME_ORDER_CHUNK_BYTES = 512;
+constexpr size_t ME_ORDER_CHUNK_HEADER_BYTES = 24;
+constexpr size_t ME_ORDERS_PER_CHUNK = (ME_ORDER_CHUNK_BYTES - ME_ORDER_CHUNK_HEADER_BYTES) / sizeof(MEOrder);
+
+/*
+A run of orders at one price level in time priority. New orders go into the next unused slot of the
+level's last chunk, a removed order leaves an empty slot (qty_ 0) behind and the chunk is released once
+its last order is gone, so matching walks the level slot by slot through contiguous memory instead of
+chasing a pointer per order.
+*/
+struct alignas(ME_ORDER_CHUNK_BYTES) MEOrderChunk{
+    MEOrdersAtPrice* orders_at_price_ = nullptr;
+    MEOrderChunkIndex prev_chunk_ = MEOrderChunkIndex_INVALID;
+    MEOrderChunkIndex next_chunk_ = MEOrderChunkIndex_INVALID;
+    // slots before begin_ are empty, slots from end_ on have never been used
+    uint16_t begin_ = 0;
+    uint16_t end_ = 0;
+    // orders still in the chunk
+    uint16_t num_orders_ = 0;
+    MEOrder orders_[ME_ORDERS_PER_CHUNK];
+
+    MEOrderChunk() = default;
+    MEOrderChunk(MEOrdersAtPrice* orders_at_price, MEOrderChunkIndex prev_chunk) noexcept:
+    orders_at_price_(orders_at_price), prev_chunk_(prev_chunk){
+
+    }
+
+    static auto Of(const MEOrder* order) noexcept{
+        return reinterpret_cast<MEOrderChunk*>(reinterpret_cast<uintptr_t>(order) & ~(ME_ORDER_CHUNK_BYTES - 1));
+    }
+};
+static_assert(offsetof(MEOrderChunk, orders_) == ME_ORDER_CHUNK_HEADER_BYTES);
+static_assert(sizeof(MEOrderChunk) == ME_ORDER_CHUNK_BYTES);
+
+// a resting order's slot in the book, chunk index * ME_ORDERS_PER_CHUNK + slot in the chunk
+typedef uint32_t MEOrderHandle;
+constexpr auto MEOrderHandle_INVALID = std::numeric_limits<MEOrderHandle>::max();
+static_assert(ME_MAX_ORDER_IDS * ME_ORDERS_PER_CHUNK < MEOrderHandle_INVALID, "every slot needs a handle");
 
+// links the live orders of one client in a book, kept in an array beside the chunks so the links
+// don't take up room in the slots matching walks through
+struct MEClientOrderLink{
+    MEOrderHandle prev_;
+    MEOrderHandle next_;
+};
+
+// price levels are not linked to each other, MEOrderBook finds neighbouring levels through its occupancy bitmaps.
+// The level's open quantity and order count are kept up to date by every change to its orders, so depth can
+// be read without walking the chunks
 struct MEOrdersAtPrice{
     Side side_ = Side::INVALID;
+    uint32_t num_orders_ = 0;
     Price price_ = Price_INVALID;
-    MEOrder* first_me_order_ = nullptr;
-    MEOrdersAtPrice* prev_entry_ = nullptr;
-    MEOrdersAtPrice* next_entry_ = nullptr;
+    MEOrderChunkIndex first_chunk_ = MEOrderChunkIndex_INVALID;
+    MEOrderChunkIndex last_chunk_ = MEOrderChunkIndex_INVALID;
+    // sum of the open qty_ of the level's orders, wider than Qty so it can't overflow
+    uint64_t total_qty_ = 0;
 
     MEOrdersAtPrice() = default;
-    MEOrdersAtPrice(Side side, Price price, MEOrder* first_me_order, MEOrdersAtPrice* prev_entry, MEOrdersAtPrice* next_entry): 
-    side_(side), price_(price),first_me_order_(first_me_order), prev_entry_(prev_entry), next_entry_(next_entry){
+    MEOrdersAtPrice(Side side, Price price):
+    side_(side), price_(price){
 
     }
 
@@ -66,14 +121,31 @@ struct MEOrdersAtPrice{
         ss << "MEOrdersAtPrice["
         << "side: " << SideToString(side_) << " "
         << "price: " << PriceToString(price_) << " "
-        << "first_me_order: " << (first_me_order_ ? first_me_order_->ToString() : "null") << " "
-        << "prev: " << (prev_entry_ ? prev_entry_ -> price_ : Price_INVALID) << " "
-        << "next: " << (next_entry_ ? next_entry_ -> price_ : Price_INVALID) << "]";
+        << "qty: " << total_qty_ << " "
+        << "orders: " << num_orders_ << " "
+        << "first_chunk: " << first_chunk_ << " "
+        << "last_chunk: " << last_chunk_ << "]";
 
         return ss.str();
     }
 };
 
-typedef std::array<MEOrdersAtPrice*, ME_MAX_PRICE_LEVELS> OrdersAtPriceHashMap;
+static_assert(sizeof(MEOrdersAtPrice) == 32, "two levels per cache line");
+
+// one price level as seen from outside the book, Price_INVALID and 0s when the side has fewer levels
+struct MEBookLevel{
+    Price price_ = Price_INVALID;
+    uint64_t qty_ = 0;
+    uint32_t num_orders_ = 0;
+};
+
+// best bid and ask with their aggregates, read in O(1) from the book's best level pointers
+struct METopOfBook{
+    MEBookLevel bid_;
+    MEBookLevel ask_;
+};
+
+// one slot per price in the book's band, sized at runtime and allocated by the book
+typedef MEOrdersAtPrice** OrdersAtPriceHashMap;
 
-}
\ No newline at end of file
+}
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <bit>
 #include "../../common/types.h"
 #include "../../common/mem_pool.h"
 #include "../../common/logging.h"
+#include "../../common/hierarchical_bitmap.h"
+#include "../../common/arena.h"
 #include "../order_server/client_response.h"
 #include "../market_data/market_update.h"
 #include "matching_engine.h"
 #include "me_order.h"
+#include "me_client_order_index.h"
 
 using namespace Common;
 
@@ -15,24 +19,42 @@ Limit Order book data members:
 1. A matching_engine_ pointer variable to the MatchingEngine parent for the orderbook to publish
    order responses and market data updates to
 
-2. The ClientOrderHashMap variable, cid_oid_to_order_, to track the OrderHashMap objects by their ClientId key.
-   As a reminder, OrderHashMap tracks the MEOrder objects by their OrderId keys.
+2. The ClientOrderIndex variable, cid_oid_to_order_, an open-addressing hash map from (ClientId, OrderId)
+   to the live MEOrder, sized by the number of orders the book can hold.
 
 3. The orders_at_price_pool_ memory pool variable of the MEOrdersAtPrice objects to create
    new objects from and return dead objects back to.
 
-4. The head of the doubly linked list of bids (bids_by_price_) and asks (asks_by_price_), since we track orders
-   at the price level as a list of MEOrdersAtPrice objects.
+4. The best bid (bids_by_price_) and best ask (asks_by_price_) MEOrdersAtPrice levels. Every level keeps its
+   open quantity and order count as orders are added, filled and removed, so GetTopOfBook() and GetDepth()
+   never walk a level's orders.
 
 5. A hashmap, OrdersAtPriceHashmap, to track the MEOrdersAtPrice objects for the price levels, using the price 
-   of the level as a key into the map.
-
-6. A memory pool of the MEOrder objects, called order_pool_, where MEOrder objects are created from and returned 
-   to without incurring dynamic memory allocations.
-
-7. Some minor members, such as TickerId for the instrument for this order book, OrderId to track the next 
+   of the level as a key into the map, and one HierarchicalBitmap per side (bid_levels_, ask_levels_) marking
+   which slots hold a level. The next best level after the touch is removed is found with bit scans over the
+   bitmap, so adding, removing and advancing levels costs the same at any book depth.
+   The map has one slot per price in a power-of-two band [base_price_, base_price_ + price_band_) and a price's
+   slot is its low bits, so no two prices in the band share a slot. Every live level is kept inside the band;
+   when a new level falls outside it the band is re-centered over the live levels by moving base_price_ only,
+   the slots form a ring and nothing is copied.
+
+6. A memory pool of MEOrderChunk objects, called order_chunk_pool_, holding the resting orders of each level
+   in time priority. A level links its chunks by their 32-bit index in the pool, and the orders in a chunk
+   sit side by side, so matching a level streams through memory without dynamic memory allocations.
+
+7. Per-client lists of live orders, client_orders_ holds the first order of every client and
+   client_order_links_ the links for every slot of the chunk pool, so MassCancel() visits only the
+   client's own orders instead of scanning cid_oid_to_order_. The link array is left uninitialized
+   like the chunk pool and only commits memory for slots that held an order.
+
+8. Capacity comes from the ticker's METickerInfo: max_orders sizes the chunk pool, the link array and the
+   client order index, price_band the level pool, map and bitmaps. With an Arena the level and chunk pools,
+   the level map and bitmaps, the links and the index are carved from it instead of the heap, its pages are zero
+   and only committed once touched.
+
+9. Some minor members, such as TickerId for the instrument for this order book, OrderId to track the next 
    market data order ID, an MEClientResponse variable (client_response_), an MEMarketUpdate object 
-   (market_update_), a string to log time, and the Logger object for logging purposes.
+   (market_update_), and the Logger object for logging purposes.
 */
 
 namespace Exchange{
@@ -42,35 +64,65 @@ class MEOrderBook final{
 private:
     TickerId ticker_id_ = TickerId_INVALID;
     MatchingEngine* matching_engine_ = nullptr;
-    ClientOrderHashmap cid_oid_to_order_;
+    // resting orders the book has room for
+    const size_t max_orders_ = ME_MAX_ORDER_IDS;
+    ClientOrderIndex cid_oid_to_order_;
+    size_t price_band_ = 0;
+    uint64_t price_mask_ = 0;
+    Price base_price_ = 0;
+    size_t rebase_count_ = 0;
     OrdersAtPriceHashMap price_orders_at_price_;
-    MemPool<MEOrdersAtPrice> orders_at_price_pool_;
+    HierarchicalBitmap bid_levels_;
+    HierarchicalBitmap ask_levels_;
+    FreeListMemPool<MEOrdersAtPrice> orders_at_price_pool_;
     MEOrdersAtPrice* bids_by_price_ = nullptr;
     MEOrdersAtPrice* asks_by_price_ = nullptr;
-    MemPool<MEOrder> order_pool_;
+    FreeListMemPool<MEOrderChunk> order_chunk_pool_;
+    MEClientOrderLink* client_order_links_ = nullptr;
+    // the level map and the client order links come from the heap when the book has no arena
+    const bool owns_storage_ = true;
+    std::array<MEOrderHandle, ME_MAX_NUM_CLIENTS> client_orders_;
     OrderId next_market_order_id_ = 1;
     MEClientResponse client_response_;
     MEMarketUpdate market_update_;
-    std::string time_str_;
     Logger* logger_ = nullptr;
 
 public:
-    // Constructor
-    MEOrderBook(TickerId ticker_id, Logger* logger, Exchange::MatchingEngine* matching_engine): 
-                ticker_id_(ticker_id), logger_(logger), matching_engine_(matching_engine),
-                orders_at_price_pool_(ME_MAX_PRICE_LEVELS), order_pool_(ME_MAX_ORDER_IDS){
-        
+    // Constructor, price_band is the number of distinct prices the book can hold levels for at once
+    // and is rounded up to a power of two, max_orders the number of resting orders it can hold.
+    // The order storage comes from arena when one is given, the arena has to outlive the book
+    MEOrderBook(TickerId ticker_id, Logger* logger, Exchange::MatchingEngine* matching_engine, size_t price_band = ME_MAX_PRICE_LEVELS,
+                size_t max_orders = ME_MAX_ORDER_IDS, Arena* arena = nullptr): 
+                ticker_id_(ticker_id), matching_engine_(matching_engine), max_orders_(max_orders),
+                cid_oid_to_order_(max_orders, ArenaStorage(arena, ClientOrderIndex::StorageBytes(max_orders), ClientOrderIndex::StorageAlignment())),
+                price_band_(std::bit_ceil(price_band)), price_mask_(price_band_ - 1), price_orders_at_price_(arena ? static_cast<MEOrdersAtPrice**>(arena->Allocate(price_band_ * sizeof(MEOrdersAtPrice*), alignof(MEOrdersAtPrice*)))
+                                             : new MEOrdersAtPrice*[price_band_]()),
+                bid_levels_(price_band_, ArenaStorage(arena, HierarchicalBitmap::StorageBytes(price_band_), HierarchicalBitmap::StorageAlignment())),
+                ask_levels_(price_band_, ArenaStorage(arena, HierarchicalBitmap::StorageBytes(price_band_), HierarchicalBitmap::StorageAlignment())),
+                orders_at_price_pool_(price_band_, ArenaStorage(arena, FreeListMemPool<MEOrdersAtPrice>::StorageBytes(price_band_),
+                                                                FreeListMemPool<MEOrdersAtPrice>::StorageAlignment())),
+                order_chunk_pool_(max_orders, ArenaStorage(arena, FreeListMemPool<MEOrderChunk>::StorageBytes(max_orders),
+                                                           FreeListMemPool<MEOrderChunk>::StorageAlignment())),
+                client_order_links_(arena ? static_cast<MEClientOrderLink*>(arena->Allocate(max_orders * ME_ORDERS_PER_CHUNK * sizeof(MEClientOrderLink), alignof(MEClientOrderLink)))
+                                          : new MEClientOrderLink[max_orders * ME_ORDERS_PER_CHUNK]),
+                owns_storage_(!arena), logger_(logger){
+      ASSERT(max_orders >= 1 && max_orders <= ME_MAX_ORDER_IDS, "Order book capacity must be 1-" + std::to_string(ME_MAX_ORDER_IDS) + " orders");
+      client_orders_.fill(MEOrderHandle_INVALID);
     }
 
-    MEOrderBook::~MEOrderBook(){
-        logger_->Log("%:% %() % OrderBook\n%\n", __FILE__, __LINE__, __FUNCTION__, 
-                    Common::GetCurrentTimeStr(&time_str_), ToString(false, true));
+    ~MEOrderBook(){
+        logger_->Log<"%:% %() % OrderBook\n%\n">(__FILE__, __LINE__, __FUNCTION__, 
+                    Common::LogTime{}, ToString(false, true));
         matching_engine_ = nullptr;
         bids_by_price_ = nullptr;
         asks_by_price_ = nullptr;
-        for(auto &itr : cid_oid_to_order_){
-            itr.fill(nullptr);
+        cid_oid_to_order_.Clear();
+        if(owns_storage_){
+            delete[] price_orders_at_price_;
+            delete[] client_order_links_;
         }
+        price_orders_at_price_ = nullptr;
+        client_order_links_ = nullptr;
     }
 
     // deleted copy constructor, move constructor and assignment operators
@@ -80,116 +132,252 @@ public:
     MEOrderBook& operator=(const MEOrderBook&) = delete;
     MEOrderBook& operator=(const MEOrderBook&&) = delete;
 
+   static auto ArenaStorage(Arena* arena, size_t bytes, size_t alignment) -> void*{
+      return (arena ? arena->Allocate(bytes, alignment) : nullptr);
+   }
+
    // return the next market order id
    auto GenerateNewMarketOrderId() noexcept -> OrderId{
-      return next_market_order_id_;
+      return next_market_order_id_++;
+   }
+
+   auto GetRebaseCount() const noexcept{
+      return rebase_count_;
+   }
+
+   // bytes of order storage committed so far, the chunk pool never shrinks
+   auto GetOrderStorageBytes() const noexcept{
+      return order_chunk_pool_.HighWaterMark() * sizeof(MEOrderChunk);
    }
 
-   // converts a price to an index that ranges between 0 and ME_MAX_PRICE_LEVELS-1
-   // used to index the prices levels std::array
+   // live objects in each pool, for the stats segment
+   auto GetLevelsInUse() const noexcept{
+      return orders_at_price_pool_.InUse();
+   }
+
+   auto GetOrderChunksInUse() const noexcept{
+      return order_chunk_pool_.InUse();
+   }
+
+   // converts a price to an index that ranges between 0 and price_band_-1
+   // used to index the prices levels vector
    auto PriceToIndex(Price price) const noexcept{
-      return (price % ME_MAX_PRICE_LEVELS);
+      return static_cast<size_t>(static_cast<uint64_t>(price) & price_mask_);
    }
 
+   // unsigned difference so prices below base_price_ and Price_INVALID fall outside too
+   auto InBand(Price price) const noexcept{
+      return (static_cast<uint64_t>(price) - static_cast<uint64_t>(base_price_)) < price_band_;
+   }
+
+   // prices outside the band can't have a level, their slot belongs to a price inside it
    auto GetOrdersAtPrice(Price price) const noexcept -> MEOrdersAtPrice*{
-      return price_orders_at_price_.at(PriceToIndex(price));
+      return InBand(price) ? price_orders_at_price_[PriceToIndex(price)] : nullptr;
    }
 
-      // adds order to the book
-   auto AddOrder(MEOrder* order) noexcept{
-      const auto orders_at_price = GetOrdersAtPrice(order->price_);
-      if(!orders_at_price){
-         order->next_order_ = order->prev_order_ = order;
-         auto new_orders_at_price = orders_at_price_pool_.Allocate(order->side_, order->price_, order, nullptr, nullptr);
-         AddOrdersAtPrice(new_orders_at_price);
+   // what differs between the two sides, resolved at compile time so the matching and level paths
+   // below are instantiated once per side and carry no side checks. Bids get better upwards, asks downwards
+   static constexpr auto OppositeSide(Side side) noexcept{
+      return (side == Side::BUY ? Side::SELL : Side::BUY);
+   }
+
+   // whether price is better than other for an order on side S
+   template<Side S>
+   static constexpr auto IsBetter(Price price, Price other) noexcept{
+      if constexpr(S == Side::BUY){
+         return price > other;
       }else{
-         auto first_order = (orders_at_price ? orders_at_price->first_me_order_ : nullptr);
-         first_order->prev_order_ = first_order->next_order_ = order;
-         order->prev_order_ = first_order->prev_order_;
-         order->next_order_ = first_order;
-         first_order->prev_order_ = order;
+         return price < other;
       }
+   }
 
-      cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = order;
+   template<Side S>
+   auto Levels() noexcept -> HierarchicalBitmap&{
+      if constexpr(S == Side::BUY){
+         return bid_levels_;
+      }else{
+         return ask_levels_;
+      }
    }
 
-   auto AddOrdersAtPrice(MEOrdersAtPrice* new_orders_at_price) noexcept {
-      price_orders_at_price_.at(PriceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
-      // get best bids and best asks for either side that's associated with our MEOrdersAtPrice object
-      const auto best_orders_by_price = (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_);
-
-      // need to handle edge cased where bids or asks are empty
-      // then we need to set the bids_by_price_ or asks_by_price_ ourselves
-      // which points to the head of the sorted list for it's side
-      if(UNLIKELY(!best_orders_by_price)){
-         (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
-         new_orders_at_price->prev_entry_ = new_orders_at_price->next_entry_ = new_orders_at_price;
+   template<Side S>
+   auto BestLevel() noexcept -> MEOrdersAtPrice*&{
+      if constexpr(S == Side::BUY){
+         return bids_by_price_;
       }else{
-         // now we have a list of orders and need to find the correct entry in teh linked list of price levels
-         // so we will walk through the bids or asks till we find the correct price level and then we will insert
-         // we will use a boolean "add_after" to determine if we should insert before or after the target
-         // price level
-         auto target = best_orders_by_price;
-         bool add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) 
-                           || (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-         if(add_after){
-            target = target->next_entry_;
-            add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_)
-                           || (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-         }
+         return asks_by_price_;
+      }
+   }
 
-         while(add_after && target != best_orders_by_price){
-            add_after = ((new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ > target->price_) 
-                           || (new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ < target->price_));
-            if(add_after){
-               target = target->next_entry_;
-            }
+   // the first occupied slot of side S at or beyond index moving away from the touch, slots form a ring
+   // (price modulo price_band_), so the scan wraps around the end of the bitmap
+   template<Side S>
+   auto NextLevelIndex(size_t index) noexcept{
+      if constexpr(S == Side::BUY){
+         return bid_levels_.FindPrevWrapping(index);
+      }else{
+         return ask_levels_.FindNextWrapping(index);
+      }
+   }
+
+   // moves the band so that it covers price as well as every live level, centering it over them.
+   // Only base_price_ changes, returns false if they span more prices than the band holds
+   auto Rebase(Price price) noexcept -> bool{
+      auto low = price, high = price;
+      // live levels are all inside the band, so scanning the ring from the slot of base_price_
+      // upwards (or from the top of the band downwards) reaches the lowest (highest) price first
+      const auto base_index = PriceToIndex(base_price_);
+      const auto top_index = PriceToIndex(base_price_ + static_cast<Price>(price_mask_));
+      for(const auto levels : {&bid_levels_, &ask_levels_}){
+         if(!levels->Empty()){
+            low = std::min(low, price_orders_at_price_[levels->FindNextWrapping(base_index)]->price_);
+            high = std::max(high, price_orders_at_price_[levels->FindPrevWrapping(top_index)]->price_);
          }
+      }
+      const auto span = static_cast<uint64_t>(high) - static_cast<uint64_t>(low);
+      if(UNLIKELY(span >= price_band_)){
+         return false;
+      }
+      base_price_ = low - static_cast<Price>((price_band_ - 1 - span) / 2);
+      ++rebase_count_;
+      return true;
+   }
 
-         // Need to append the new price level by updating the prev_entry_ or next_entry variables
-         // add new_orders_at_price after target.
-         if(add_after){
-            if(target == best_orders_by_price){
-               target = best_orders_by_price->prev_entry_;
-            }
-            new_orders_at_price->prev_entry_ = target;
-            target->next_entry_->prev_entry_ = new_orders_at_price;
-            new_orders_at_price->next_entry_ = target->next_entry_;
-            target->next_entry_ = new_orders_at_price;
-         }else{
-            // add new_orders_at_price before target
-            new_orders_at_price->prev_entry_ = target->prev_entry_;
-            new_orders_at_price->next_entry_ = target;
-            target->prev_entry_->next_entry_ = new_orders_at_price;
-            target->prev_entry_ = new_orders_at_price;
-
-            // Need to check if this price level is now best bid/best ask
-            if((new_orders_at_price->side_ == Side::BUY && new_orders_at_price->price_ > best_orders_by_price->price_)
-                  || (new_orders_at_price->side_ == Side::SELL && new_orders_at_price->price_ < best_orders_by_price->price_)){
-               
-               target->next_entry_ = (target->next_entry_ == best_orders_by_price ? new_orders_at_price : target->next_entry_);
-               (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_) = new_orders_at_price;
-            
-            }
+   auto HandleOf(const MEOrder* order) const noexcept -> MEOrderHandle{
+      const auto chunk = MEOrderChunk::Of(order);
+      return static_cast<MEOrderHandle>(order_chunk_pool_.IndexOf(chunk) * ME_ORDERS_PER_CHUNK + (order - chunk->orders_));
+   }
+
+   auto OrderAt(MEOrderHandle handle) const noexcept -> MEOrder*{
+      return &order_chunk_pool_.ObjectAt(handle / ME_ORDERS_PER_CHUNK)->orders_[handle % ME_ORDERS_PER_CHUNK];
+   }
+
+   // pushes the order on the front of its client's list
+   auto LinkClientOrder(const MEOrder* order) noexcept -> void{
+      const auto handle = HandleOf(order);
+      auto& head = client_orders_[order->client_id_];
+      client_order_links_[handle] = {MEOrderHandle_INVALID, head};
+      if(head != MEOrderHandle_INVALID){
+         client_order_links_[head].prev_ = handle;
+      }
+      head = handle;
+   }
+
+   auto UnlinkClientOrder(const MEOrder* order) noexcept -> void{
+      const auto& link = client_order_links_[HandleOf(order)];
+      (link.prev_ == MEOrderHandle_INVALID ? client_orders_[order->client_id_] : client_order_links_[link.prev_].next_) = link.next_;
+      if(link.next_ != MEOrderHandle_INVALID){
+         client_order_links_[link.next_].prev_ = link.prev_;
+      }
+   }
+
+   static auto ToBookLevel(const MEOrdersAtPrice* orders_at_price) noexcept -> MEBookLevel{
+      return (orders_at_price ? MEBookLevel{orders_at_price->price_, orders_at_price->total_qty_, orders_at_price->num_orders_} : MEBookLevel{});
+   }
+
+   auto GetTopOfBook() const noexcept -> METopOfBook{
+      return {ToBookLevel(bids_by_price_), ToBookLevel(asks_by_price_)};
+   }
+
+   // writes up to max_levels levels of side, best first, and returns how many it wrote.
+   // One bit scan per level, no order is visited
+   auto GetDepth(Side side, MEBookLevel* levels, size_t max_levels) const noexcept -> size_t{
+      const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+      const auto& occupied = (side == Side::BUY ? bid_levels_ : ask_levels_);
+      size_t num_levels = 0;
+      for(auto itr = best_orders_by_price; itr && num_levels < max_levels;){
+         levels[num_levels++] = ToBookLevel(itr);
+         const auto index = PriceToIndex(itr->price_);
+         itr = price_orders_at_price_[side == Side::BUY ? occupied.FindPrevWrapping(index - 1) : occupied.FindNextWrapping(index + 1)];
+         if(itr == best_orders_by_price){
+            break;
          }
       }
+      return num_levels;
+   }
+
+   // oldest order at a level, the first chunk always starts with a live order
+   auto GetFirstOrder(const MEOrdersAtPrice* orders_at_price) const noexcept -> MEOrder*{
+      const auto chunk = order_chunk_pool_.ObjectAt(orders_at_price->first_chunk_);
+      return &chunk->orders_[chunk->begin_];
+   }
+
+   // adds order to the back of its level's FIFO, creating the level if needed
+   template<Side S>
+   auto AddOrder(Price price, const MEOrder& new_order) noexcept -> MEOrder*{
+      auto orders_at_price = GetOrdersAtPrice(price);
+      if(!orders_at_price){
+         orders_at_price = orders_at_price_pool_.Allocate(S, price);
+         AddOrdersAtPrice<S>(orders_at_price);
+      }
+
+      auto chunk = (orders_at_price->last_chunk_ == MEOrderChunkIndex_INVALID ? nullptr : order_chunk_pool_.ObjectAt(orders_at_price->last_chunk_));
+      if(!chunk || chunk->end_ == ME_ORDERS_PER_CHUNK){
+         const auto prev_chunk = orders_at_price->last_chunk_;
+         chunk = order_chunk_pool_.Allocate(orders_at_price, prev_chunk);
+         const auto chunk_index = static_cast<MEOrderChunkIndex>(order_chunk_pool_.IndexOf(chunk));
+         (prev_chunk == MEOrderChunkIndex_INVALID ? orders_at_price->first_chunk_ : order_chunk_pool_.ObjectAt(prev_chunk)->next_chunk_) = chunk_index;
+         orders_at_price->last_chunk_ = chunk_index;
+      }
+
+      auto order = &chunk->orders_[chunk->end_++];
+      *order = new_order;
+      ++chunk->num_orders_;
+      orders_at_price->total_qty_ += order->qty_;
+      ++orders_at_price->num_orders_;
+      cid_oid_to_order_.Insert(order->client_id_, order->client_order_id_, order);
+      LinkClientOrder(order);
+      return order;
+   }
 
+   // registers a new price level. Levels are found through the per-side occupancy bitmaps instead of
+   // a sorted list, so this only has to check whether the new level is the new best price for its side
+   template<Side S>
+   auto AddOrdersAtPrice(MEOrdersAtPrice* new_orders_at_price) noexcept -> void{
+      const auto index = PriceToIndex(new_orders_at_price->price_);
+      price_orders_at_price_[index] = new_orders_at_price;
+      Levels<S>().Set(index);
+
+      auto& best_orders_by_price = BestLevel<S>();
+      if(!best_orders_by_price || IsBetter<S>(new_orders_at_price->price_, best_orders_by_price->price_)){
+         best_orders_by_price = new_orders_at_price;
+      }
    }
 
    // get priority value by checking if there are orders at a price level
-   // and returning the last order at a price level's priority + 1
-   auto GetNextPriority(TickerId ticker_id, Price price){
+   // and returning the last order at a price level's priority + 1, a removed order's
+   // slot keeps its priority so priorities at a level keep increasing
+   auto GetNextPriority(Price price) noexcept -> Priority{
       const auto orders_at_price = GetOrdersAtPrice(price);
       if(!orders_at_price){
          return 1lu;
-      return orders_at_price->first_me_order_->prev_order_->priority_ + 1;
       }
+      const auto last_chunk = order_chunk_pool_.ObjectAt(orders_at_price->last_chunk_);
+      return last_chunk->orders_[last_chunk->end_ - 1].priority_ + 1;
    }
 
-    // Add()
+    // Add(), picks the side's instantiation once, the order server only forwards BUY and SELL orders
    auto Add(ClientId client_id, OrderId client_order_id, 
             TickerId ticker_id, Side side, 
             Price price, Qty qty) noexcept -> void{
+      // a client order id names one live order of the client, reusing it would leave the first order
+      // in the book where it can't be canceled, and ids the index can't hold are refused the same way
+      if(UNLIKELY(!ClientOrderIndex::IsValidKey(client_id, client_order_id) || cid_oid_to_order_.Find(client_id, client_order_id))){
+         client_response_ = {ClientResponseType::NEW_REJECTED, client_id, ticker_id, client_order_id,
+                             OrderId_INVALID, side, price, Qty_INVALID, qty};
+         matching_engine_->SendClientResponse(&client_response_);
+         return;
+      }
+      if(side == Side::BUY){
+         Add<Side::BUY>(client_id, client_order_id, ticker_id, price, qty);
+      }else{
+         Add<Side::SELL>(client_id, client_order_id, ticker_id, price, qty);
+      }
+   }
+
+   template<Side S>
+   auto Add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Price price, Qty qty) noexcept -> void{
+      constexpr auto side = S;
       // set client_response attributes
       const auto new_market_order_id = GenerateNewMarketOrderId();
       client_response_ = {ClientResponseType::ACCEPTED, client_id, ticker_id, client_order_id, 
@@ -198,17 +386,21 @@ public:
       matching_engine_->SendClientResponse(&client_response_);
 
       // check if order has matches with passive orders in orderbook
-      const auto leaves_qty = CheckForMatch(client_id, client_order_id, ticker_id, side, price, qty, new_market_order_id);
+      const auto leaves_qty = CheckForMatch<S>(client_id, client_order_id, ticker_id, price, qty, new_market_order_id);
 
       if(LIKELY(leaves_qty)){
-         const auto priority = GetNextPriority(ticker_id, price);
-         // create new order based on MEOrder Constructor and allocate it
-         // from order_pool
-         auto order = order_pool_.Allocate(ticker_id, client_id, client_order_id,
-                                           new_market_order_id, side, price, leaves_qty,
-                                           priority, nullptr, nullptr);
-         // add order to book
-         AddOrder(order);
+         // a new level outside the band needs the band moved first, if the book is too wide
+         // for that, or already holds max_orders_ orders, the remainder can't rest and is
+         // canceled back to the client
+         if(UNLIKELY(cid_oid_to_order_.Size() == max_orders_ || (!InBand(price) && !Rebase(price)))){
+            client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, client_order_id,
+                                new_market_order_id, side, price, Qty_INVALID, leaves_qty};
+            matching_engine_->SendClientResponse(&client_response_);
+            return;
+         }
+         const auto priority = GetNextPriority(price);
+         // add order to book in the next free slot of its level
+         AddOrder<S>(price, MEOrder(client_id, client_order_id, new_market_order_id, leaves_qty, priority));
           // create new market update
          market_update_ = {MarketUpdateType::ADD, client_response_.market_order_id_,
                                           ticker_id, side, price, leaves_qty, priority};
@@ -218,15 +410,10 @@ public:
 
    // Cancel()
    auto Cancel(ClientId client_id, OrderId order_id, TickerId ticker_id) noexcept -> void{
-      // checking that the client_id is valid
-      auto is_cancelable = (client_id < cid_oid_to_order_.size());
-      MEOrder* exchange_order = nullptr;
-      // checking that the order_id specified exists in the orderbook and belongs to the client_id
-      if(LIKELY(is_cancelable)){
-         auto& co_itr = cid_oid_to_order_.at(client_id);
-         exchange_order = co_itr.at(order_id);
-         is_cancelable = (exchange_order != nullptr);
-      }
+      // checking that the order_id specified exists in the orderbook and belongs to the client_id,
+      // out of range ids are simply not found
+      auto exchange_order = cid_oid_to_order_.Find(client_id, order_id);
+      const auto is_cancelable = (exchange_order != nullptr);
 
       // if we don't find the order or it doesn't belong to the client, send a Cancel_Reject
       // back to the client
@@ -234,125 +421,285 @@ public:
          client_response_ = {ClientResponseType::CANCEL_REJECTED, client_id, ticker_id, order_id,
                              OrderId_INVALID, Side::INVALID, Price_INVALID, Qty_INVALID, Qty_INVALID};
       }else{
+         const auto orders_at_price = MEOrderChunk::Of(exchange_order)->orders_at_price_;
          client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, order_id,
-                             exchange_order->market_order_id_, exchange_order->side_, 
-                             exchange_order->price_, Qty_INVALID, exchange_order->qty_};
+                             exchange_order->market_order_id_, orders_at_price->side_, 
+                             orders_at_price->price_, Qty_INVALID, exchange_order->qty_};
          market_update_ = {MarketUpdateType::CANCEL, exchange_order->market_order_id_, ticker_id,
-                           exchange_order->side_, exchange_order->price_, 0, exchange_order->priority_};
+                           orders_at_price->side_, orders_at_price->price_, 0, exchange_order->priority_};
          RemoveOrder(exchange_order);
          matching_engine_->SendMarketUpdate(&market_update_);
       }
       matching_engine_->SendClientResponse(&client_response_);
     }
 
-    auto RemoveOrder(MEOrder* order) noexcept -> void{
-      auto orders_at_price = GetOrdersAtPrice(order->price_);
-
-      // only one element
-      if(order->prev_order_ == order){ 
-         RemoveOrdersAtPrice(order->side_, order->price_);
+   // Replace(), changes the price and/or open quantity of a resting order and keeps its client and market
+   // order ids. A smaller quantity at the same price is amended in place and keeps the order's queue
+   // priority, anything else takes the order out of its level and sends it through matching again at
+   // the new price, so it can trade, and the remainder joins the back of the new level. Either way the
+   // market sees one MODIFY carrying the order's price, quantity and priority, or a CANCEL if the
+   // replaced order traded away completely or could not rest
+   auto Replace(ClientId client_id, OrderId order_id, TickerId ticker_id, Side side, Price price, Qty qty) noexcept -> void{
+      auto exchange_order = cid_oid_to_order_.Find(client_id, order_id);
+      const auto old_orders_at_price = (exchange_order ? MEOrderChunk::Of(exchange_order)->orders_at_price_ : nullptr);
+      // the side can't change and a quantity of 0 is a cancel
+      if(UNLIKELY(!exchange_order || old_orders_at_price->side_ != side || !qty || qty == Qty_INVALID || price == Price_INVALID)){
+         client_response_ = {ClientResponseType::REPLACE_REJECTED, client_id, ticker_id, order_id,
+                             OrderId_INVALID, side, price, Qty_INVALID, Qty_INVALID};
+         matching_engine_->SendClientResponse(&client_response_);
+         return;
+      }
+      if(side == Side::BUY){
+         Replace<Side::BUY>(exchange_order, client_id, order_id, ticker_id, price, qty);
       }else{
-         const auto order_before = order->prev_order_;
-         const auto order_after = order->next_order_;
-         order_before->next_order_ = order_after;
-         order_after->prev_order_ = order_before;
-         if(orders_at_price->first_me_order_ == order){
-            orders_at_price->first_me_order_ = order_after;
-         }
-         order->prev_order_ = order->next_order_ = nullptr;
+         Replace<Side::SELL>(exchange_order, client_id, order_id, ticker_id, price, qty);
       }
+   }
 
-      cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = nullptr;
-      order_pool_.Deallocate(order);
-    }
+   // replaces exchange_order, a live order of side S
+   template<Side S>
+   auto Replace(MEOrder* exchange_order, ClientId client_id, OrderId order_id, TickerId ticker_id, Price price, Qty qty) noexcept -> void{
+      constexpr auto side = S;
+      const auto old_orders_at_price = MEOrderChunk::Of(exchange_order)->orders_at_price_;
+      const auto market_order_id = exchange_order->market_order_id_;
+      client_response_ = {ClientResponseType::REPLACED, client_id, ticker_id, order_id,
+                          market_order_id, side, price, 0, qty};
+      matching_engine_->SendClientResponse(&client_response_);
 
-    auto RemoveOrdersAtPrice(Side side, Price price) noexcept{
-      const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
-      auto orders_at_price = GetOrdersAtPrice(price);
-      if(UNLIKELY(orders_at_price->next_entry_ == orders_at_price)){
-         (side == Side::BUY ? bids_by_price_ : asks_by_price_) = nullptr;
-      }else{
-         orders_at_price->prev_entry_->next_entry_ = orders_at_price->next_entry_;
-         orders_at_price->next_entry_->prev_entry_ = orders_at_price->prev_entry_;
+      if(price == old_orders_at_price->price_ && qty <= exchange_order->qty_){
+         old_orders_at_price->total_qty_ -= exchange_order->qty_ - qty;
+         exchange_order->qty_ = qty;
+         market_update_ = {MarketUpdateType::MODIFY, market_order_id, ticker_id, side, price, qty, exchange_order->priority_};
+         matching_engine_->SendMarketUpdate(&market_update_);
+         return;
+      }
+
+      const auto old_price = old_orders_at_price->price_;
+      RemoveOrder<S>(exchange_order);
+      const auto leaves_qty = CheckForMatch<S>(client_id, order_id, ticker_id, price, qty, market_order_id);
+      if(UNLIKELY(!leaves_qty)){
+         market_update_ = {MarketUpdateType::CANCEL, market_order_id, ticker_id, side, old_price, 0, Priority_INVALID};
+         matching_engine_->SendMarketUpdate(&market_update_);
+         return;
+      }
+      if(UNLIKELY(!InBand(price) && !Rebase(price))){
+         client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, order_id,
+                             market_order_id, side, price, Qty_INVALID, leaves_qty};
+         matching_engine_->SendClientResponse(&client_response_);
+         market_update_ = {MarketUpdateType::CANCEL, market_order_id, ticker_id, side, old_price, 0, Priority_INVALID};
+         matching_engine_->SendMarketUpdate(&market_update_);
+         return;
+      }
+      const auto priority = GetNextPriority(price);
+      AddOrder<S>(price, MEOrder(client_id, order_id, market_order_id, leaves_qty, priority));
+      market_update_ = {MarketUpdateType::MODIFY, market_order_id, ticker_id, side, price, leaves_qty, priority};
+      matching_engine_->SendMarketUpdate(&market_update_);
+   }
 
-         if(orders_at_price == best_orders_by_price){
-            (side == Side::BUY ? bids_by_price_ : asks_by_price_) = orders_at_price->next_entry_;
+   // MassCancel(), cancels every live order of the client in this book, or only those on side unless it is
+   // Side::INVALID. Walks the client's own list, so the cost follows the client's live orders and not the
+   // size of the book. Each order gets a CANCELED response and a CANCEL market update, the caller publishes
+   // them together. Returns the number of orders canceled
+   auto MassCancel(ClientId client_id, TickerId ticker_id, Side side) noexcept -> size_t{
+      if(UNLIKELY(client_id >= ME_MAX_NUM_CLIENTS)){
+         return 0;
+      }
+      size_t canceled = 0;
+      for(auto handle = client_orders_[client_id]; handle != MEOrderHandle_INVALID;){
+         const auto order = OrderAt(handle);
+         // read before RemoveOrder() unlinks the order
+         handle = client_order_links_[handle].next_;
+         const auto orders_at_price = MEOrderChunk::Of(order)->orders_at_price_;
+         if(side != Side::INVALID && orders_at_price->side_ != side){
+            continue;
          }
-         orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr; 
+         client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, order->client_order_id_,
+                             order->market_order_id_, orders_at_price->side_,
+                             orders_at_price->price_, Qty_INVALID, order->qty_};
+         matching_engine_->SendClientResponse(&client_response_);
+         market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, ticker_id,
+                           orders_at_price->side_, orders_at_price->price_, 0, order->priority_};
+         matching_engine_->SendMarketUpdate(&market_update_);
+         RemoveOrder(order);
+         ++canceled;
+      }
+      return canceled;
+   }
+
+    // for callers that don't know the order's side, dispatches on its level's side once
+    auto RemoveOrder(MEOrder* order) noexcept -> void{
+      if(MEOrderChunk::Of(order)->orders_at_price_->side_ == Side::BUY){
+         RemoveOrder<Side::BUY>(order);
+      }else{
+         RemoveOrder<Side::SELL>(order);
       }
-      price_orders_at_price_.at(PriceToIndex(price)) = nullptr;
-      orders_at_price_pool_.Deallocate(orders_at_price);
     }
 
-    auto CheckForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, 
-                        Qty qty, Qty new_market_order_id) noexcept{
-      auto leaves_qty = qty;
+    // empties the order's slot, releasing its chunk once the chunk has no orders left and
+    // the level once it has no chunks left. order rests on side S
+    template<Side S>
+    auto RemoveOrder(MEOrder* order) noexcept -> void{
+      cid_oid_to_order_.Erase(order->client_id_, order->client_order_id_);
+      UnlinkClientOrder(order);
+      auto chunk = MEOrderChunk::Of(order);
+      auto orders_at_price = chunk->orders_at_price_;
+      orders_at_price->total_qty_ -= order->qty_;
+      --orders_at_price->num_orders_;
+      order->qty_ = 0;
+
+      if(LIKELY(--chunk->num_orders_)){
+         // keep begin_ on a live order, every slot is skipped at most once
+         while(!chunk->orders_[chunk->begin_].qty_){
+            ++chunk->begin_;
+         }
+         return;
+      }
 
-      // keep matching through the OrdersAtPrice LinkedList and taking out orders at each price level
-      // as long as the client order quantity > 0 and there are still price levels that the client 
-      // order crosses
+      (chunk->prev_chunk_ == MEOrderChunkIndex_INVALID ? orders_at_price->first_chunk_ : order_chunk_pool_.ObjectAt(chunk->prev_chunk_)->next_chunk_) = chunk->next_chunk_;
+      (chunk->next_chunk_ == MEOrderChunkIndex_INVALID ? orders_at_price->last_chunk_ : order_chunk_pool_.ObjectAt(chunk->next_chunk_)->prev_chunk_) = chunk->prev_chunk_;
+      order_chunk_pool_.Deallocate(chunk);
 
-      if(side == Side::BUY){
-         while(leaves_qty && asks_by_price_){
-            const auto ask_itr = asks_by_price_->first_me_order_;
-            if(LIKELY(price < ask_itr->price_)){
-               break;
-            }
-            match(ticker_id, client_id, side, client_order_id, new_market_order_id, ask_itr, &leaves_qty);
-         }
+      if(orders_at_price->first_chunk_ == MEOrderChunkIndex_INVALID){
+         RemoveOrdersAtPrice<S>(orders_at_price);
       }
+    }
 
-      if(side == Side::SELL){
-         while(leaves_qty && bids_by_price_){
-            const auto bid_itr = bids_by_price_->first_me_order_;
-            if(LIKELY(price > bid_itr->price_)){
-               break;
-            }
-            match(ticker_id, client_id, side, client_order_id, new_market_order_id, bid_itr, &leaves_qty);
-         }
+    template<Side S>
+    auto RemoveOrdersAtPrice(MEOrdersAtPrice* orders_at_price) noexcept -> void{
+      const auto index = PriceToIndex(orders_at_price->price_);
+      Levels<S>().Clear(index);
+      price_orders_at_price_[index] = nullptr;
+
+      // the next best level is the next occupied slot moving away from the touch
+      auto& best_orders_by_price = BestLevel<S>();
+      if(orders_at_price == best_orders_by_price){
+         const auto next_index = NextLevelIndex<S>(index);
+         best_orders_by_price = (next_index == HierarchicalBitmap::NPOS ? nullptr : price_orders_at_price_[next_index]);
       }
+      orders_at_price_pool_.Deallocate(orders_at_price);
+    }
 
+    // keep matching the order of side S against the best level of the other side, taking out orders
+    // at each price level as long as the client order quantity > 0 and there are still price levels
+    // that the client order crosses
+    template<Side S>
+    auto CheckForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Price price, 
+                        Qty qty, OrderId new_market_order_id) noexcept -> Qty{
+      constexpr auto passive_side = OppositeSide(S);
+      auto leaves_qty = qty;
+      auto& best_passive = BestLevel<passive_side>();
+      // stops at the first passive level the order's price does not reach
+      while(leaves_qty && best_passive){
+         if(LIKELY(IsBetter<passive_side>(price, best_passive->price_))){
+            break;
+         }
+         match<S>(ticker_id, client_id, client_order_id, new_market_order_id, best_passive, &leaves_qty);
+      }
       return leaves_qty;
     }
 
-    auto match(TickerId ticker_id, ClientId client_id, Side side, OrderId client_order_id, Orderid new_market_order_id
-               MEOrder* itr, Qty* leaves_qty) noexcept{
-      const auto order = itr;
+    // fills the order of side S against the oldest order at the level
+    template<Side S>
+    auto match(TickerId ticker_id, ClientId client_id, OrderId client_order_id, OrderId new_market_order_id,
+               MEOrdersAtPrice* orders_at_price, Qty* leaves_qty) noexcept -> void{
+      constexpr auto side = S;
+      constexpr auto order_side = OppositeSide(S);
+      const auto order = GetFirstOrder(orders_at_price);
+      const auto price = orders_at_price->price_;
       const auto order_qty = order->qty_;
       const auto fill_qty = std::min(*leaves_qty, order_qty);
       *leaves_qty -= fill_qty;
       order->qty_ -= fill_qty;
+      orders_at_price->total_qty_ -= fill_qty;
       
       // send response to client of new order about fill
       client_response_ = {ClientResponseType::FILLED, client_id, ticker_id, client_order_id,
-                           new_market_order_id, side, itr->price_, fill_qty, *leaves_qty};
+                           new_market_order_id, side, price, fill_qty, *leaves_qty};
       matching_engine_->SendClientResponse(&client_response_);
 
       // send response to client of passive order about fill
       client_response_ = {ClientResponseType::FILLED, order->client_id_, ticker_id, order->client_order_id_, 
-                           order->market_order_id_, order->side_, itr->price_, fill_qty, order->qty_};
+                           order->market_order_id_, order_side, price, fill_qty, order->qty_};
       matching_engine_->SendClientResponse(&client_response_);
 
       // send trade message to market as a market update
-      market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, itr->price_,
+      market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, price,
                         fill_qty, Priority_INVALID};
       matching_engine_->SendMarketUpdate(&market_update_);
 
       // send modify or cancel of passive order to market as a market update
       if(!order->qty_){
-         market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, ticker_id, order->side_,
-                           order->price_, order_qty, Priority_INVALID};
+         market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, ticker_id, order_side,
+                           price, order_qty, Priority_INVALID};
          matching_engine_->SendMarketUpdate(&market_update_);
-         removeOrder(order);
+         RemoveOrder<order_side>(order);
       }else{
-         market_update_ = {MarketUpdateType::MODIFY, order->market_order_id_, ticker_id, order->side_,
-                           order->price_, order->qty_, order->priority_};
+         market_update_ = {MarketUpdateType::MODIFY, order->market_order_id_, ticker_id, order_side,
+                           price, order->qty_, order->priority_};
          matching_engine_->SendMarketUpdate(&market_update_);
       }
 
     }
 
-};
+    // dumps both sides best level first, with detailed every resting order is listed and with
+    // validity_check the level ordering is verified
+    auto ToString(bool detailed, bool validity_check) const -> std::string{
+      std::stringstream ss;
+      const auto print_side = [&](const MEOrdersAtPrice* best_orders_by_price, Side side){
+         ss << SideToString(side) << ":\n";
+         const auto& levels = (side == Side::BUY ? bid_levels_ : ask_levels_);
+         auto last_price = Price_INVALID;
+         auto level = 0;
+         for(auto itr = best_orders_by_price; itr; ++level){
+            uint64_t qty = 0;
+            size_t num_orders = 0;
+            std::stringstream orders_ss;
+            for(auto chunk_index = itr->first_chunk_; chunk_index != MEOrderChunkIndex_INVALID;){
+               const auto chunk = order_chunk_pool_.ObjectAt(chunk_index);
+               for(auto slot = chunk->begin_; slot < chunk->end_; ++slot){
+                  const auto& order = chunk->orders_[slot];
+                  if(!order.qty_){
+                     continue;
+                  }
+                  qty += order.qty_;
+                  ++num_orders;
+                  if(detailed){
+                     orders_ss << " [oid:" << OrderIdToString(order.market_order_id_)
+                               << " q:" << QtyToString(order.qty_)
+                               << " p:" << PriorityToString(order.priority_) << "]";
+                  }
+               }
+               chunk_index = chunk->next_chunk_;
+            }
+
+            if(validity_check && (qty != itr->total_qty_ || num_orders != itr->num_orders_)){
+               FATAL("Level aggregates out of date for ticker:" + TickerIdToString(ticker_id_) + " " + itr->ToString()
+                     + " orders hold qty:" + std::to_string(qty) + " orders:" + std::to_string(num_orders));
+            }
+
+            ss << "  L:" << level << " <px:" << PriceToString(itr->price_) << " qty:" << qty
+               << " orders:" << num_orders << ">" << orders_ss.str() << "\n";
+
+            if(validity_check && last_price != Price_INVALID
+               && (side == Side::BUY ? itr->price_ >= last_price : itr->price_ <= last_price)){
+               FATAL("Price levels out of order for ticker:" + TickerIdToString(ticker_id_) + " at " + ss.str());
+            }
+            last_price = itr->price_;
+
+            // walk away from the touch through the occupied slots until we come back around to it
+            const auto index = PriceToIndex(itr->price_);
+            itr = price_orders_at_price_[side == Side::BUY ? levels.FindPrevWrapping(index - 1) : levels.FindNextWrapping(index + 1)];
+            if(itr == best_orders_by_price){
+               break;
+            }
+         }
+      };
+
+      ss << "Ticker:" << TickerIdToString(ticker_id_) << "\n";
+      print_side(asks_by_price_, Side::SELL);
+      print_side(bids_by_price_, Side::BUY);
+      return ss.str();
+    }
 
-typedef std::array<MEOrderBook *, ME_MAX_TICKERS> OrderBookHashMap;
+};
 }
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include <cstdlib>
+#include "../../common/benchmark_utils.h"
+#include "matching_engine.cpp"
+
+/* Drives MatchingEngine::ProcessClientRequest() on the calling thread (the engine thread is never
+   started) and drains the outgoing queues between operations, outside the timed sections.
+   - order storage: bytes of order storage committed per resting order, on a fresh book
+   - add latency vs depth: a new passive level is added behind `depth` existing levels per side,
+     then canceled again
+   - sweep: one aggressive order takes out `levels` ask levels of one order each
+   - level sweep: one aggressive order takes out a single level holding `orders` resting orders, reported
+     per filled order. Each order is added between orders for deeper levels, as in a live book, so the
+     swept orders are not allocated back to back
+   - trend: a window of live bid levels walks up one tick per step for several price bands, each
+     step adds a level at the top and cancels the one at the bottom, so the book re-centers its band
+     along the way. Adds that moved the band are reported separately
+   - re-quote: one order behind `depth` bid levels is re-quoted every iteration, with a REPLACE that moves
+     it a tick, a REPLACE that only lowers its qty, or a CANCEL followed by a NEW. Reports the time for
+     the whole re-quote and the market updates it published
+   - depth read: the best `levels` levels per side of a book `depth` levels deep holding several orders
+     per level, read from the levels' running aggregates. The book's validity check compares the
+     aggregates with its orders afterwards
+   - mass cancel: one client's `orders` orders are pulled with one MASS_CANCEL while another client keeps
+     `others` orders in the same levels, reported per canceled order
+   Every timed section except the depth read is also counted with PerfCounters, and a "<result> perf" line
+   gives the cycles, instructions, branches and branch misses per operation. The counters need a PMU the
+   kernel exposes to the process (perf_event_paranoid of 2 or lower), without one those lines are skipped.
+   Usage: me_order_book_benchmark [iterations] */
+
+using namespace Exchange;
+
+constexpr TickerId BENCH_TICKER = 0;
+constexpr ClientId BENCH_CLIENT = 1;
+constexpr ClientId BENCH_OTHER_CLIENT = 2;
+constexpr Price BENCH_BASE_PRICE = 10000;
+constexpr size_t BENCH_INTERLEAVED_ORDERS = 3;
+
+class BookBench final{
+private:
+    ClientRequestLFQueue requests_;
+    ClientResponseLFQueue responses_;
+    MEMarketUpdateLFQueue updates_;
+    MatchingEngine engine_;
+    OrderId next_client_order_id_ = 1;
+
+public:
+    BookBench(): requests_(ME_MAX_CLIENT_UPDATES), responses_(ME_MAX_CLIENT_UPDATES), updates_(ME_MAX_MARKET_UPDATES),
+                 engine_(&requests_, &responses_, &updates_){
+    }
+
+    // number of FILLED responses drained, market updates drained are added to updates_drained
+    auto Drain(size_t* updates_drained = nullptr) noexcept{
+        size_t fills = 0;
+        for(auto responses = responses_.GetReadSpan(); !responses.empty(); responses = responses_.GetReadSpan()){
+            for(const auto& response : responses){
+                fills += (response.response_.type_ == ClientResponseType::FILLED);
+            }
+            responses_.UpdateReadIndex(responses.size());
+        }
+        for(auto updates = updates_.GetReadSpan(); !updates.empty(); updates = updates_.GetReadSpan()){
+            if(updates_drained){
+                *updates_drained += updates.size();
+            }
+            updates_.UpdateReadIndex(updates.size());
+        }
+        return fills;
+    }
+
+    // returns the client order id used, cancels pass the id of the order to cancel
+    auto Send(ClientRequestType type, Side side, Price price, Qty qty, OrderId order_id = OrderId_INVALID, ClientId client_id = BENCH_CLIENT) noexcept{
+        const MEClientRequest request{type, client_id, BENCH_TICKER,
+                                      (order_id == OrderId_INVALID ? next_client_order_id_++ : order_id), side, price, qty};
+        engine_.ProcessClientRequest(&request);
+        return request.order_id_;
+    }
+
+    // the counters run just outside the clock reads so their ioctls don't show up in the samples
+    auto TimedSend(std::vector<Nanos>* samples, PerfCounters* counters, ClientRequestType type, Side side, Price price, Qty qty,
+                   OrderId order_id = OrderId_INVALID) noexcept{
+        counters->Start();
+        const auto start = GetCurrentNanos();
+        const auto id = Send(type, side, price, qty, order_id);
+        samples->push_back(GetCurrentNanos() - start);
+        counters->Stop();
+        return id;
+    }
+
+    // one order per level, bids below and asks at/above BENCH_BASE_PRICE
+    auto BuildBook(size_t bid_levels, size_t ask_levels) noexcept{
+        std::vector<OrderId> ids;
+        for(size_t i = 0; i < bid_levels; ++i){
+            ids.push_back(Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE - 1 - i, 10));
+        }
+        for(size_t i = 0; i < ask_levels; ++i){
+            ids.push_back(Send(ClientRequestType::NEW, Side::SELL, BENCH_BASE_PRICE + i, 10));
+        }
+        Drain();
+        return ids;
+    }
+
+    auto GetOrderStorageBytes() const noexcept{
+        return engine_.GetOrderBook(BENCH_TICKER)->GetOrderStorageBytes();
+    }
+
+    auto GetBook() const noexcept{
+        return engine_.GetOrderBook(BENCH_TICKER);
+    }
+
+    auto GetRebaseCount() const noexcept{
+        return engine_.GetOrderBook(BENCH_TICKER)->GetRebaseCount();
+    }
+
+    auto ClearBook(const std::vector<OrderId>& ids) noexcept{
+        for(const auto id : ids){
+            Send(ClientRequestType::CANCEL, Side::INVALID, Price_INVALID, 0, id);
+        }
+        Drain();
+    }
+};
+
+auto RunOrderStorage(BookBench& bench, size_t orders, size_t levels){
+    std::vector<OrderId> ids;
+    ids.reserve(orders);
+    for(size_t i = 0; i < orders; ++i){
+        ids.push_back(bench.Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE - 1 - (i % levels), 10));
+        if(i % 1024 == 0){
+            bench.Drain();
+        }
+    }
+    bench.Drain();
+    PrintMetrics("order storage", {{"orders", orders}, {"levels", levels},
+                                   {"bytes_per_resting_order", static_cast<double>(bench.GetOrderStorageBytes()) / orders}});
+    bench.ClearBook(ids);
+}
+
+auto RunAddVsDepth(BookBench& bench, size_t depth, size_t iterations){
+    const auto ids = bench.BuildBook(depth, depth);
+    std::vector<Nanos> add_samples, cancel_samples;
+    PerfCounters add_counters, cancel_counters;
+    add_samples.reserve(iterations);
+    cancel_samples.reserve(iterations);
+    for(size_t i = 0; i < iterations; ++i){
+        // worst case for a sorted level list: the new level goes behind every existing bid
+        const auto id = bench.TimedSend(&add_samples, &add_counters, ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE - 1 - depth, 10);
+        bench.TimedSend(&cancel_samples, &cancel_counters, ClientRequestType::CANCEL, Side::INVALID, Price_INVALID, 0, id);
+        bench.Drain();
+    }
+    bench.ClearBook(ids);
+    PrintPerfCounters("depth:" + std::to_string(depth) + " add new level", add_counters, add_samples.size());
+    PrintPerfCounters("depth:" + std::to_string(depth) + " cancel level", cancel_counters, cancel_samples.size());
+    PrintLatencyStats("depth:" + std::to_string(depth) + " add new level ns", add_samples);
+    PrintLatencyStats("depth:" + std::to_string(depth) + " cancel level ns", cancel_samples);
+}
+
+auto RunSweep(BookBench& bench, size_t levels, size_t iterations){
+    std::vector<Nanos> samples;
+    PerfCounters counters;
+    samples.reserve(iterations);
+    for(size_t i = 0; i < iterations; ++i){
+        bench.BuildBook(0, levels);
+        bench.TimedSend(&samples, &counters, ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE + levels - 1, 10 * levels);
+        if(UNLIKELY(bench.Drain() != 2 * levels)){
+            FATAL("sweep of " + std::to_string(levels) + " levels did not fill every level");
+        }
+    }
+    PrintPerfCounters("sweep levels:" + std::to_string(levels) + " aggressive order", counters, samples.size());
+    PrintLatencyStats("sweep levels:" + std::to_string(levels) + " aggressive order ns", samples);
+}
+
+auto RunLevelSweep(BookBench& bench, size_t orders, size_t iterations){
+    std::vector<Nanos> samples;
+    PerfCounters counters;
+    samples.reserve(iterations);
+    for(size_t i = 0; i < iterations; ++i){
+        std::vector<OrderId> deeper_ids;
+        for(size_t j = 0; j < orders; ++j){
+            bench.Send(ClientRequestType::NEW, Side::SELL, BENCH_BASE_PRICE, 10);
+            for(size_t k = 0; k < BENCH_INTERLEAVED_ORDERS; ++k){
+                deeper_ids.push_back(bench.Send(ClientRequestType::NEW, Side::SELL, BENCH_BASE_PRICE + 1 + (j + k) % 16, 10));
+            }
+            if(j % 1024 == 0){
+                bench.Drain();
+            }
+        }
+        bench.Drain();
+        counters.Start();
+        const auto start = GetCurrentNanos();
+        bench.Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE, 10 * orders);
+        samples.push_back((GetCurrentNanos() - start) / orders);
+        counters.Stop();
+        if(UNLIKELY(bench.Drain() != 2 * orders)){
+            FATAL("sweep of " + std::to_string(orders) + " orders did not fill every order");
+        }
+        bench.ClearBook(deeper_ids);
+    }
+    PrintPerfCounters("level sweep orders:" + std::to_string(orders) + " filled order", counters, samples.size() * orders);
+    PrintLatencyStats("level sweep orders:" + std::to_string(orders) + " ns per filled order", samples);
+}
+
+auto RunTrend(BookBench& bench, size_t live_levels, size_t steps){
+    std::vector<Nanos> add_samples, rebase_add_samples, cancel_samples;
+    // adds with and without a rebase together, whether an add moved the band is only known afterwards
+    PerfCounters add_counters, cancel_counters;
+    add_samples.reserve(steps);
+    cancel_samples.reserve(steps);
+    std::vector<OrderId> ids(live_levels);
+    const auto start_rebases = bench.GetRebaseCount();
+    for(size_t step = 0; step < steps; ++step){
+        auto& id = ids[step % live_levels];
+        if(step >= live_levels){
+            bench.TimedSend(&cancel_samples, &cancel_counters, ClientRequestType::CANCEL, Side::INVALID, Price_INVALID, 0, id);
+        }
+        const auto rebases = bench.GetRebaseCount();
+        add_counters.Start();
+        const auto start = GetCurrentNanos();
+        id = bench.Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE + step, 10);
+        const auto elapsed = GetCurrentNanos() - start;
+        add_counters.Stop();
+        (bench.GetRebaseCount() != rebases ? rebase_add_samples : add_samples).push_back(elapsed);
+        bench.Drain();
+    }
+    for(size_t i = 0; i < std::min(live_levels, steps); ++i){
+        bench.Send(ClientRequestType::CANCEL, Side::INVALID, Price_INVALID, 0, ids[i]);
+    }
+    bench.Drain();
+    const auto prefix = "trend live:" + std::to_string(live_levels) + " rebases:" + std::to_string(bench.GetRebaseCount() - start_rebases);
+    PrintPerfCounters(prefix + " add", add_counters, steps);
+    PrintPerfCounters(prefix + " cancel", cancel_counters, cancel_samples.size());
+    PrintLatencyStats(prefix + " add ns", add_samples);
+    PrintLatencyStats(prefix + " add with rebase ns", rebase_add_samples);
+    PrintLatencyStats(prefix + " cancel ns", cancel_samples);
+}
+
+enum class RequoteMode{
+    REPLACE_PRICE,
+    REPLACE_QTY_DOWN,
+    CANCEL_NEW
+};
+
+auto RunRequote(BookBench& bench, RequoteMode mode, size_t depth, size_t iterations){
+    const auto ids = bench.BuildBook(depth, depth);
+    std::vector<Nanos> samples;
+    PerfCounters counters;
+    samples.reserve(iterations);
+    // room for one qty step down per iteration
+    Qty qty = iterations + 1;
+    auto id = bench.Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE - 1 - depth, qty);
+    bench.Drain();
+    size_t updates = 0;
+    for(size_t i = 0; i < iterations; ++i){
+        // alternates between the level behind the book and one tick deeper
+        const Price price = BENCH_BASE_PRICE - 1 - depth - ((i + 1) % 2);
+        counters.Start();
+        const auto start = GetCurrentNanos();
+        switch(mode){
+            case RequoteMode::REPLACE_PRICE:
+                bench.Send(ClientRequestType::REPLACE, Side::BUY, price, qty, id);
+                break;
+            case RequoteMode::REPLACE_QTY_DOWN:
+                bench.Send(ClientRequestType::REPLACE, Side::BUY, BENCH_BASE_PRICE - 1 - depth, --qty, id);
+                break;
+            case RequoteMode::CANCEL_NEW:
+                bench.Send(ClientRequestType::CANCEL, Side::INVALID, Price_INVALID, 0, id);
+                id = bench.Send(ClientRequestType::NEW, Side::BUY, price, qty);
+                break;
+        }
+        samples.push_back(GetCurrentNanos() - start);
+        counters.Stop();
+        bench.Drain(&updates);
+    }
+    bench.ClearBook(ids);
+    bench.ClearBook({id});
+    const std::string name = (mode == RequoteMode::REPLACE_PRICE ? "replace price" : mode == RequoteMode::REPLACE_QTY_DOWN ? "replace qty down" : "cancel new");
+    const auto prefix = "requote depth:" + std::to_string(depth) + " " + name;
+    PrintPerfCounters(prefix, counters, samples.size());
+    PrintLatencyStats(prefix + " ns", samples);
+    PrintMetrics(prefix + " updates", {{"requotes", iterations}, {"updates_per_requote", iterations ? static_cast<double>(updates) / iterations : 0.0}});
+}
+
+auto RunDepthRead(BookBench& bench, size_t depth, size_t levels, size_t iterations){
+    std::vector<OrderId> ids;
+    for(size_t order = 0; order < 4; ++order){
+        const auto level_ids = bench.BuildBook(depth, depth);
+        ids.insert(ids.end(), level_ids.begin(), level_ids.end());
+    }
+    // partial fills and a qty-down replace leave levels whose orders hold different quantities
+    bench.Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE, 15);
+    bench.Send(ClientRequestType::REPLACE, Side::BUY, BENCH_BASE_PRICE - 1, 3, ids.front());
+    bench.Drain();
+    ASSERT(!bench.GetBook()->ToString(false, true).empty(), "validity check failed");
+    std::vector<MEBookLevel> bids(levels), asks(levels);
+    std::vector<Nanos> samples;
+    samples.reserve(iterations);
+    uint64_t total_qty = 0;
+    for(size_t i = 0; i < iterations; ++i){
+        const auto start = GetCurrentNanos();
+        const auto num_bids = bench.GetBook()->GetDepth(Side::BUY, bids.data(), levels);
+        const auto num_asks = bench.GetBook()->GetDepth(Side::SELL, asks.data(), levels);
+        samples.push_back(GetCurrentNanos() - start);
+        total_qty += bids[num_bids - 1].qty_ + asks[num_asks - 1].qty_;
+    }
+    const auto top_of_book = bench.GetBook()->GetTopOfBook();
+    if(UNLIKELY(top_of_book.bid_.qty_ != 33 || top_of_book.bid_.num_orders_ != 4 || top_of_book.ask_.qty_ != 25 || top_of_book.ask_.num_orders_ != 3)){
+        FATAL("unexpected top of book bid qty:" + std::to_string(top_of_book.bid_.qty_) + " ask qty:" + std::to_string(top_of_book.ask_.qty_));
+    }
+    bench.ClearBook(ids);
+    PrintLatencyStats("depth read depth:" + std::to_string(depth) + " levels:" + std::to_string(levels) + " ns", samples);
+    ASSERT(total_qty, "depth read saw no quantity");
+}
+
+auto RunMassCancel(BookBench& bench, size_t orders, size_t others, size_t iterations){
+    std::vector<Nanos> samples;
+    PerfCounters counters;
+    samples.reserve(iterations);
+    std::vector<OrderId> other_ids;
+    for(size_t i = 0; i < others; ++i){
+        other_ids.push_back(bench.Send(ClientRequestType::NEW, Side::BUY, BENCH_BASE_PRICE - 1 - i % 64, 10, OrderId_INVALID, BENCH_OTHER_CLIENT));
+        if(i % 1024 == 0){
+            bench.Drain();
+        }
+    }
+    bench.Drain();
+    for(size_t i = 0; i < iterations; ++i){
+        for(size_t j = 0; j < orders; ++j){
+            bench.Send(ClientRequestType::NEW, (j % 2 ? Side::BUY : Side::SELL), (j % 2 ? BENCH_BASE_PRICE - 1 - j % 64 : BENCH_BASE_PRICE + j % 64), 10);
+            if(j % 1024 == 0){
+                bench.Drain();
+            }
+        }
+        bench.Drain();
+        counters.Start();
+        const auto start = GetCurrentNanos();
+        bench.Send(ClientRequestType::MASS_CANCEL, Side::INVALID, Price_INVALID, Qty_INVALID);
+        samples.push_back((GetCurrentNanos() - start) / orders);
+        counters.Stop();
+        size_t updates = 0;
+        bench.Drain(&updates);
+        if(UNLIKELY(updates != orders)){
+            FATAL("mass cancel of " + std::to_string(orders) + " orders published " + std::to_string(updates) + " updates");
+        }
+    }
+    for(const auto id : other_ids){
+        bench.Send(ClientRequestType::CANCEL, Side::INVALID, Price_INVALID, 0, id, BENCH_OTHER_CLIENT);
+    }
+    bench.Drain();
+    const auto prefix = "mass cancel orders:" + std::to_string(orders) + " others:" + std::to_string(others);
+    PrintPerfCounters(prefix + " canceled order", counters, samples.size() * orders);
+    PrintLatencyStats(prefix + " ns per canceled order", samples);
+}
+
+int main(int argc, char** argv){
+    const size_t iterations = argc > 1 ? std::atol(argv[1]) : 10000;
+
+    auto bench = new BookBench();
+    RunOrderStorage(*bench, 100000, 64);
+    for(const size_t depth : {1, 16, 256, 4096}){
+        RunAddVsDepth(*bench, depth, iterations);
+    }
+    for(const size_t levels : {1, 16, 256, 1024}){
+        RunSweep(*bench, levels, std::max<size_t>(iterations / levels, 1));
+    }
+    for(const size_t orders : {16, 256, 4096}){
+        RunLevelSweep(*bench, orders, std::max<size_t>(iterations / orders, 4));
+    }
+    RunTrend(*bench, 256, 4 * ME_MAX_PRICE_LEVELS);
+    for(const size_t depth : {1, 256}){
+        for(const auto mode : {RequoteMode::REPLACE_PRICE, RequoteMode::REPLACE_QTY_DOWN, RequoteMode::CANCEL_NEW}){
+            RunRequote(*bench, mode, depth, iterations);
+        }
+    }
+    for(const size_t levels : {1, 10}){
+        RunDepthRead(*bench, 4096, levels, iterations);
+    }
+    for(const size_t orders : {16, 256, 4096}){
+        for(const size_t others : {0, 100000}){
+            RunMassCancel(*bench, orders, others, std::max<size_t>(iterations / orders, 4));
+        }
+    }
+    delete bench;
+    return 0;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../../common/types.h"
+
+using namespace Common;
+
+namespace Exchange{
+// one listed instrument and the capacity its book is created with
+struct METickerInfo{
+    std::string symbol_;
+    // most resting orders the book holds, its order pools and client order index are sized for this many
+    size_t max_orders_ = ME_MAX_ORDER_IDS;
+    // width of the book's price band, rounded up to a power of two, at most ME_MAX_PRICE_LEVELS
+    size_t price_levels_ = ME_MAX_PRICE_LEVELS;
+};
+
+/*
+The tickers the exchange lists. Loaded once at startup, before the matching engines and the order server are
+created, and only read after that, so lookups take no lock. Ticker ids index a vector, a ticker is listed
+when its entry has a symbol. Without a loaded file tickers 0 to ME_DEFAULT_TICKERS - 1 are listed with the
+default capacity.
+*/
+class METickerUniverse final{
+private:
+    std::vector<METickerInfo> tickers_;
+    size_t num_listed_ = 0;
+
+public:
+    METickerUniverse(){
+        Reset(ME_DEFAULT_TICKERS);
+    }
+
+    METickerUniverse(const METickerUniverse&) = delete;
+    METickerUniverse(const METickerUniverse&&) = delete;
+    METickerUniverse& operator=(const METickerUniverse&) = delete;
+    METickerUniverse& operator=(const METickerUniverse&&) = delete;
+
+    static auto Instance() noexcept -> METickerUniverse*{
+        static METickerUniverse universe;
+        return &universe;
+    }
+
+    // lists tickers 0 to num_tickers - 1, named by their id, with the same capacity
+    auto Reset(size_t num_tickers, size_t max_orders = ME_MAX_ORDER_IDS, size_t price_levels = ME_MAX_PRICE_LEVELS) -> void{
+        ASSERT(num_tickers >= 1 && num_tickers <= ME_MAX_TICKERS, "Ticker universe must hold 1-" + std::to_string(ME_MAX_TICKERS) + " tickers");
+        ASSERT(max_orders >= 1 && max_orders <= ME_MAX_ORDER_IDS && price_levels >= 2 && price_levels <= ME_MAX_PRICE_LEVELS, "Invalid ticker capacity");
+        tickers_.assign(num_tickers, METickerInfo{std::string(), max_orders, price_levels});
+        for(size_t ticker_id = 0; ticker_id < num_tickers; ++ticker_id){
+            tickers_[ticker_id].symbol_ = std::to_string(ticker_id);
+        }
+        num_listed_ = num_tickers;
+    }
+
+    // one ticker per line: <ticker_id> <symbol> [max_orders] [price_levels], # starts a comment.
+    // Every field present has to parse completely and nothing may follow the price levels.
+    // Replaces the current universe only if the whole file is valid
+    auto Load(const std::string& file_name) -> bool{
+        std::ifstream file(file_name);
+        if(!file){
+            std::cerr << "Could not open ticker universe " << file_name << std::endl;
+            return false;
+        }
+        // the whole token is a number, "AAPL" or "10k" is not
+        const auto parse_number = [](const std::string& token, auto* value){
+            const auto end = token.data() + token.size();
+            const auto [ptr, error] = std::from_chars(token.data(), end, *value);
+            return (error == std::errc() && ptr == end);
+        };
+        std::vector<METickerInfo> tickers;
+        size_t num_listed = 0;
+        std::string line;
+        for(size_t line_number = 1; std::getline(file, line); ++line_number){
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::vector<std::string> tokens;
+            for(std::string token; fields >> token;){
+                tokens.push_back(token);
+            }
+            // only blank and comment lines are skipped
+            if(tokens.empty()){
+                continue;
+            }
+            const auto where = file_name + ":" + std::to_string(line_number) + " ";
+            TickerId ticker_id = TickerId_INVALID;
+            if(!parse_number(tokens[0], &ticker_id)){
+                std::cerr << where << "expected a ticker id, got " << tokens[0] << std::endl;
+                return false;
+            }
+            METickerInfo info;
+            if(tokens.size() < 2){
+                std::cerr << where << "expected a symbol for ticker " << ticker_id << std::endl;
+                return false;
+            }
+            info.symbol_ = tokens[1];
+            if(tokens.size() > 4){
+                std::cerr << where << "unexpected " << tokens[4] << " after the price levels of ticker " << ticker_id << std::endl;
+                return false;
+            }
+            if((tokens.size() > 2 && !parse_number(tokens[2], &info.max_orders_)) || (tokens.size() > 3 && !parse_number(tokens[3], &info.price_levels_))){
+                std::cerr << where << "expected numbers for the max orders and price levels of ticker " << ticker_id << std::endl;
+                return false;
+            }
+            // the book rounds the price levels up to a power of two and sizes its level map by them
+            if(ticker_id >= ME_MAX_TICKERS || info.max_orders_ < 1 || info.max_orders_ > ME_MAX_ORDER_IDS
+               || info.price_levels_ < 2 || info.price_levels_ > ME_MAX_PRICE_LEVELS){
+                std::cerr << where << "ticker id must be below " << ME_MAX_TICKERS << ", max orders 1-"
+                          << ME_MAX_ORDER_IDS << " and price levels 2-" << ME_MAX_PRICE_LEVELS << std::endl;
+                return false;
+            }
+            if(ticker_id >= tickers.size()){
+                tickers.resize(ticker_id + 1);
+            }
+            if(!tickers[ticker_id].symbol_.empty()){
+                std::cerr << where << "ticker " << ticker_id << " is listed twice" << std::endl;
+                return false;
+            }
+            tickers[ticker_id] = info;
+            ++num_listed;
+        }
+        if(!num_listed){
+            std::cerr << "Ticker universe " << file_name << " lists no tickers" << std::endl;
+            return false;
+        }
+        tickers_ = std::move(tickers);
+        num_listed_ = num_listed;
+        return true;
+    }
+
+    auto Contains(TickerId ticker_id) const noexcept{
+        return ticker_id < tickers_.size() && !tickers_[ticker_id].symbol_.empty();
+    }
+
+    // only for listed tickers
+    auto Get(TickerId ticker_id) const noexcept -> const METickerInfo&{
+        return tickers_[ticker_id];
+    }
+
+    // one past the highest listed ticker id
+    auto Size() const noexcept{
+        return tickers_.size();
+    }
+
+    auto GetNumListed() const noexcept{
+        return num_listed_;
+    }
+};
+}
@@ -2,6 +2,7 @@
 #include <sstream>
 #include "../../common/types.h"
 #include "../../common/lf_queue.h"
+#include "../../common/time_utils.h"
 
 using namespace Common;
 
@@ -10,7 +11,12 @@ namespace Exchange{
 enum class ClientRequestType : uint8_t{
     INVALID = 0,
     NEW = 1,
-    CANCEL = 2
+    CANCEL = 2,
+    // new price and/or open quantity for the resting order order_id_, the side has to stay the same
+    REPLACE = 3,
+    // cancels every resting order of client_id_ on ticker_id_ and side_, TickerId_INVALID covers every
+    // ticker and Side::INVALID both sides
+    MASS_CANCEL = 4
 };
 
 inline std::string ClientRequestTypeToString(ClientRequestType type){
@@ -20,6 +26,12 @@ inline std::string ClientRequestTypeToString(ClientRequestType type){
     
     case ClientRequestType::CANCEL:
         return "CANCEL";
+
+    case ClientRequestType::REPLACE:
+        return "REPLACE";
+
+    case ClientRequestType::MASS_CANCEL:
+        return "MASS_CANCEL";
     
     case ClientRequestType::INVALID:
         return "INVALID";
@@ -65,5 +77,19 @@ struct OMClientRequest{
 };
 
 #pragma pack(pop)
-typedef LFQueue<MEClientRequest> ClientRequestLFQueue;
+
+// what the order server hands the matching engine: the request plus the kernel receive time of the bytes it
+// arrived in, which the latency probes measure from. Never goes on the wire
+struct MEClientRequestEnvelope{
+    MEClientRequest request_;
+    Nanos rx_time_ = 0;
+};
+
+typedef SPSCLFQueue<MEClientRequestEnvelope> ClientRequestLFQueue;
+
+// the matching engine shard that owns ticker_id when the exchange runs num_shards of them, every request for
+// a ticker goes through the same shard so the ticker's requests, responses and market updates stay in order
+inline auto TickerIdToShard(TickerId ticker_id, size_t num_shards) noexcept -> size_t{
+    return ticker_id % num_shards;
+}
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <sstream>
 #include "../../common/types.h"
 #include "../../common/lf_queue.h"
+#include "client_request.h"
 
 using namespace Common;
 
@@ -12,7 +13,14 @@ enum class ClientResponseType : uint8_t{
     ACCEPTED = 1,
     CANCELED = 2,
     FILLED = 3,
-    CANCEL_REJECTED = 4
+    CANCEL_REJECTED = 4,
+    REPLACED = 5,
+    REPLACE_REJECTED = 6,
+    // follows the CANCELED of every order a MASS_CANCEL removed, exec_qty_ is the number of orders. A mass
+    // cancel of every ticker gets one from each matching engine shard, counting the orders of its tickers
+    MASS_CANCELED = 7,
+    // a NEW whose client order id is already one of the client's live orders, or out of the range the book can index
+    NEW_REJECTED = 8
 };
 
 inline std::string ClientResponseTypeToString(ClientResponseType type){
@@ -25,6 +33,14 @@ inline std::string ClientResponseTypeToString(ClientResponseType type){
         return "FILLED";
     case ClientResponseType::CANCEL_REJECTED:
         return "CANCEL_REJECTED";
+    case ClientResponseType::REPLACED:
+        return "REPLACED";
+    case ClientResponseType::REPLACE_REJECTED:
+        return "REPLACE_REJECTED";
+    case ClientResponseType::MASS_CANCELED:
+        return "MASS_CANCELED";
+    case ClientResponseType::NEW_REJECTED:
+        return "NEW_REJECTED";
     case ClientResponseType::INVALID:
         return "INVALID";
     }
@@ -75,6 +91,14 @@ struct OMClientResponse{
 
 #pragma pack(pop)
 
+// a response on its way to the order server with the receive time and type of the request that caused it,
+// for the latency probes. Never goes on the wire
+struct MEClientResponseEnvelope{
+    MEClientResponse response_;
+    Nanos rx_time_ = 0;
+    ClientRequestType request_type_ = ClientRequestType::INVALID;
+};
+
 // client response lock-free queue
-typedef LFQueue<MEClientResponse> ClientResponseLFQueue;
+typedef SPSCLFQueue<MEClientResponseEnvelope> ClientResponseLFQueue;
 }
\ No newline at end of file
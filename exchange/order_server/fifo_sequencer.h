@@ -0,0 +1,126 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "../../common/thread_utils.h"
+#include "../../common/macros.h"
+#include "../../common/logging.h"
+#include "../../common/latency_histogram.h"
+#include "client_request.h"
+
+namespace Exchange{
+/*
+Requests read from different client sockets in one pass of the order server are handed to the matching
+engine in the order the kernel received them, not in the order the sockets happened to be read. With several
+matching engine shards each request goes to the queue of the shard owning its ticker, and a MASS_CANCEL of
+every ticker goes to all of them.
+*/
+class FIFOSequencer final{
+private:
+    // one queue per matching engine shard
+    std::vector<ClientRequestLFQueue*> incoming_requests_;
+    Logger* logger_ = nullptr;
+    // the owning server's run flag, a publish waiting on a full queue gives up once it is cleared
+    const volatile bool* run_ = nullptr;
+
+    struct RecvTimeClientRequest{
+        Nanos recv_time_ = 0;
+        // ties on recv_time_ keep the order the requests were read in
+        size_t arrival_ = 0;
+        MEClientRequest request_;
+
+        auto operator<(const RecvTimeClientRequest& rhs) const{
+            return (recv_time_ < rhs.recv_time_ || (recv_time_ == rhs.recv_time_ && arrival_ < rhs.arrival_));
+        }
+    };
+
+    std::array<RecvTimeClientRequest, ME_MAX_PENDING_REQUESTS> pending_client_requests_;
+    size_t pending_size_ = 0;
+
+public:
+    FIFOSequencer(const std::vector<ClientRequestLFQueue*>& client_requests, Logger* logger, const volatile bool* run):
+                  incoming_requests_(client_requests), logger_(logger), run_(run){
+        ASSERT(!incoming_requests_.empty() && incoming_requests_.size() <= ME_MAX_SHARDS, "FIFOSequencer needs 1 to ME_MAX_SHARDS request queues");
+    }
+
+    auto GetNumShards() const noexcept{
+        return incoming_requests_.size();
+    }
+
+    auto AddClientRequest(Nanos rx_time, const MEClientRequest& request){
+        // a pass that read more than fits is sequenced in parts, each part in receive time order
+        if(UNLIKELY(pending_size_ >= pending_client_requests_.size())){
+            SequenceAndPublish();
+        }
+        pending_client_requests_[pending_size_] = RecvTimeClientRequest{rx_time, pending_size_, request};
+        ++pending_size_;
+    }
+
+    // writes request to one shard's queue without publishing it, false when the server stopped while the queue was full
+    auto Write(ClientRequestLFQueue* queue, const RecvTimeClientRequest& client_request) noexcept{
+        auto next_write = queue->GetNextToWriteTo();
+        // back-pressure: publish what we have and wait for the matching engine to drain
+        if(UNLIKELY(!next_write)){
+            queue->PublishWriteIndex();
+            while(!next_write && *run_){
+                next_write = queue->GetNextToWriteTo();
+            }
+            if(UNLIKELY(!next_write)){
+                return false;
+            }
+        }
+        *next_write = MEClientRequestEnvelope{client_request.request_, client_request.recv_time_};
+        queue->AdvanceWriteIndex();
+        return true;
+    }
+
+    // sorts the pending requests by receive time and publishes them to the matching engine shards with one
+    // store per shard that got a request
+    auto SequenceAndPublish() -> void{
+        if(UNLIKELY(!pending_size_)){
+            return;
+        }
+        logger_->Log<"%:% %() % Processing % requests.\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{}, pending_size_);
+
+        std::sort(pending_client_requests_.begin(), pending_client_requests_.begin() + pending_size_);
+
+        const auto now = Common::GetTscNanos();
+        const auto num_shards = incoming_requests_.size();
+        uint64_t written_shards = 0;
+        for(size_t i = 0; i < pending_size_; ++i){
+            const auto& client_request = pending_client_requests_[i];
+            logger_->Log<"%:% %() % Writing RX:% Req:% to FIFO.\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                         client_request.recv_time_, client_request.request_);
+
+            auto written = true;
+            if(UNLIKELY(client_request.request_.ticker_id_ == TickerId_INVALID)){
+                // only a MASS_CANCEL of every ticker gets here, the order server drops any other request without a valid ticker
+                for(size_t shard = 0; shard < num_shards && written; ++shard){
+                    written = Write(incoming_requests_[shard], client_request);
+                }
+                written_shards = ~0ull;
+            }else{
+                const auto shard = TickerIdToShard(client_request.request_.ticker_id_, num_shards);
+                written = Write(incoming_requests_[shard], client_request);
+                written_shards |= (1ull << shard);
+            }
+            // stopping, the rest of the pass is dropped
+            if(UNLIKELY(!written)){
+                break;
+            }
+            Common::LatencyProbe(LatencyStage::FIFO_SEQUENCED, static_cast<uint8_t>(client_request.request_.type_), client_request.recv_time_, now);
+        }
+        for(size_t shard = 0; shard < num_shards; ++shard){
+            if(written_shards & (1ull << shard)){
+                incoming_requests_[shard]->PublishWriteIndex();
+            }
+        }
+        pending_size_ = 0;
+    }
+
+    FIFOSequencer() = delete;
+    FIFOSequencer(const FIFOSequencer&) = delete;
+    FIFOSequencer(const FIFOSequencer&&) = delete;
+    FIFOSequencer& operator=(const FIFOSequencer&) = delete;
+    FIFOSequencer& operator=(const FIFOSequencer&&) = delete;
+};
+}
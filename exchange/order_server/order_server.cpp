@@ -1,4 +1,4 @@
-#include "order_server/order_server.h"
+#include "order_server.h"
 
 namespace Exchange{
 // Constructor accepts pointers to two lock-free queue objects:
@@ -6,15 +6,24 @@ namespace Exchange{
 // and one to receive MEClientResponses from teh matching engine
 // it also accepts a network interface and port to use that the order gateway
 // will listen to and accept client connections on.
-OrderServer::OrderServer(ClientRequestLFQueue* client_requests, 
-                ClientResponseLFQueue* client_responses, 
-                const std::string& iface, int port): iface_(iface), port_(port),
-                outgoing_responses_(client_responses),
+OrderServer::OrderServer(const std::vector<ClientRequestLFQueue*>& client_requests,
+                const std::vector<ClientResponseLFQueue*>& client_responses,
+                const std::string& iface, int port,
+                IdleStrategyType idle_strategy): iface_(iface), port_(port),
                 logger_("exchange_order_server.log"), tcp_server_(logger_),
-                fifo_sequencer_(client_requests, &logger_){
+                outgoing_responses_(client_responses),
+                fifo_sequencer_(client_requests, &logger_, &run_), idle_strategy_(idle_strategy), requests_("os.requests"), rejected_("os.rejected"),
+                responses_("os.responses"), disconnects_("os.disconnects"), dropped_responses_("os.dropped_responses"),
+                response_queue_depth_("os.response_queue_depth", StatKind::GAUGE){
     cid_next_exp_seq_num_.fill(1);
     cid_next_outgoing_seq_num_.fill(1);
     cid_tcp_socket_.fill(nullptr);
+    pending_sends_.reserve(ME_MAX_CLIENT_UPDATES);
+    ASSERT(outgoing_responses_.size() == fifo_sequencer_.GetNumShards(), "Need one request and one response queue per matching engine shard");
+    // any shard's publish wakes a parked order server
+    for(auto responses : outgoing_responses_){
+        responses->SetReaderIdleStrategy(&idle_strategy_);
+    }
     // Need to implement RecvCallback()
     tcp_server_.recv_callback_ = [this](auto socket, auto rx_time){
         RecvCallback(socket, rx_time);
@@ -23,6 +32,9 @@ OrderServer::OrderServer(ClientRequestLFQueue* client_requests,
     tcp_server_.recv_finished_callback_ = [this](){
         RecvFinishedCallback();
     };
+    tcp_server_.disconnect_callback_ = [this](auto socket){
+        DisconnectCallback(socket);
+    };
 }
 
 OrderServer::~OrderServer()
@@ -31,6 +43,9 @@ OrderServer::~OrderServer()
     // sleeps so that thread can finish any pending tasks
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(1s);
+    for(auto responses : outgoing_responses_){
+        responses->SetReaderIdleStrategy(nullptr);
+    }
 }
 
 // sets bool run_ to true (flag that controls how long main thread runs)
@@ -40,7 +55,7 @@ OrderServer::~OrderServer()
 auto OrderServer::Start() -> void{
     run_ = true;
     tcp_server_.Listen(iface_, port_);
-    ASSERT(Common::CreateAndStartThread(-1, "Exchnage/OrderServer", 
+    ASSERT(Common::CreateAndStartThread(-1, "Exchange/OrderServer", 
            [this](){Run();}) != nullptr, "Failed to start OrderServer thread.");
 }
 
@@ -48,4 +63,60 @@ auto OrderServer::Start() -> void{
 auto OrderServer::Stop() -> void{
     run_ = false;
 }
+
+// polls for new connections, reads and writes the client sockets and forwards every response the matching
+// engine shards published, one shard's queue after the other
+auto OrderServer::Run() noexcept -> void{
+    logger_.Log<"%:% %() %\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{});
+    while(run_){
+        tcp_server_.Poll();
+        const auto received = tcp_server_.SendAndRecv();
+
+        // SendAndRecv() just wrote out what the previous pass queued on the sockets
+        if(!pending_sends_.empty()){
+            const auto now = Common::GetTscNanos();
+            for(const auto& pending_send : pending_sends_){
+                Common::LatencyProbe(LatencyStage::SOCKET_SEND, static_cast<uint8_t>(pending_send.request_type_), pending_send.rx_time_, now);
+            }
+            pending_sends_.clear();
+        }
+
+        size_t num_responses = 0;
+        for(auto responses : outgoing_responses_){
+            const auto client_responses = responses->GetReadSpan();
+            num_responses += client_responses.size();
+            ForwardResponses(client_responses);
+            if(!client_responses.empty()){
+                responses->UpdateReadIndex(client_responses.size());
+            }
+        }
+        response_queue_depth_.Set(num_responses);
+        responses_.Add(num_responses);
+        // socket data is only seen when a park times out, responses wake the order server
+        idle_strategy_.Idle(received || num_responses, [this](){
+            return std::any_of(outgoing_responses_.begin(), outgoing_responses_.end(), [](const auto responses){ return responses->Size() != 0; });
+        });
+    }
+}
+
+// writes every response to its client's socket with the client's next outgoing sequence number
+auto OrderServer::ForwardResponses(std::span<const MEClientResponseEnvelope> client_responses) noexcept -> void{
+    for(const auto& client_response : client_responses){
+        const auto& me_client_response = client_response.response_;
+        auto& next_outgoing_seq_num = cid_next_outgoing_seq_num_[me_client_response.client_id_];
+        logger_.Log<"%:% %() % Processing cid:% seq:% %\n">(__FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                    me_client_response.client_id_, next_outgoing_seq_num, me_client_response);
+
+        auto socket = cid_tcp_socket_[me_client_response.client_id_];
+        // the client disconnected, this includes the responses to its cancel-on-disconnect
+        if(UNLIKELY(socket == nullptr)){
+            dropped_responses_.Increment();
+            continue;
+        }
+        socket->Send(&next_outgoing_seq_num, sizeof(next_outgoing_seq_num));
+        socket->Send(&me_client_response, sizeof(MEClientResponse));
+        ++next_outgoing_seq_num;
+        pending_sends_.push_back(PendingSend{client_response.rx_time_, client_response.request_type_});
+    }
+}
 }
\ No newline at end of file
@@ -1,12 +1,17 @@
 #pragma once
 #include <functional>
-#include "common/lf_queue.h"
-#include "common/thread_utils.h"
-#include "common/macros.h"
-#include "common/tcp_server.h"
-#include "order_server/client_request.h"
-#include "order_server/client_response.h"
-#include "order_server/fifo_sequencer.h"
+#include <span>
+#include <vector>
+#include "../../common/lf_queue.h"
+#include "../../common/thread_utils.h"
+#include "../../common/macros.h"
+#include "../../common/tcp_server.h"
+#include "../../common/latency_histogram.h"
+#include "../../common/stats_segment.h"
+#include "client_request.h"
+#include "client_response.h"
+#include "fifo_sequencer.h"
+#include "../matcher/me_ticker_universe.h"
 
 namespace Exchange{
 class OrderServer
@@ -15,28 +20,52 @@ private:
     const std::string iface_;
     const int port_{};
     volatile bool run_{false};
-    std::string time_str_;
     Logger logger_;
     std::array<size_t, ME_MAX_NUM_CLIENTS> cid_next_outgoing_seq_num_;
     std::array<size_t, ME_MAX_NUM_CLIENTS> cid_next_exp_seq_num_;
     std::array<Common::TCPSocket*, ME_MAX_NUM_CLIENTS> cid_tcp_socket_;
     Common::TCPServer tcp_server_;
-    ClientResponseLFQueue* outgoing_responses_;
-    // Need to add FIFOSequencer class
+    // one response queue per matching engine shard, merged in Run(). Responses about one ticker all come
+    // from the same shard and keep their order, responses about different tickers may interleave
+    std::vector<ClientResponseLFQueue*> outgoing_responses_;
     FIFOSequencer fifo_sequencer_;
+    // what Run() does after a pass with no socket data and no responses, a parked order server is woken
+    // by the matching engine's publish, socket data is only seen when the park times out
+    IdleStrategy idle_strategy_;
+    // responses written to client sockets since the last TCPServer::SendAndRecv(), for the SOCKET_SEND probe
+    struct PendingSend{
+        Nanos rx_time_ = 0;
+        ClientRequestType request_type_ = ClientRequestType::INVALID;
+    };
+    std::vector<PendingSend> pending_sends_;
+    // published as os.<stat>
+    StatsCounter requests_;
+    // requests dropped for an unknown client, the wrong socket or a sequence gap
+    StatsCounter rejected_;
+    StatsCounter responses_;
+    // clients whose socket disconnected, each gets a MASS_CANCEL, and responses that arrived for a client with no socket
+    StatsCounter disconnects_;
+    StatsCounter dropped_responses_;
+    // responses ready when the order server last read its queue
+    StatsCounter response_queue_depth_;
 
 
 public:
-    OrderServer(ClientRequestLFQueue* client_requests, 
-                ClientResponseLFQueue* client_responses, 
-                const std::string& iface, int port);
+    // client_requests and client_responses hold the queues of every matching engine shard in shard order
+    OrderServer(const std::vector<ClientRequestLFQueue*>& client_requests,
+                const std::vector<ClientResponseLFQueue*>& client_responses,
+                const std::string& iface, int port,
+                IdleStrategyType idle_strategy = IdleStrategyType::BUSY_SPIN);
     ~OrderServer();
     auto Start() -> void;
     auto Stop() -> void;
+    auto Run() noexcept -> void;
+    auto ForwardResponses(std::span<const MEClientResponseEnvelope> client_responses) noexcept -> void;
     
     auto RecvCallback(TCPSocket* socket, Nanos rx_time) noexcept{
-        logger_.Log("%:% %() % Received socket:% len:% rx:%\n", __FILE__,
-        __LINE__, __FUNCTION__, Common::GetCurrentTimeStr(&time_str_), 
+        const auto now = Common::GetTscNanos();
+        logger_.Log<"%:% %() % Received socket:% len:% rx:%\n">(__FILE__,
+        __LINE__, __FUNCTION__, Common::LogTime{}, 
         socket->fd_, socket->next_rcv_valid_index_, rx_time);
 
         if(socket->next_rcv_valid_index_ >= sizeof(OMClientRequest)){
@@ -46,9 +75,17 @@ public:
                 auto request = reinterpret_cast<const OMClientRequest*>(
                                socket->rcv_buffer_+i);
                 
-                logger_.Log("%:% %() % Received %\n", __FILE__, __LINE__,
-                            __FUNCTION__, Common::GetCurrentTimeStr(&time_str_),
-                            request->ToString());
+                logger_.Log<"%:% %() % Received %\n">(__FILE__, __LINE__,
+                            __FUNCTION__, Common::LogTime{},
+                            *request);
+
+                if(UNLIKELY(request->me_client_request_.client_id_ >= ME_MAX_NUM_CLIENTS)){
+                    logger_.Log<"%:% %() % Received ClientRequest from unknown ClientId: % on socket: %\n">(
+                                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                                request->me_client_request_.client_id_, socket->fd_);
+                    rejected_.Increment();
+                    continue;
+                }
                 
                 if(UNLIKELY(cid_tcp_socket_[request->
                             me_client_request_.client_id_] == nullptr)){
@@ -58,39 +95,64 @@ public:
                 
                 if(cid_tcp_socket_[request
                    ->me_client_request_.client_id_] != socket){
-                    logger_.Log("%:% %() % Received ClientRequest from \
+                    logger_.Log<"%:% %() % Received ClientRequest from \
                                 ClientId: % on different socket: % \
-                                expected: % \n", __FILE__, __LINE__,
+                                expected: % \n">(__FILE__, __LINE__,
                                 __FUNCTION__, 
-                                Common::GetCurrentTimeStr(&time_str_), 
+                                Common::LogTime{}, 
                                 request->me_client_request_.client_id_,
                                 socket->fd_,
                                 cid_tcp_socket_[request->me_client_request_
                                                 .client_id_]->fd_);
+                    rejected_.Increment();
                     continue;
                 }
                 
-                auto next_exp_seq_num = cid_next_exp_seq_num_[request->
+                auto& next_exp_seq_num = cid_next_exp_seq_num_[request->
                                         me_client_request_.client_id_];
                 if(request->seq_num_ != next_exp_seq_num){
-                    logger_.Log("%:% %() % Incorrect sequence number. \
+                    logger_.Log<"%:% %() % Incorrect sequence number. \
                                 ClientId: % SeqNum expected: % received: % \
-                                \n", __FILE__, __LINE__, __FUNCTION__,
-                                Common::GetCurrentTimeStr(&time_str_),
+                                \n">(__FILE__, __LINE__, __FUNCTION__,
+                                Common::LogTime{},
                                 request->me_client_request_.client_id_,
                                 next_exp_seq_num,
                                 request->seq_num_);
                     
+                    rejected_.Increment();
                     continue;
                 }
                 
                 // add client request to the FIFO sequencer
                 ++next_exp_seq_num;
+                // a ticker the exchange doesn't list, only a mass cancel may name none
+                const auto ticker_id = request->me_client_request_.ticker_id_;
+                if(UNLIKELY(!METickerUniverse::Instance()->Contains(ticker_id)
+                            && !(ticker_id == TickerId_INVALID && request->me_client_request_.type_ == ClientRequestType::MASS_CANCEL))){
+                    logger_.Log<"%:% %() % Received ClientRequest for unknown TickerId: % from ClientId: %\n">(
+                                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                                ticker_id, request->me_client_request_.client_id_);
+                    rejected_.Increment();
+                    continue;
+                }
+                // the books are built per side, an order has to be on one of them
+                const auto type = request->me_client_request_.type_;
+                const auto side = request->me_client_request_.side_;
+                if(UNLIKELY((type == ClientRequestType::NEW || type == ClientRequestType::REPLACE) && side != Side::BUY && side != Side::SELL)){
+                    logger_.Log<"%:% %() % Received % with invalid Side: % from ClientId: %\n">(
+                                __FILE__, __LINE__, __FUNCTION__, Common::LogTime{},
+                                ClientRequestTypeToString(type), SideToString(side), request->me_client_request_.client_id_);
+                    rejected_.Increment();
+                    continue;
+                }
+                requests_.Increment();
+                Common::LatencyProbe(LatencyStage::ORDER_SERVER_RECV, static_cast<uint8_t>(request->me_client_request_.type_), rx_time, now);
                 fifo_sequencer_.AddClientRequest(rx_time, 
                                                  request->me_client_request_);                
             }
             
-            memcpy(socket->rcv_buffer_, socket->rcv_buffer_ + i,
+            // a partial request at the end of the buffer may overlap where it moves to
+            memmove(socket->rcv_buffer_, socket->rcv_buffer_ + i,
                    socket->next_rcv_valid_index_ - i); 
                    socket->next_rcv_valid_index_ -= i;
         }
@@ -99,5 +161,29 @@ public:
     auto RecvFinishedCallback() noexcept{
         fifo_sequencer_.SequenceAndPublish();
     }
+
+    // cancel-on-disconnect: every client that was sending on the socket loses its resting orders on all
+    // tickers, and starts a new session with sequence numbers from 1 when it connects again
+    auto DisconnectCallback(TCPSocket* socket) noexcept{
+        const auto now = Common::GetTscNanos();
+        auto disconnected = false;
+        for(ClientId client_id = 0; client_id < ME_MAX_NUM_CLIENTS; ++client_id){
+            if(cid_tcp_socket_[client_id] != socket){
+                continue;
+            }
+            logger_.Log<"%:% %() % ClientId:% disconnected on socket:%, canceling its orders\n">(__FILE__, __LINE__, __FUNCTION__,
+                        Common::LogTime{}, client_id, socket->fd_);
+            cid_tcp_socket_[client_id] = nullptr;
+            cid_next_exp_seq_num_[client_id] = 1;
+            cid_next_outgoing_seq_num_[client_id] = 1;
+            fifo_sequencer_.AddClientRequest(now, MEClientRequest{ClientRequestType::MASS_CANCEL, client_id, TickerId_INVALID,
+                                                                  OrderId_INVALID, Side::INVALID, Price_INVALID, Qty_INVALID});
+            disconnects_.Increment();
+            disconnected = true;
+        }
+        if(disconnected){
+            fifo_sequencer_.SequenceAndPublish();
+        }
+    }
 };
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "journal.h"
+#include "order_server/client_request.h"
+
+/* Prints the client requests a matching engine journaled, in sequence order, from segment first_segment
+   on, then a summary. Torn records (ones the exchange had not finished writing when it stopped) end a
+   segment and are counted, a sequence gap or an unreadable segment ends the read with an error. The
+   journal of shard i is exchange_journal_i, an unsharded exchange writes exchange_journal.
+   Usage: journal_reader [prefix] [first_segment] [summary_only] */
+
+using namespace Common;
+using namespace Exchange;
+
+int main(int argc, char** argv){
+    const std::string prefix = argc > 1 ? argv[1] : "exchange_journal";
+    const size_t first_segment = argc > 2 ? std::atol(argv[2]) : 0;
+    const bool summary_only = argc > 3 && std::atoi(argv[3]) != 0;
+
+    if(!JournalSegmentExists(prefix, first_segment)){
+        std::cerr << "No journal segment " << JournalSegmentName(prefix, first_segment) << std::endl;
+        return 1;
+    }
+    JournalReader reader(prefix, first_segment);
+    JournalRecord record;
+    size_t records = 0, bad_size = 0;
+    uint64_t first_sequence = 0;
+    while(reader.Next(&record)){
+        if(!records){
+            first_sequence = record.sequence_;
+        }
+        ++records;
+        if(record.size_ != sizeof(MEClientRequest)){
+            ++bad_size;
+            continue;
+        }
+        if(!summary_only){
+            MEClientRequest request;
+            std::memcpy(&request, record.payload_, sizeof(request));
+            std::cout << record.sequence_ << " " << request.ToString() << "\n";
+        }
+    }
+    std::cout << "records:" << records << " sequences:" << first_sequence << "-" << (records ? reader.GetNextSequence() - 1 : 0)
+              << " segments:" << (reader.GetSegmentIndex() - first_segment) << " torn:" << reader.GetTornRecords()
+              << " not_requests:" << bad_size << std::endl;
+    if(!reader.GetError().empty()){
+        std::cerr << "Journal " << prefix << " error: " << reader.GetError() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,381 @@
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark_utils.h"
+#include "latency_histogram.h"
+#include "matcher/matching_engine.cpp"
+
+/* Puts synthetic order flow on MatchingEngine shards, each running on its own thread, with no order server or
+   sockets in the way. The generator thread writes requests straight into the ClientRequestLFQueue of the
+   shard owning the ticker, a drain thread empties the response and market update queues of every shard the
+   way the order server merges them, and the run reports:
+   - sustained: requests per second from the first request written to the last response drained
+   - latency <request type> ns: time from writing a request to draining each response it caused
+   - responses and market updates by type
+   every result prefixed with shards:<n>
+   Every request is one of
+   - add: a passive order on a random side, priced 1 + distance ticks away from the ticker's mid, where
+     distance follows `dist` (uniform over [0, spread) or the absolute value of a normal with sigma spread/2)
+   - cancel: one of the generator's orders on the ticker that may still be live, chosen at random. Orders
+     already filled are canceled too and come back CANCEL_REJECTED, the way a real client's late cancels do
+   - aggress: an order priced spread ticks through the mid, so it sweeps resting orders on the other side
+   - replace: one of the generator's orders on the ticker that may still be live gets a new passive price
+     and quantity, the way a market maker re-quotes. Filled orders come back REPLACE_REJECTED
+   picked with the add/cancel/aggress/replace weights, for a random client and ticker. A ticker with max_live
+   orders that may still be live gets a cancel instead of an add or aggress, which keeps the books
+   inside their pools. Results also go to the BENCHMARK_JSON file when it is set.
+   The engines list tickers 0 to tickers - 1, each book created on its ticker's first order with room for
+   book_orders orders and a price band of book_levels, books then reports how many the shards created and their arena bytes.
+   Usage: me_load_generator [key=value ...] with keys
+     requests clients tickers add cancel aggress replace mid spread dist max_qty max_live rate seed idle placement
+     shards book_orders book_levels journal stats
+   rate is requests per second, 0 writes as fast as the engine drains. idle is the engine's
+   IdleStrategyType, placement a thread placement config as taken by the exchange. shards is a comma
+   separated list of shard counts, the same flow is run once per count, which gives the scaling curve
+   when each engine thread is placed on its own core. journal is OFF (the default) or the JournalSyncPolicy
+   of a journal each engine keeps the way the exchange does, written to exchange_journal* in the working
+   directory. stats=1 publishes the engines' stats in a shared memory segment of this process's own, its
+   name is printed for tools/stats_reader and it is removed at exit, by default they stay private and never
+   touch the exchange's. */
+
+using namespace Exchange;
+
+struct LoadConfig{
+    size_t requests_ = 1000000;
+    size_t clients_ = 64;
+    size_t tickers_ = ME_DEFAULT_TICKERS;
+    unsigned add_weight_ = 60;
+    unsigned cancel_weight_ = 30;
+    unsigned aggress_weight_ = 10;
+    unsigned replace_weight_ = 0;
+    Price mid_ = 10000;
+    Price spread_ = 50;
+    bool normal_ = false;
+    Qty max_qty_ = 100;
+    size_t max_live_ = 10000;
+    double rate_ = 0;
+    uint64_t seed_ = 1;
+    IdleStrategyType idle_strategy_ = IdleStrategyType::BUSY_SPIN;
+    std::string placement_;
+    std::vector<size_t> shards_ = {1};
+    size_t book_orders_ = ME_MAX_ORDER_IDS;
+    size_t book_levels_ = ME_MAX_PRICE_LEVELS;
+    bool journal_ = false;
+    JournalConfig journal_config_;
+    bool stats_ = false;
+};
+
+auto ParseConfig(int argc, char** argv){
+    LoadConfig config;
+    for(int i = 1; i < argc; ++i){
+        const std::string arg = argv[i];
+        const auto equals = arg.find('=');
+        ASSERT(equals != std::string::npos, "Expected key=value, got " + arg);
+        const auto key = arg.substr(0, equals);
+        const auto value = arg.substr(equals + 1);
+        if(key == "requests"){ config.requests_ = std::stoull(value); }
+        else if(key == "clients"){ config.clients_ = std::stoull(value); }
+        else if(key == "tickers"){ config.tickers_ = std::stoull(value); }
+        else if(key == "add"){ config.add_weight_ = std::stoul(value); }
+        else if(key == "cancel"){ config.cancel_weight_ = std::stoul(value); }
+        else if(key == "aggress"){ config.aggress_weight_ = std::stoul(value); }
+        else if(key == "replace"){ config.replace_weight_ = std::stoul(value); }
+        else if(key == "mid"){ config.mid_ = std::stoll(value); }
+        else if(key == "spread"){ config.spread_ = std::stoll(value); }
+        else if(key == "dist"){
+            ASSERT(value == "uniform" || value == "normal", "dist is uniform or normal, got " + value);
+            config.normal_ = (value == "normal");
+        }
+        else if(key == "max_qty"){ config.max_qty_ = std::stoul(value); }
+        else if(key == "max_live"){ config.max_live_ = std::stoull(value); }
+        else if(key == "rate"){ config.rate_ = std::stod(value); }
+        else if(key == "seed"){ config.seed_ = std::stoull(value); }
+        else if(key == "idle"){
+            ASSERT(IdleStrategyTypeFromString(value, &config.idle_strategy_), "Unknown idle strategy " + value);
+        }
+        else if(key == "placement"){ config.placement_ = value; }
+        else if(key == "book_orders"){ config.book_orders_ = std::stoull(value); }
+        else if(key == "book_levels"){ config.book_levels_ = std::stoull(value); }
+        else if(key == "stats"){ config.stats_ = (std::stoul(value) != 0); }
+        else if(key == "journal"){
+            config.journal_ = (value != "OFF");
+            ASSERT(!config.journal_ || JournalSyncPolicyFromString(value, &config.journal_config_.sync_policy_), "Unknown journal sync policy " + value);
+        }
+        else if(key == "shards"){
+            config.shards_.clear();
+            for(size_t begin = 0; begin < value.size();){
+                const auto end = std::min(value.find(',', begin), value.size());
+                config.shards_.push_back(std::stoull(value.substr(begin, end - begin)));
+                begin = end + 1;
+            }
+        }
+        else{ FATAL("Unknown option " + key); }
+    }
+    ASSERT(config.clients_ >= 1 && config.clients_ <= ME_MAX_NUM_CLIENTS, "clients must be 1-" + std::to_string(ME_MAX_NUM_CLIENTS));
+    ASSERT(config.tickers_ >= 1 && config.tickers_ <= ME_MAX_TICKERS, "tickers must be 1-" + std::to_string(ME_MAX_TICKERS));
+    ASSERT(config.add_weight_ + config.cancel_weight_ + config.aggress_weight_ + config.replace_weight_ > 0, "add, cancel, aggress and replace weights are all 0");
+    ASSERT(config.spread_ >= 1 && config.spread_ < config.mid_, "spread must be at least 1 and below mid");
+    ASSERT(config.max_qty_ >= 1 && config.max_live_ >= 1, "max_qty and max_live must be at least 1");
+    ASSERT(config.book_orders_ >= 1 && config.book_orders_ <= ME_MAX_ORDER_IDS, "book_orders must be 1-" + std::to_string(ME_MAX_ORDER_IDS));
+    ASSERT(config.max_live_ <= config.book_orders_, "max_live orders do not fit a book of book_orders");
+    ASSERT(config.book_levels_ >= 2 && config.book_levels_ <= ME_MAX_PRICE_LEVELS, "book_levels must be 2-" + std::to_string(ME_MAX_PRICE_LEVELS));
+    ASSERT(!config.shards_.empty(), "shards needs at least one shard count");
+    for(const auto shards : config.shards_){
+        ASSERT(shards >= 1 && shards <= ME_MAX_SHARDS, "shards must be 1-" + std::to_string(ME_MAX_SHARDS));
+    }
+    return config;
+}
+
+// writes the requests, remembers which orders may still be live so cancels have something to hit
+class OrderFlow final{
+private:
+    struct LiveOrder{
+        ClientId client_id_;
+        OrderId order_id_;
+        Side side_;
+    };
+
+    const LoadConfig& config_;
+    std::mt19937_64 random_;
+    std::vector<OrderId> next_order_id_;
+    std::vector<std::vector<LiveOrder>> live_orders_;
+
+    auto Random(uint64_t bound) noexcept{
+        return std::uniform_int_distribution<uint64_t>(0, bound - 1)(random_);
+    }
+
+    auto Distance() noexcept -> Price{
+        if(config_.normal_){
+            const auto distance = std::abs(std::normal_distribution<double>(0, config_.spread_ / 2.0)(random_));
+            return std::min<Price>(static_cast<Price>(distance), config_.mid_ - 2);
+        }
+        return Random(config_.spread_);
+    }
+
+public:
+    explicit OrderFlow(const LoadConfig& config): config_(config), random_(config.seed_), next_order_id_(config.clients_, 1),
+                                                  live_orders_(config.tickers_){
+        for(auto& live : live_orders_){
+            live.reserve(config.max_live_);
+        }
+    }
+
+    // price for a passive order, on its own side of the mid
+    auto PassivePrice(Side side) noexcept{
+        const auto offset = 1 + Distance();
+        return (side == Side::BUY ? config_.mid_ - offset : config_.mid_ + offset);
+    }
+
+    auto Next() noexcept -> MEClientRequest{
+        const TickerId ticker_id = Random(config_.tickers_);
+        auto& live = live_orders_[ticker_id];
+        const auto pick = Random(config_.add_weight_ + config_.cancel_weight_ + config_.aggress_weight_ + config_.replace_weight_);
+        const auto replace = (!live.empty() && pick >= config_.add_weight_ + config_.cancel_weight_ + config_.aggress_weight_);
+        if(replace){
+            const auto& order = live[Random(live.size())];
+            return MEClientRequest{ClientRequestType::REPLACE, order.client_id_, ticker_id, order.order_id_, order.side_,
+                                   PassivePrice(order.side_), static_cast<Qty>(1 + Random(config_.max_qty_))};
+        }
+        const auto cancel = (!live.empty() && (live.size() >= config_.max_live_ || (pick >= config_.add_weight_ && pick < config_.add_weight_ + config_.cancel_weight_)));
+        if(cancel){
+            const auto index = Random(live.size());
+            const auto order = live[index];
+            live[index] = live.back();
+            live.pop_back();
+            return MEClientRequest{ClientRequestType::CANCEL, order.client_id_, ticker_id, order.order_id_, Side::INVALID, Price_INVALID, Qty_INVALID};
+        }
+
+        const ClientId client_id = Random(config_.clients_);
+        const auto side = (Random(2) ? Side::BUY : Side::SELL);
+        // a replace on a ticker with no orders becomes an add
+        const auto aggress = (pick >= config_.add_weight_ + config_.cancel_weight_ && pick < config_.add_weight_ + config_.cancel_weight_ + config_.aggress_weight_);
+        // aggressive orders reach through the mid
+        const auto price = (aggress ? (side == Side::BUY ? config_.mid_ + config_.spread_ : config_.mid_ - config_.spread_) : PassivePrice(side));
+        const auto order_id = next_order_id_[client_id]++;
+        // an aggressive order rests too if it does not fill completely
+        live.push_back(LiveOrder{client_id, order_id, side});
+        return MEClientRequest{ClientRequestType::NEW, client_id, ticker_id, order_id, side, price, static_cast<Qty>(1 + Random(config_.max_qty_))};
+    }
+};
+
+// empties the output queues of every shard and records when each response was drained
+class Drain final{
+private:
+    std::vector<ClientResponseLFQueue*> responses_;
+    std::vector<MEMarketUpdateLFQueue*> market_updates_;
+    std::array<LatencyHistogram, LATENCY_MAX_TAGS> latency_;
+    std::array<size_t, 16> responses_by_type_ = {};
+    std::array<size_t, 8> updates_by_type_ = {};
+    Nanos last_response_time_ = 0;
+
+public:
+    Drain(const std::vector<ClientResponseLFQueue*>& responses, const std::vector<MEMarketUpdateLFQueue*>& market_updates):
+          responses_(responses), market_updates_(market_updates){
+
+    }
+
+    // true when it drained anything
+    auto Poll() noexcept{
+        auto drained = false;
+        for(auto queue : responses_){
+            const auto responses = queue->GetReadSpan();
+            if(!responses.empty()){
+                const auto now = GetTscNanos();
+                for(const auto& response : responses){
+                    latency_[static_cast<size_t>(response.request_type_) & (LATENCY_MAX_TAGS - 1)].Record(now - response.rx_time_);
+                    ++responses_by_type_[static_cast<size_t>(response.response_.type_) & 15];
+                }
+                last_response_time_ = now;
+                queue->UpdateReadIndex(responses.size());
+                drained = true;
+            }
+        }
+        for(auto queue : market_updates_){
+            const auto updates = queue->GetReadSpan();
+            for(const auto& update : updates){
+                ++updates_by_type_[static_cast<size_t>(update.type_) & 7];
+            }
+            queue->UpdateReadIndex(updates.size());
+            drained |= !updates.empty();
+        }
+        return drained;
+    }
+
+    auto GetLastResponseTime() const noexcept{
+        return last_response_time_;
+    }
+
+    // prefix tells the results of runs with different shard counts apart
+    auto Print(const std::string& prefix) const{
+        for(size_t tag = 0; tag < latency_.size(); ++tag){
+            const auto& latency = latency_[tag];
+            if(latency.GetCount()){
+                PrintMetrics(prefix + "latency " + ClientRequestTypeToString(static_cast<ClientRequestType>(tag)) + " ns",
+                             {{"responses", latency.GetCount()}, {"p50", latency.GetPercentile(0.5)}, {"p90", latency.GetPercentile(0.9)},
+                              {"p99", latency.GetPercentile(0.99)}, {"p99.9", latency.GetPercentile(0.999)}, {"max", latency.GetMax()},
+                              {"mean", latency.GetMean()}});
+            }
+        }
+        PrintMetrics(prefix + "responses", {{"ACCEPTED", responses_by_type_[static_cast<size_t>(ClientResponseType::ACCEPTED)]},
+                                   {"CANCELED", responses_by_type_[static_cast<size_t>(ClientResponseType::CANCELED)]},
+                                   {"FILLED", responses_by_type_[static_cast<size_t>(ClientResponseType::FILLED)]},
+                                   {"CANCEL_REJECTED", responses_by_type_[static_cast<size_t>(ClientResponseType::CANCEL_REJECTED)]},
+                                   {"REPLACED", responses_by_type_[static_cast<size_t>(ClientResponseType::REPLACED)]},
+                                   {"REPLACE_REJECTED", responses_by_type_[static_cast<size_t>(ClientResponseType::REPLACE_REJECTED)]},
+                                   {"NEW_REJECTED", responses_by_type_[static_cast<size_t>(ClientResponseType::NEW_REJECTED)]}});
+        PrintMetrics(prefix + "market updates", {{"ADD", updates_by_type_[static_cast<size_t>(MarketUpdateType::ADD)]},
+                                        {"MODIFY", updates_by_type_[static_cast<size_t>(MarketUpdateType::MODIFY)]},
+                                        {"CANCEL", updates_by_type_[static_cast<size_t>(MarketUpdateType::CANCEL)]},
+                                        {"TRADE", updates_by_type_[static_cast<size_t>(MarketUpdateType::TRADE)]}});
+    }
+};
+
+auto RunLoad(const LoadConfig& config, size_t num_shards){
+    std::vector<std::unique_ptr<ClientRequestLFQueue>> requests;
+    std::vector<std::unique_ptr<ClientResponseLFQueue>> responses;
+    std::vector<std::unique_ptr<MEMarketUpdateLFQueue>> market_updates;
+    std::vector<std::unique_ptr<MatchingEngine>> engines;
+    for(size_t shard = 0; shard < num_shards; ++shard){
+        requests.push_back(std::make_unique<ClientRequestLFQueue>(ME_MAX_CLIENT_UPDATES));
+        responses.push_back(std::make_unique<ClientResponseLFQueue>(ME_MAX_CLIENT_UPDATES));
+        market_updates.push_back(std::make_unique<MEMarketUpdateLFQueue>(ME_MAX_MARKET_UPDATES));
+        engines.push_back(std::make_unique<MatchingEngine>(requests.back().get(), responses.back().get(), market_updates.back().get(),
+                                                           config.idle_strategy_, shard, num_shards,
+                                                           (config.journal_ ? &config.journal_config_ : nullptr)));
+        engines.back()->Start();
+    }
+
+    std::vector<ClientResponseLFQueue*> drained_responses;
+    std::vector<MEMarketUpdateLFQueue*> drained_updates;
+    for(size_t shard = 0; shard < num_shards; ++shard){
+        drained_responses.push_back(responses[shard].get());
+        drained_updates.push_back(market_updates[shard].get());
+    }
+    auto drain = std::make_unique<Drain>(drained_responses, drained_updates);
+    std::atomic<bool> generating = {true};
+    auto drain_thread = CreateAndStartThread(-1, "Tools/LoadDrain", [&](){
+        // stops once generation is over and the engine has been quiet for a while
+        Nanos quiet_since = 0;
+        while(true){
+            if(drain->Poll()){
+                quiet_since = 0;
+                continue;
+            }
+            if(!generating.load(std::memory_order_acquire)){
+                const auto now = GetTscNanos();
+                if(!quiet_since){
+                    quiet_since = now;
+                }else if(now - quiet_since > 100 * NANOS_TO_MILLIS){
+                    return;
+                }
+            }
+            CpuRelax();
+        }
+    });
+    ASSERT(drain_thread != nullptr, "Failed to start drain thread.");
+
+    OrderFlow flow(config);
+    const auto gap = (config.rate_ > 0 ? static_cast<Nanos>(NANOS_TO_SECS / config.rate_) : 0);
+    const auto start = GetTscNanos();
+    for(size_t i = 0; i < config.requests_; ++i){
+        if(gap){
+            const auto send_time = start + static_cast<Nanos>(i) * gap;
+            while(GetTscNanos() < send_time){
+                CpuRelax();
+            }
+        }
+        const auto request = flow.Next();
+        auto& queue = *requests[TickerIdToShard(request.ticker_id_, num_shards)];
+        auto next_write = queue.GetNextToWriteTo();
+        while(UNLIKELY(!next_write)){
+            next_write = queue.GetNextToWriteTo();
+        }
+        *next_write = MEClientRequestEnvelope{request, GetTscNanos()};
+        queue.UpdateWriteIndex();
+    }
+    generating.store(false, std::memory_order_release);
+    drain_thread->join();
+    delete drain_thread;
+
+    const auto prefix = "shards:" + std::to_string(num_shards) + " ";
+    PrintThroughput(prefix + "sustained", config.requests_, drain->GetLastResponseTime() - start);
+    drain->Print(prefix);
+    size_t books = 0;
+    size_t book_bytes = 0;
+    for(const auto& engine : engines){
+        books += engine->GetNumOrderBooks();
+        book_bytes += engine->GetBookArenaBytes();
+    }
+    PrintMetrics(prefix + "books", {{"created", books}, {"arena_bytes", book_bytes}});
+
+    // the engines stop before the queues they read go away
+    for(auto& engine : engines){
+        engine->Stop();
+    }
+    engines.clear();
+}
+
+int main(int argc, char** argv){
+    const auto config = ParseConfig(argc, argv);
+    METickerUniverse::Instance()->Reset(config.tickers_, config.book_orders_, config.book_levels_);
+    const auto segment = std::string(STATS_SEGMENT_NAME) + ".load_generator." + std::to_string(getpid());
+    if(config.stats_){
+        ASSERT(StatsSegment::Instance()->Publish(segment, STATS_BASE_SLOTS + config.tickers_ * ME_STATS_PER_TICKER),
+               "Could not publish stats segment " + segment);
+        std::cout << "Publishing stats in " << segment << std::endl;
+    }
+    if(!config.placement_.empty()){
+        ASSERT(ThreadPlacementConfig::Instance()->Load(config.placement_), "Invalid thread placement config " + config.placement_);
+    }
+    for(const auto num_shards : config.shards_){
+        RunLoad(config, num_shards);
+    }
+    // the name is this run's alone, nobody reads it once the run is over
+    if(config.stats_){
+        shm_unlink(segment.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "stats_segment.h"
+
+/* Prints the counters and gauges the exchange publishes in its shared memory stats segment, every
+   interval_ms milliseconds, with the rate per second of each counter since the previous print. Only
+   maps the segment read only, the exchange never notices it is being watched. segment names another
+   process's segment, such as the one me_load_generator stats=1 prints.
+   Usage: stats_reader [interval_ms] [name filter] [segment] */
+
+using namespace Common;
+
+int main(int argc, char** argv){
+    const long interval_ms = argc > 1 ? std::atol(argv[1]) : 1000;
+    const std::string filter = argc > 2 ? argv[2] : "";
+    const std::string segment = argc > 3 ? argv[3] : STATS_SEGMENT_NAME;
+
+    const auto fd = shm_open(segment.c_str(), O_RDONLY, 0);
+    if(fd < 0){
+        std::cerr << "Could not open stats segment " << segment << " error: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    // the header gives the capacity the writer sized the segment for
+    struct stat segment_stat;
+    if(fstat(fd, &segment_stat) != 0 || static_cast<size_t>(segment_stat.st_size) < sizeof(StatsSegmentHeader)){
+        std::cerr << "Stats segment " << segment << " is not initialized" << std::endl;
+        close(fd);
+        return 1;
+    }
+    auto memory = mmap(nullptr, segment_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED){
+        std::cerr << "Could not map stats segment " << segment << " error: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    const auto header = static_cast<const StatsSegmentHeader*>(memory);
+    if(header->magic_ != STATS_SEGMENT_MAGIC || StatsSegmentSize(header->capacity_) > static_cast<size_t>(segment_stat.st_size)){
+        std::cerr << "Stats segment " << segment << " has an unknown layout" << std::endl;
+        return 1;
+    }
+    const auto slots = reinterpret_cast<const StatSlot*>(header + 1);
+
+    std::vector<uint64_t> last_values(header->capacity_, 0);
+    for(size_t i = 0; i < header->num_slots_.load(std::memory_order_acquire); ++i){
+        last_values[i] = slots[i].value_.load(std::memory_order_relaxed);
+    }
+    auto last_time = GetCurrentNanos();
+    while(true){
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+        const auto now = GetCurrentNanos();
+        const auto elapsed_seconds = static_cast<double>(now - last_time) / NANOS_TO_SECS;
+        last_time = now;
+
+        // the slots below num_slots_ are fully written, later ones may still be registering
+        const auto num_slots = header->num_slots_.load(std::memory_order_acquire);
+        const auto alive = (kill(header->pid_, 0) == 0 || errno == EPERM);
+        std::string time_str;
+        std::cout << GetCurrentTimeStr(&time_str) << " pid:" << header->pid_ << (alive ? "" : " (exited)") << " stats:" << num_slots << "\n";
+        for(size_t i = 0; i < num_slots; ++i){
+            const auto& slot = slots[i];
+            if(!filter.empty() && std::string(slot.name_).find(filter) == std::string::npos){
+                continue;
+            }
+            const auto value = slot.value_.load(std::memory_order_relaxed);
+            std::cout << "  " << slot.name_ << " " << StatKindToString(slot.kind_) << " " << value;
+            if(slot.kind_ == StatKind::COUNTER){
+                std::cout << " " << static_cast<uint64_t>((value - last_values[i]) / elapsed_seconds) << "/s";
+            }
+            std::cout << "\n";
+            last_values[i] = value;
+        }
+        std::cout.flush();
+    }
+    return 0;
+}